@@ -12,15 +12,23 @@
 #include "ascii_tree.h"
 #include "reos_debugger.h"
 #include "reos_kernel.h"
+#include "reos_parallel.h"
 #include "reos_stdlib.h"
 #include "percent_debugger.h"
 #include "profile_debugger.h"
+#include "readahead_input.h"
+#include "reos_image.h"
+#include "sample_debugger.h"
 #include "shell_debugger.h"
+#include "standard_inst.h"
+#include "timeline_debugger.h"
+#include "trace_debugger.h"
 
 static void print_usage()
 {
 	fprintf(stderr,
 			"Usage: ascii [OPTION]... REGEX INPUT\n"
+			"  or:  ascii [OPTION]... --image IMAGE INPUT\n"
 			"Options:\n"
 			"	-m, --matches\n"
 			"		show matches\n"
@@ -28,6 +36,23 @@ static void print_usage()
 			"		attach GDB-like shell debugger\n"
 			"	-p, --profile\n"
 			"		collect performance data\n"
+			"	--sample HZ\n"
+			"		profile by sampling the running pc HZ times per CPU second\n"
+			"	--counters\n"
+			"		with --profile, also read the CPU's hardware counters\n"
+			"	--timeline FILE\n"
+			"		write thread counts over the input, in at most 4096 buckets, to FILE\n"
+			"	--trace FILE\n"
+			"		record the last million kernel events to FILE, for reos-trace\n"
+			"	--optimize\n"
+			"		optimize the regex's tree\n"
+			"	--no-closures\n"
+			"		run the jmps and splits between instructions one at a time, instead\n"
+			"		of through closures\n"
+			"	--save-image IMAGE\n"
+			"		save the compiled regex to IMAGE\n"
+			"	--image IMAGE\n"
+			"		load the compiled regex from IMAGE instead of taking a REGEX\n"
 			"	-h, --help\n"
 			"		display this help\n"
 			"	-r, --regex\n"
@@ -38,6 +63,12 @@ static void print_usage()
 			"		match only at the starting offset\n"
 			"	-f, --file\n"
 			"		treat INPUT as a file path\n"
+			"	-M, --mmap\n"
+			"		treat INPUT as a file path and map it into memory\n"
+			"	-j, --jobs JOBS\n"
+			"		with -M, match on JOBS threads\n"
+			"	-R, --readahead\n"
+			"		treat INPUT as a file path and read it on a background thread\n"
 			"	-b, --backtrack-caps\n"
 			"		find all captures by sometimes backtracking\n");
 	exit(0);
@@ -51,9 +82,20 @@ int main(int argc, char **argv)
 	int matches = 0;
 	int debug = 0;
 	int profile = 0;
+	int counters = 0;
+	int sample = 0;
+	char *trace = 0;
+	char *timeline = 0;
 	int file = 0;
-	int offset = 0;
+	int map = 0;
+	int readahead = 0;
+	int optimize = 0;
+	int closures = 1;
+	char *save_image = 0;
+	char *image = 0;
+	long offset = 0;
 	int percent = 0;
+	int jobs = 0;
 
 	int i;
 	for (i = 1; i < argc; i++) {
@@ -63,6 +105,22 @@ int main(int argc, char **argv)
 			debug = 1;
 		else if (!strcmp(argv[i], "--profile"))
 			profile = 1;
+		else if (!strcmp(argv[i], "--counters"))
+			counters = 1;
+		else if (!strcmp(argv[i], "--optimize"))
+			optimize = 1;
+		else if (!strcmp(argv[i], "--no-closures"))
+			closures = 0;
+		else if (!strcmp(argv[i], "--save-image"))
+			save_image = argv[++i];
+		else if (!strcmp(argv[i], "--image"))
+			image = argv[++i];
+		else if (!strcmp(argv[i], "--sample"))
+			sample = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--trace"))
+			trace = argv[++i];
+		else if (!strcmp(argv[i], "--timeline"))
+			timeline = argv[++i];
 		else if (!strcmp(argv[i], "--percent"))
 			percent = 1;
 		else if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help"))
@@ -72,20 +130,36 @@ int main(int argc, char **argv)
 			break;
 		}
 		else if (!strcmp(argv[i], "-o") || !strcmp(argv[i], "--offset"))
-			offset = atoi(argv[++i]);
+			offset = atol(argv[++i]);
 		else if (!strcmp(argv[i], "-a") || !strcmp(argv[i], "--anchored"))
 			ops |= REOS_ANCHORED;
 		else if (!strcmp(argv[i], "-p") || !strcmp(argv[i], "--partial"))
 			ops |= REOS_PARTIAL;
 		else if (!strcmp(argv[i], "-f") || !strcmp(argv[i], "--file"))
 			file = 1;
+		else if (!strcmp(argv[i], "-M") || !strcmp(argv[i], "--mmap"))
+			map = 1;
+		else if (!strcmp(argv[i], "-j") || !strcmp(argv[i], "--jobs"))
+			jobs = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-R") || !strcmp(argv[i], "--readahead"))
+			readahead = 1;
 		else if (!strcmp(argv[i], "-b") || !strcmp(argv[i], "--backtrack-matching"))
 			ops |= REOS_BACKTRACK_MATCHING;
 		else
 			break;
 	}
 
-	if (i+2 < argc) {
+	if (image) {
+		if (i+1 < argc) {
+			fprintf(stderr, "Error: Too many arguments\n\n");
+			print_usage();
+		}
+		else if (i+1 > argc) {
+			fprintf(stderr, "Error: Specify an input\n\n");
+			print_usage();
+		}
+	}
+	else if (i+2 < argc) {
 		fprintf(stderr, "Error: Too many arguments\n\n");
 		print_usage();
 	}
@@ -98,36 +172,64 @@ int main(int argc, char **argv)
 		print_usage();
 	}
 
-	TreeNode *tree = ascii_expression_compile(argv[i++]);
-	if (!tree) {
-		fprintf(stderr, "Error: Invalid regular expression\n\n");
-		print_usage();
+	ReOS_Pattern *pattern;
+	ReOS_PatternInfo info;
+	if (image) {
+		pattern = new_image_pattern(image, ASCII_INST_SET, &info);
+		if (!pattern)
+			exit(1);
 	}
+	else {
+		TreeNode *tree = ascii_expression_compile(argv[i++]);
+		if (!tree) {
+			fprintf(stderr, "Error: Invalid regular expression\n\n");
+			print_usage();
+		}
 
-	if (debug) {
-		print_ascii_tree(tree);
-		printf("\n");
+		if (optimize)
+			tree = ascii_tree_optimize(tree);
+
+		if (debug) {
+			print_ascii_tree(tree);
+			printf("\n");
+		}
+
+		pattern = new_mem_pattern();
+		standard_tree_compile(pattern, tree, ascii_inst_factory, ascii_tree_node_compile);
+		if (closures)
+			standard_pattern_compute_closures(pattern);
+		free_ascii_tree_node(tree);
+		standard_pattern_info(pattern, &info);
+	}
+
+	if (save_image && reos_pattern_write_image(pattern, ascii_inst_args_size, ASCII_INST_SET, &info, save_image)) {
+		fprintf(stderr, "error: could not write image to %s\n", save_image);
+		exit(1);
 	}
 
 	ReOS_Input *input;
-	if (file)
+	ReOS_Input *file_input = 0;
+	if (map)
+		input = new_ascii_mmap_input(argv[i]);
+	else if (readahead) {
+		file_input = new_ascii_file_input(argv[i]);
+		input = new_readahead_input(file_input, 0, 0);
+	}
+	else if (file)
 		input = new_ascii_file_input(argv[i]);
 	else
 		input = new_ascii_string_input(argv[i]);
 
-	ReOS_Pattern *pattern = new_mem_pattern();
-	standard_tree_compile(pattern, tree, ascii_inst_factory, ascii_tree_node_compile);
-	free_ascii_tree_node(tree);
-
 	ReOS_Kernel *vm = new_reos_kernel(pattern, execute_ascii_inst, -1);
 	vm->test_backref = ascii_test_backref;
+	vm->history_size = info.history_size;
 
 	ReOS_Debugger *shell_debugger;
 	if (debug) {
 		shell_debugger = new_shell_debugger();
 		ShellDebuggerData *data = shell_debugger->data;
 		data->print_inst = print_ascii_inst;
-		if (!file)
+		if (!file && !map && !readahead)
 			data->print_input = print_ascii_string_input;
 
 		reos_simplelist_push_tail(vm->debuggers, shell_debugger);
@@ -136,16 +238,46 @@ int main(int argc, char **argv)
 	ReOS_Debugger *profile_debugger;
 	if (profile) {
 		profile_debugger = new_profile_debugger();
+		if (counters)
+			profile_debugger_open_counters(profile_debugger);
 		reos_simplelist_push_tail(vm->debuggers, profile_debugger);
 	}
 
+	ReOS_Debugger *trace_debugger;
+	if (trace) {
+		trace_debugger = new_trace_debugger(1 << 20);
+		reos_simplelist_push_tail(vm->debuggers, trace_debugger);
+	}
+
+	ReOS_Debugger *sample_debugger;
+	if (sample) {
+		sample_debugger = new_sample_debugger(sample);
+		reos_simplelist_push_tail(vm->debuggers, sample_debugger);
+	}
+
+	ReOS_Debugger *timeline_debugger;
+	if (timeline) {
+		timeline_debugger = new_timeline_debugger(1, 4096);
+		reos_simplelist_push_tail(vm->debuggers, timeline_debugger);
+	}
+
 	ReOS_Debugger *percent_debugger;
 	if (percent) {
 		percent_debugger = new_percent_debugger();
 		reos_simplelist_push_tail(vm->debuggers, percent_debugger);
 	}
 
-	reos_kernel_execute(vm, input, offset, ops);
+	if (map && jobs > 1) {
+		ReOS_InputFactory factory = {
+			(OpenInputFunc)new_ascii_mmap_input,
+			(VoidPtrFunc)free_ascii_mmap_input,
+			argv[i]
+		};
+		long length = ((AsciiMmapInputData *)input->data)->len;
+		reos_kernel_execute_parallel(vm, &factory, length, info.max_length, jobs, ops);
+	}
+	else
+		reos_kernel_execute(vm, input, offset, ops);
 
 	if (matches) {
 		printf("| Match\tSub\tIndexes\tReconstruction\n");
@@ -166,7 +298,7 @@ int main(int argc, char **argv)
 							int capture_len = cap->end - cap->start;
 
 							char reconst[capture_len];
-							reos_capture_reconstruct(cap, vm->token_buf->input, reconst);
+							reos_capture_reconstruct(cap, input, reconst);
 							printf("%ld]\t%.*s", cap->end, capture_len, reconst);
 						}
 						printf("\n");
@@ -180,20 +312,55 @@ int main(int argc, char **argv)
 		}
 	}
 
-	if (profile)
+	if (profile) {
 		profile_debugger_print_results(profile_debugger);
+		profile_debugger_print_listing(profile_debugger, print_ascii_inst);
+	}
+
+	if (trace) {
+		if (trace_debugger_write(trace_debugger, trace) == -1) {
+			fprintf(stderr, "error: could not write trace to %s\n", trace);
+			exit(1);
+		}
+		free_trace_debugger(trace_debugger);
+	}
+
+	if (sample) {
+		sample_debugger_print_results(sample_debugger, print_ascii_inst);
+		free_sample_debugger(sample_debugger);
+	}
+
+	if (timeline) {
+		FILE *f = fopen(timeline, "w");
+		if (!f) {
+			fprintf(stderr, "error: could not write timeline to %s\n", timeline);
+			exit(1);
+		}
+		timeline_debugger_write(timeline_debugger, f);
+		fclose(f);
+		free_timeline_debugger(timeline_debugger);
+	}
 
 	if (debug)
 		free_shell_debugger(shell_debugger);
 	if (profile)
 		free_profile_debugger(profile_debugger);
 
-	if (file)
+	if (map)
+		free_ascii_mmap_input(input);
+	else if (readahead) {
+		free_readahead_input(input);
+		free_ascii_file_input(file_input);
+	}
+	else if (file)
 		free_ascii_file_input(input);
 	else
 		free_ascii_string_input(input);
 
-	free_mem_pattern(pattern);
+	if (image)
+		free_image_pattern(pattern);
+	else
+		free_mem_pattern(pattern);
 	free_reos_kernel(vm);
 	return 0;
 }
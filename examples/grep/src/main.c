@@ -0,0 +1,636 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <Judy.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "ascii_expression.h"
+#include "ascii_input.h"
+#include "ascii_inst.h"
+#include "ascii_tree.h"
+#include "reos_capture.h"
+#include "reos_kernel.h"
+#include "reos_stdlib.h"
+#include "standard_inst.h"
+
+/**
+ * \file
+ *
+ * A grep work-alike. Each file is mapped into memory and matched one line at
+ * a time, with the kernel reset between lines, so a match never spans a line
+ * break and every match is reported at most once per line.
+ *
+ * Before matching, the regex tree is searched for a literal string that
+ * every match must contain. Lines without it are skipped with memmem(),
+ * without running the kernel at all; on most real searches that's nearly all
+ * of them.
+ *
+ * Files are handed out to a pool of threads, each with its own kernel. Each
+ * file's output is collected in memory and printed in command line order.
+ */
+
+typedef struct GrepString GrepString;
+typedef struct GrepLiteral GrepLiteral;
+typedef struct GrepFile GrepFile;
+typedef struct GrepMatch GrepMatch;
+typedef struct GrepWorker GrepWorker;
+typedef struct Grep Grep;
+
+struct GrepString
+{
+	char *s;
+	int len;
+};
+
+/**
+ * What's known about the strings a tree node can match.
+ */
+struct GrepLiteral
+{
+	// the node matches exactly one string, which is prefix, suffix and best
+	int exact;
+
+	// every string the node matches starts with prefix, ends with suffix and
+	// contains best
+	GrepString prefix;
+	GrepString suffix;
+	GrepString best;
+};
+
+struct GrepFile
+{
+	char *path;
+	char *out;
+	size_t out_len;
+	int selected;
+	int error;
+	int done;
+};
+
+struct GrepMatch
+{
+	long start;
+	long end;
+};
+
+struct GrepWorker
+{
+	Grep *grep;
+	pthread_t thread;
+	ReOS_Kernel *k;
+	ReOS_Input *line_input;
+
+	GrepMatch *parts;
+	int max_parts;
+
+	long bytes;
+	long lines;
+	long executed;
+};
+
+struct Grep
+{
+	ReOS_Pattern *pattern;
+	int whole_capture;
+	GrepString literal;
+
+	int count;
+	int list;
+	int invert;
+	int only_matching;
+	int prefix;
+
+	GrepFile *files;
+	int num_files;
+	int next_file;
+	pthread_mutex_t lock;
+	pthread_cond_t file_done;
+};
+
+static void print_usage()
+{
+	fprintf(stderr,
+			"Usage: reos-grep [OPTION]... REGEX FILE...\n"
+			"Options:\n"
+			"	-c, --count\n"
+			"		print only the number of selected lines in each file\n"
+			"	-l, --files-with-matches\n"
+			"		print only the names of files with selected lines\n"
+			"	-v, --invert-match\n"
+			"		select lines that don't match\n"
+			"	-o, --only-matching\n"
+			"		print only the matched parts of selected lines\n"
+			"	-j, --jobs JOBS\n"
+			"		search JOBS files at a time (default: one per processor)\n"
+			"	-s, --stats\n"
+			"		print scan statistics to standard error\n"
+			"	--optimize\n"
+			"		optimize the regex's tree\n"
+			"	--no-closures\n"
+			"		run the jmps and splits between instructions one at a time, instead\n"
+			"		of through closures\n"
+			"	-h, --help\n"
+			"		display this help\n"
+			"	-e, --regexp\n"
+			"		force the next argument to be interpreted as REGEX and not as an option\n");
+	exit(2);
+}
+
+static GrepString new_grep_string(char *s, int len)
+{
+	GrepString str = {malloc(len + 1), len};
+	memcpy(str.s, s, len);
+	return str;
+}
+
+static GrepString grep_string_concat(GrepString a, GrepString b)
+{
+	GrepString str = {malloc(a.len + b.len + 1), a.len + b.len};
+	memcpy(str.s, a.s, a.len);
+	memcpy(str.s + a.len, b.s, b.len);
+	return str;
+}
+
+static void free_grep_literal(GrepLiteral *lit)
+{
+	free(lit->prefix.s);
+	free(lit->suffix.s);
+	free(lit->best.s);
+}
+
+static void grep_literal_init(GrepLiteral *lit, int exact, GrepString prefix, GrepString suffix,
+							  GrepString best)
+{
+	lit->exact = exact;
+	lit->prefix = new_grep_string(prefix.s, prefix.len);
+	lit->suffix = new_grep_string(suffix.s, suffix.len);
+	lit->best = new_grep_string(best.s, best.len);
+}
+
+/**
+ * Finds the literal strings that every match of \a node must start with, end
+ * with and contain. Zero-width assertions, backreferences and anything that
+ * can match more than one string count as knowing nothing, which is always
+ * safe.
+ */
+static void grep_literal_analyze(TreeNode *node, GrepLiteral *lit)
+{
+	GrepString empty = {"", 0};
+	GrepLiteral left, right;
+
+	switch (node->type) {
+	case NodeAsciiChar:
+	{
+		GrepString c = {&((AsciiTreeNodeArgs *)node->args)->c1, 1};
+		grep_literal_init(lit, 1, c, c, c);
+		break;
+	}
+
+	case NodeParen:
+		grep_literal_analyze(node->left, lit);
+		break;
+
+	// at least one copy starts and ends the match
+	case NodePlus:
+	case NodeRepCount:
+		if (node->type == NodeRepCount && node->x == 0) {
+			grep_literal_init(lit, 0, empty, empty, empty);
+			break;
+		}
+		grep_literal_analyze(node->left, lit);
+		lit->exact = 0;
+		break;
+
+	case NodeCat:
+	{
+		grep_literal_analyze(node->left, &left);
+		grep_literal_analyze(node->right, &right);
+
+		lit->exact = left.exact && right.exact;
+		lit->prefix = left.exact ? grep_string_concat(left.prefix, right.prefix)
+								 : new_grep_string(left.prefix.s, left.prefix.len);
+		lit->suffix = right.exact ? grep_string_concat(left.suffix, right.suffix)
+								  : new_grep_string(right.suffix.s, right.suffix.len);
+
+		// the longest of the two sides' own literals and the one that spans
+		// the boundary between them
+		GrepString join = grep_string_concat(left.suffix, right.prefix);
+		GrepString best = join;
+		if (left.best.len > best.len)
+			best = left.best;
+		if (right.best.len > best.len)
+			best = right.best;
+		lit->best = new_grep_string(best.s, best.len);
+
+		free(join.s);
+		free_grep_literal(&left);
+		free_grep_literal(&right);
+		break;
+	}
+
+	default:
+		grep_literal_init(lit, 0, empty, empty, empty);
+		break;
+	}
+}
+
+/**
+ * \return The highest capture number in \a node, or -1 if it has none
+ */
+static int tree_max_capture(TreeNode *node)
+{
+	if (!node)
+		return -1;
+
+	int max = node->type == NodeParen ? node->x : -1;
+	int left = tree_max_capture(node->left);
+	int right = tree_max_capture(node->right);
+	if (left > max)
+		max = left;
+	if (right > max)
+		max = right;
+	return max;
+}
+
+static int grep_match_compare(const void *a, const void *b)
+{
+	const GrepMatch *x = a, *y = b;
+	if (x->start != y->start)
+		return x->start < y->start ? -1 : 1;
+	if (x->end != y->end)
+		return x->end > y->end ? -1 : 1;
+	return 0;
+}
+
+/**
+ * Runs the kernel over one line.
+ *
+ * \return Whether the line matched
+ */
+static int grep_worker_match(GrepWorker *w, char *line, long len)
+{
+	ReOS_Kernel *k = w->k;
+
+	// the line input is reused for every line; only its window changes
+	AsciiStringInputData *data = (AsciiStringInputData *)w->line_input->data;
+	data->string = line;
+	data->len = len;
+	data->pos = 0;
+
+	reos_kernel_clear_matches(k);
+	reos_kernel_execute(k, w->line_input, 0, 0);
+	w->executed++;
+	return k->num_capturesets > 0;
+}
+
+/**
+ * Prints the non-overlapping matches of the last line matched, leftmost
+ * first and longest at each start. Empty matches aren't printed.
+ */
+static void grep_worker_print_parts(GrepWorker *w, GrepFile *f, FILE *out, char *line)
+{
+	Grep *g = w->grep;
+	int num_parts = 0;
+
+	foreach_simple(ReOS_CaptureSet, capture_set, w->k->matches) {
+		ReOS_Capture *cap = reos_captureset_get_capture(capture_set, g->whole_capture);
+		if (!cap || cap->end <= cap->start)
+			continue;
+
+		if (num_parts == w->max_parts) {
+			w->max_parts = w->max_parts ? w->max_parts * 2 : 16;
+			w->parts = realloc(w->parts, sizeof(GrepMatch) * w->max_parts);
+		}
+		w->parts[num_parts].start = cap->start;
+		w->parts[num_parts].end = cap->end;
+		num_parts++;
+	}
+
+	qsort(w->parts, num_parts, sizeof(GrepMatch), grep_match_compare);
+
+	long pos = 0;
+	int i;
+	for (i = 0; i < num_parts; i++) {
+		if (w->parts[i].start < pos)
+			continue;
+
+		if (g->prefix)
+			fprintf(out, "%s:", f->path);
+		fwrite(line + w->parts[i].start, 1, w->parts[i].end - w->parts[i].start, out);
+		fputc('\n', out);
+		pos = w->parts[i].end;
+	}
+}
+
+/**
+ * Handles a selected line.
+ *
+ * \return Whether the rest of the file can be skipped
+ */
+static int grep_worker_select(GrepWorker *w, GrepFile *f, FILE *out, char *line, long len)
+{
+	Grep *g = w->grep;
+	f->selected++;
+
+	if (g->list)
+		return 1;
+	else if (g->count)
+		return 0;
+	else if (g->only_matching) {
+		if (!g->invert)
+			grep_worker_print_parts(w, f, out, line);
+	}
+	else {
+		if (g->prefix)
+			fprintf(out, "%s:", f->path);
+		fwrite(line, 1, len, out);
+		fputc('\n', out);
+	}
+	return 0;
+}
+
+/**
+ * Selects every line in [\a start, \a end) of \a map, which are known not to
+ * match.
+ *
+ * \return Whether the rest of the file can be skipped
+ */
+static int grep_worker_select_unmatched(GrepWorker *w, GrepFile *f, FILE *out, char *map,
+										long start, long end)
+{
+	while (start < end) {
+		char *nl = memchr(map + start, '\n', end - start);
+		long line_end = nl ? nl - map : end;
+
+		w->lines++;
+		if (grep_worker_select(w, f, out, map + start, line_end - start))
+			return 1;
+		start = line_end + 1;
+	}
+	return 0;
+}
+
+static void grep_worker_search(GrepWorker *w, GrepFile *f, FILE *out)
+{
+	Grep *g = w->grep;
+
+	// new_ascii_mmap_input() exits on failure, and one bad path shouldn't end
+	// the whole search
+	struct stat st;
+	if (stat(f->path, &st) == -1 || access(f->path, R_OK) == -1) {
+		fprintf(stderr, "reos-grep: %s: %s\n", f->path, strerror(errno));
+		f->error = 1;
+		return;
+	}
+	if (S_ISDIR(st.st_mode)) {
+		fprintf(stderr, "reos-grep: %s: Is a directory\n", f->path);
+		f->error = 1;
+		return;
+	}
+
+	ReOS_Input *input = new_ascii_mmap_input(f->path);
+	AsciiMmapInputData *data = (AsciiMmapInputData *)input->data;
+	char *map = data->map;
+	long len = data->len;
+	w->bytes += len;
+
+	long pos = 0;
+	while (pos < len) {
+		// skip ahead to the next line containing the literal; the lines
+		// before it can't match
+		if (g->literal.len) {
+			char *hit = memmem(map + pos, len - pos, g->literal.s, g->literal.len);
+			long line_start = len;
+			if (hit) {
+				char *nl = memrchr(map + pos, '\n', hit - (map + pos));
+				line_start = nl ? nl - map + 1 : pos;
+			}
+
+			if (g->invert && grep_worker_select_unmatched(w, f, out, map, pos, line_start))
+				break;
+
+			pos = line_start;
+			if (pos == len)
+				break;
+		}
+
+		char *nl = memchr(map + pos, '\n', len - pos);
+		long line_end = nl ? nl - map : len;
+
+		w->lines++;
+		if (grep_worker_match(w, map + pos, line_end - pos) != g->invert
+				&& grep_worker_select(w, f, out, map + pos, line_end - pos))
+			break;
+
+		pos = line_end + 1;
+	}
+
+	free_ascii_mmap_input(input);
+}
+
+static void *grep_worker_main(void *d)
+{
+	GrepWorker *w = (GrepWorker *)d;
+	Grep *g = w->grep;
+
+	for (;;) {
+		pthread_mutex_lock(&g->lock);
+		int i = g->next_file++;
+		pthread_mutex_unlock(&g->lock);
+
+		if (i >= g->num_files)
+			return 0;
+
+		GrepFile *f = &g->files[i];
+		FILE *out = open_memstream(&f->out, &f->out_len);
+		grep_worker_search(w, f, out);
+
+		if (g->list && f->selected)
+			fprintf(out, "%s\n", f->path);
+		else if (g->count && !g->list && !f->error) {
+			if (g->prefix)
+				fprintf(out, "%s:", f->path);
+			fprintf(out, "%d\n", f->selected);
+		}
+		fclose(out);
+
+		pthread_mutex_lock(&g->lock);
+		f->done = 1;
+		pthread_cond_broadcast(&g->file_done);
+		pthread_mutex_unlock(&g->lock);
+	}
+}
+
+static double elapsed_since(struct timespec *start)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+	Grep g;
+	memset(&g, 0, sizeof(Grep));
+
+	int jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	int stats = 0;
+	int optimize = 0;
+	int closures = 1;
+
+	int i;
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-c") || !strcmp(argv[i], "--count"))
+			g.count = 1;
+		else if (!strcmp(argv[i], "-l") || !strcmp(argv[i], "--files-with-matches"))
+			g.list = 1;
+		else if (!strcmp(argv[i], "-v") || !strcmp(argv[i], "--invert-match"))
+			g.invert = 1;
+		else if (!strcmp(argv[i], "-o") || !strcmp(argv[i], "--only-matching"))
+			g.only_matching = 1;
+		else if (!strcmp(argv[i], "-j") || !strcmp(argv[i], "--jobs")) {
+			if (i + 1 == argc)
+				print_usage();
+			jobs = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-s") || !strcmp(argv[i], "--stats"))
+			stats = 1;
+		else if (!strcmp(argv[i], "--optimize"))
+			optimize = 1;
+		else if (!strcmp(argv[i], "--no-closures"))
+			closures = 0;
+		else if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help"))
+			print_usage();
+		else if (!strcmp(argv[i], "-e") || !strcmp(argv[i], "--regexp")) {
+			i++;
+			break;
+		}
+		else
+			break;
+	}
+
+	if (i+1 > argc) {
+		fprintf(stderr, "Error: Specify a regex and at least one file\n\n");
+		print_usage();
+	}
+	else if (i+2 > argc) {
+		fprintf(stderr, "Error: Specify at least one file\n\n");
+		print_usage();
+	}
+
+	TreeNode *tree = ascii_expression_compile(argv[i++]);
+	if (!tree) {
+		fprintf(stderr, "Error: Invalid regular expression\n\n");
+		print_usage();
+	}
+	if (optimize)
+		tree = ascii_tree_optimize(tree);
+
+	GrepLiteral lit;
+	grep_literal_analyze(tree, &lit);
+	g.literal = new_grep_string(lit.best.s, lit.best.len);
+	free_grep_literal(&lit);
+
+	// wrap the whole regex in one more capture, so -o can find where each
+	// match starts and ends
+	g.whole_capture = tree_max_capture(tree) + 1;
+	if (g.only_matching) {
+		tree = new_ascii_tree_node(NodeParen, tree, 0);
+		tree->x = g.whole_capture;
+	}
+
+	g.pattern = new_mem_pattern();
+	standard_tree_compile(g.pattern, tree, ascii_inst_factory, ascii_tree_node_compile);
+	if (closures)
+		standard_pattern_compute_closures(g.pattern);
+	free_ascii_tree_node(tree);
+
+	g.files = calloc(argc - i, sizeof(GrepFile));
+	g.num_files = argc - i;
+	g.prefix = g.num_files > 1;
+	for (; i < argc; i++)
+		g.files[g.num_files - (argc - i)].path = argv[i];
+
+	pthread_mutex_init(&g.lock, 0);
+	pthread_cond_init(&g.file_done, 0);
+
+	if (jobs < 1)
+		jobs = 1;
+	if (jobs > g.num_files)
+		jobs = g.num_files;
+
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	GrepWorker *workers = calloc(jobs, sizeof(GrepWorker));
+	for (i = 0; i < jobs; i++) {
+		GrepWorker *w = &workers[i];
+		w->grep = &g;
+
+		// only -o needs more than the first match on a line
+		w->k = new_reos_kernel(g.pattern, execute_ascii_inst, g.only_matching ? -1 : 1);
+		w->k->test_backref = ascii_test_backref;
+		w->k->history_size = standard_pattern_history_size(g.pattern);
+		w->line_input = new_ascii_string_input("");
+
+		pthread_create(&w->thread, 0, grep_worker_main, w);
+	}
+
+	// print each file's output as soon as it and every file before it are
+	// done
+	int selected = 0;
+	int error = 0;
+	for (i = 0; i < g.num_files; i++) {
+		GrepFile *f = &g.files[i];
+
+		pthread_mutex_lock(&g.lock);
+		while (!f->done)
+			pthread_cond_wait(&g.file_done, &g.lock);
+		pthread_mutex_unlock(&g.lock);
+
+		fwrite(f->out, 1, f->out_len, stdout);
+		free(f->out);
+
+		selected |= f->selected > 0;
+		error |= f->error;
+	}
+
+	long bytes = 0, lines = 0, executed = 0;
+	for (i = 0; i < jobs; i++) {
+		GrepWorker *w = &workers[i];
+		pthread_join(w->thread, 0);
+
+		bytes += w->bytes;
+		lines += w->lines;
+		executed += w->executed;
+
+		free_reos_kernel(w->k);
+		free_ascii_string_input(w->line_input);
+		free(w->parts);
+	}
+
+	if (stats) {
+		double seconds = elapsed_since(&start);
+		fprintf(stderr, "literal: \"%.*s\"\n", g.literal.len, g.literal.s);
+		fprintf(stderr, "files: %d\tjobs: %d\n", g.num_files, jobs);
+		fprintf(stderr, "bytes: %ld\tlines visited: %ld\tlines matched by the kernel: %ld\n",
+				bytes, lines, executed);
+		fprintf(stderr, "seconds: %f\tMB/s: %f\n", seconds, bytes / seconds / (1 << 20));
+	}
+
+	pthread_cond_destroy(&g.file_done);
+	pthread_mutex_destroy(&g.lock);
+	free(workers);
+	free(g.files);
+	free(g.literal.s);
+	free_mem_pattern(g.pattern);
+
+	if (error)
+		return 2;
+	return selected ? 0 : 1;
+}
@@ -0,0 +1,67 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace_debugger.h"
+
+/**
+ * \file
+ *
+ * Converts a trace saved by the trace debugger, for example with the ascii
+ * example's --trace option, into Chrome trace JSON or a CSV timeline.
+ */
+
+static void print_usage()
+{
+	fprintf(stderr,
+			"Usage: reos-trace [OPTION]... TRACE [OUTPUT]\n"
+			"Writes TRACE as Chrome trace JSON, for chrome://tracing or Perfetto, to\n"
+			"OUTPUT or to standard output.\n"
+			"Options:\n"
+			"	-c, --csv\n"
+			"		write a CSV timeline instead\n"
+			"	-h, --help\n"
+			"		display this help\n");
+	exit(0);
+}
+
+int main(int argc, char **argv)
+{
+	int csv = 0;
+
+	int i;
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-c") || !strcmp(argv[i], "--csv"))
+			csv = 1;
+		else if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help"))
+			print_usage();
+		else
+			break;
+	}
+
+	if (i == argc || i+2 < argc) {
+		fprintf(stderr, "Error: Specify a trace and at most one output\n\n");
+		print_usage();
+	}
+
+	long num_events;
+	TraceEvent *events = trace_read(argv[i], &num_events);
+	if (!events)
+		exit(1);
+
+	FILE *out = stdout;
+	if (i+1 < argc && !(out = fopen(argv[i+1], "w"))) {
+		fprintf(stderr, "error: could not open %s\n", argv[i+1]);
+		exit(1);
+	}
+
+	if (csv)
+		trace_export_csv(out, events, num_events);
+	else
+		trace_export_chrome(out, events, num_events);
+
+	if (out != stdout)
+		fclose(out);
+	free(events);
+	return 0;
+}
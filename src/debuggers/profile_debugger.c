@@ -1,8 +1,37 @@
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "profile_debugger.h"
+#include "reos_kernel.h"
 #include "reos_list.h"
 
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/**
+ * \file
+ *
+ * Counts what the kernel does, overall and at each pc: how many times each
+ * instruction ran, and how many threads were spawned, dropped or turned away
+ * as duplicates there. Every event costs a counter increment, so the profile
+ * can be left on for inputs of any size.
+ *
+ * profile_debugger_print_listing() prints the pattern with those counts
+ * beside each instruction, followed by the totals for each opcode.
+ *
+ * On Linux, profile_debugger_open_counters() adds hardware counters (cycles,
+ * instructions, cache, branch and dTLB misses) read around the whole run, to
+ * tell a regression in cache behaviour from one in the amount of work done.
+ * They include the debuggers' own work, this one's counting among it.
+ */
+
+#define HEAT_WIDTH 10
+
 ReOS_Debugger *new_profile_debugger()
 {
 	ReOS_Debugger *d = malloc(sizeof(ReOS_Debugger));
@@ -10,27 +39,124 @@ ReOS_Debugger *new_profile_debugger()
 
 	d->start = profile_debugger_start_timer;
 	d->end = profile_debugger_stop_timer;
-	d->before_inst = profile_debugger_count_inst;
+	d->after_inst = profile_debugger_count_inst;
 	d->before_token = profile_debugger_count_token;
+	d->spawn = profile_debugger_count_spawn;
+	d->drop = profile_debugger_count_drop;
+	d->reject = profile_debugger_count_reject;
 
-	d->data = malloc(sizeof(ProfileDebuggerData));
+	d->data = calloc(1, sizeof(ProfileDebuggerData));
 	ProfileDebuggerData *data = d->data;
-	data->instrs_executed = 0;
-	data->tokens_read = 0;
-	data->max_threads = 0;
 
+	int i;
+	for (i = 0; i < ProfileNumCounters; i++)
+		data->counter_fds[i] = -1;
 	return d;
 }
 
 void free_profile_debugger(ReOS_Debugger *d)
 {
-	free(d->data);
+	ProfileDebuggerData *data = d->data;
+
+#ifdef __linux__
+	int i;
+	for (i = 0; i < ProfileNumCounters; i++) {
+		if (data->counter_fds[i] != -1)
+			close(data->counter_fds[i]);
+	}
+#endif
+
+	free(data->pcs);
+	free(data);
 	free(d);
 }
 
+#ifdef __linux__
+static int open_counter(int type, long long config)
+{
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = config;
+	attr.disabled = 1;
+
+	// counting only user space is allowed at the default perf_event_paranoid
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+/**
+ * Opens the hardware counters for the calling thread, to be read from when
+ * the kernel starts to when it ends. Counters the CPU or the system doesn't
+ * allow are left out and reported as unavailable.
+ *
+ * \return The number of counters opened, 0 if none could be
+ */
+int profile_debugger_open_counters(ReOS_Debugger *debugger)
+{
+	ProfileDebuggerData *data = debugger->data;
+	data->counters_open = 0;
+	data->counters_errno = ENOSYS;
+
+#ifdef __linux__
+	static const long long configs[ProfileNumCounters][2] = {
+		{PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+		{PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+		{PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+		{PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+		{PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+							 | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)}
+	};
+
+	int i;
+	for (i = 0; i < ProfileNumCounters; i++) {
+		if (data->counter_fds[i] == -1)
+			data->counter_fds[i] = open_counter(configs[i][0], configs[i][1]);
+
+		if (data->counter_fds[i] != -1)
+			data->counters_open++;
+		else
+			data->counters_errno = errno;
+	}
+#endif
+
+	return data->counters_open;
+}
+
+static ProfilePcStats *pc_stats(ProfileDebuggerData *data, int pc)
+{
+	if (pc >= data->num_pcs) {
+		int num_pcs = data->num_pcs ? data->num_pcs : 16;
+		while (num_pcs <= pc)
+			num_pcs *= 2;
+
+		data->pcs = realloc(data->pcs, sizeof(ProfilePcStats) * num_pcs);
+		memset(data->pcs + data->num_pcs, 0, sizeof(ProfilePcStats) * (num_pcs - data->num_pcs));
+		data->num_pcs = num_pcs;
+	}
+
+	return &data->pcs[pc];
+}
+
 void profile_debugger_start_timer(ReOS_Debugger *debugger, ReOS_Kernel *k)
 {
 	ProfileDebuggerData *data = debugger->data;
+	data->pattern = k->pattern;
+
+#ifdef __linux__
+	int i;
+	for (i = 0; i < ProfileNumCounters; i++) {
+		if (data->counter_fds[i] != -1) {
+			ioctl(data->counter_fds[i], PERF_EVENT_IOC_RESET, 0);
+			ioctl(data->counter_fds[i], PERF_EVENT_IOC_ENABLE, 0);
+		}
+	}
+#endif
+
 	data->start_time = clock();
 }
 
@@ -38,32 +164,186 @@ void profile_debugger_stop_timer(ReOS_Debugger *debugger, ReOS_Kernel *k)
 {
 	ProfileDebuggerData *data = debugger->data;
 	data->end_time = clock();
+
+#ifdef __linux__
+	int i;
+	for (i = 0; i < ProfileNumCounters; i++) {
+		if (data->counter_fds[i] != -1) {
+			ioctl(data->counter_fds[i], PERF_EVENT_IOC_DISABLE, 0);
+			if (read(data->counter_fds[i], &data->counter_values[i], sizeof(long long))
+				!= sizeof(long long))
+				data->counter_values[i] = -1;
+		}
+	}
+#endif
+
+	data->matches = k->num_capturesets;
 }
 
 void profile_debugger_count_inst(ReOS_Debugger *debugger, ReOS_Kernel *k)
 {
 	ProfileDebuggerData *data = debugger->data;
 	data->instrs_executed++;
+	pc_stats(data, k->pc)->executed++;
+}
 
-	int threads = 0;
-	foreach_compound(ReOS_Thread, t, k->state.current_thread_list->list)
-		threads++;
+/**
+ * Counts a token and the threads that will run against it. Counting the list
+ * once per token rather than once per instruction keeps the cost in
+ * proportion to the work the kernel does on the token anyway.
+ */
+void profile_debugger_count_token(ReOS_Debugger *debugger, ReOS_Kernel *k)
+{
+	ProfileDebuggerData *data = debugger->data;
+	data->tokens_read++;
 
+	long threads = reos_compoundlist_length(k->state.current_thread_list->list);
 	if (threads > data->max_threads)
 		data->max_threads = threads;
 }
 
-void profile_debugger_count_token(ReOS_Debugger *debugger, ReOS_Kernel *k)
+void profile_debugger_count_spawn(ReOS_Debugger *debugger, ReOS_Kernel *k, int pc)
 {
-	ProfileDebuggerData *data = debugger->data;
-	data->tokens_read++;
+	pc_stats(debugger->data, pc)->spawns++;
+}
+
+void profile_debugger_count_drop(ReOS_Debugger *debugger, ReOS_Kernel *k, int pc)
+{
+	pc_stats(debugger->data, pc)->drops++;
+}
+
+void profile_debugger_count_reject(ReOS_Debugger *debugger, ReOS_Kernel *k, int pc)
+{
+	pc_stats(debugger->data, pc)->rejects++;
+}
+
+/**
+ * Prints the memory held by each kernel subsystem, if ReOS was built to
+ * account for it.
+ */
+static void print_memory_stats()
+{
+	ReOS_MemoryStats stats;
+	if (!reos_kernel_memory_stats(&stats))
+		return;
+
+	static const char *names[ReOS_MemNumSubsystems] = {
+		"threads", "capture sets", "captures", "list nodes", "judy lists", "branches",
+		"token buffer", "pattern", "other"
+	};
+
+	printf("\n%-14s %14s %14s %12s %12s\n", "memory", "current bytes", "peak bytes", "allocs",
+		   "frees");
+
+	int i;
+	for (i = 0; i <= ReOS_MemNumSubsystems; i++) {
+		ReOS_MemoryUsage *usage = i < ReOS_MemNumSubsystems ? &stats.subsystems[i] : &stats.total;
+		printf("%-14s %14ld %14ld %12ld %12ld\n", i < ReOS_MemNumSubsystems ? names[i] : "total",
+			   usage->current_bytes, usage->peak_bytes, usage->allocs, usage->frees);
+	}
 }
 
 void profile_debugger_print_results(ReOS_Debugger *debugger)
 {
 	ProfileDebuggerData *data = debugger->data;
 	printf("\nTime elapsed: %.3lf\n", ((double)(data->end_time - data->start_time)) / CLOCKS_PER_SEC);
-	printf("Instructions executed: %d\n", data->instrs_executed);
-	printf("Tokens read: %d\n", data->tokens_read);
-	printf("Max threads: %d\n", data->max_threads);
+	printf("Instructions executed: %ld\n", data->instrs_executed);
+	printf("Tokens read: %ld\n", data->tokens_read);
+	printf("Max threads: %ld\n", data->max_threads);
+
+	print_memory_stats();
+
+	if (!data->counters_open) {
+		if (data->counters_errno)
+			printf("Hardware counters: not available (%s)\n", strerror(data->counters_errno));
+		return;
+	}
+
+	static const char *names[ProfileNumCounters] = {
+		"cycles", "instructions", "cache-misses", "branch-misses", "dtlb-misses"
+	};
+
+	printf("\n%-14s %16s %12s %12s\n", "counter", "total", "per token", "per match");
+
+	int i;
+	for (i = 0; i < ProfileNumCounters; i++) {
+		long long value = data->counter_values[i];
+		if (data->counter_fds[i] == -1 || value < 0) {
+			printf("%-14s %16s\n", names[i], "not available");
+			continue;
+		}
+
+		printf("%-14s %16lld", names[i], value);
+		if (data->tokens_read)
+			printf(" %12.2f", (double)value / data->tokens_read);
+		else
+			printf(" %12s", "-");
+		if (data->matches)
+			printf(" %12.2f", (double)value / data->matches);
+		else
+			printf(" %12s", "-");
+		printf("\n");
+	}
+}
+
+/**
+ * Prints the pattern one instruction per line, each with its counts, its
+ * share of all instructions executed and a bar scaled to the hottest pc.
+ * Below that are the executions for each opcode, with an instruction that
+ * has it as an example.
+ *
+ * \param debugger A profile debugger that has been run
+ * \param print_inst Prints an instruction of the kernel's instruction set
+ */
+void profile_debugger_print_listing(ReOS_Debugger *debugger, PrintInstFunc print_inst)
+{
+	ProfileDebuggerData *data = debugger->data;
+	if (!data->pattern)
+		return;
+
+	ReOS_Pattern *pattern = data->pattern;
+	double total = data->instrs_executed ? data->instrs_executed : 1;
+
+	long hottest = 1;
+	int pc;
+	ReOS_Inst *inst;
+	for (pc = 0; pc < data->num_pcs; pc++) {
+		if (data->pcs[pc].executed > hottest)
+			hottest = data->pcs[pc].executed;
+	}
+
+	printf("\n%5s %12s %7s %10s %10s %10s  %-*s  %s\n", "pc", "executed", "%", "spawns",
+		   "drops", "rejects", HEAT_WIDTH, "heat", "instruction");
+
+	// per-opcode totals, keyed by opcode, each an array of the count and the
+	// first pc with the opcode
+	Pvoid_t opcodes = 0;
+
+	for (pc = 0; (inst = pattern->get_inst(pattern, pc)); pc++) {
+		ProfilePcStats *stats = pc_stats(data, pc);
+		int heat = (stats->executed * HEAT_WIDTH + hottest - 1) / hottest;
+
+		printf("%5d %12ld %6.2f%% %10ld %10ld %10ld  %.*s%*s  ", pc, stats->executed,
+			   100.0 * stats->executed / total, stats->spawns, stats->drops, stats->rejects,
+			   heat, "##########", HEAT_WIDTH - heat, "");
+		print_inst(inst);
+		printf("\n");
+
+		judy_fail_get(opcodes, inst->opcode, long, opcode) {
+			opcode = calloc(2, sizeof(long));
+			opcode[1] = pc;
+			judy_insert(opcodes, inst->opcode, opcode);
+		}
+		opcode[0] += stats->executed;
+	}
+
+	printf("\n%7s %12s %7s  %s\n", "opcode", "executed", "%", "example");
+	judy_iter_begin(long, opcode, opcodes) {
+		printf("%7lu %12ld %6.2f%%  ", iter_opcode, opcode[0], 100.0 * opcode[0] / total);
+		print_inst(pattern->get_inst(pattern, opcode[1]));
+		printf("\n");
+		judy_iter_next(opcode, opcodes);
+	}
+
+	free_judy(opcodes, free);
 }
@@ -8,23 +8,67 @@ extern "C" {
 #endif
 
 typedef struct ProfileDebuggerData ProfileDebuggerData;
+typedef struct ProfilePcStats ProfilePcStats;
+
+/**
+ * The hardware counters profile_debugger_open_counters() asks for.
+ */
+enum
+{
+	ProfileCycles,
+	ProfileInstructions,
+	ProfileCacheMisses,
+	ProfileBranchMisses,
+	ProfileDtlbMisses,
+	ProfileNumCounters
+};
+
+/**
+ * What happened at one pc.
+ */
+struct ProfilePcStats
+{
+	long executed;
+	long spawns;
+	long drops;
+	long rejects;
+};
 
 struct ProfileDebuggerData
 {
 	clock_t start_time;
 	clock_t end_time;
-	int instrs_executed;
-	int tokens_read;
-	int max_threads;
+	long instrs_executed;
+	long tokens_read;
+	long max_threads;
+
+	// indexed by pc, and grown as higher pcs turn up
+	ProfilePcStats *pcs;
+	int num_pcs;
+
+	ReOS_Pattern *pattern;
+	long matches;
+
+	// file descriptors of the hardware counters, -1 for those that couldn't
+	// be opened, and what they read at the end of the run
+	int counter_fds[ProfileNumCounters];
+	long long counter_values[ProfileNumCounters];
+	int counters_open;
+	int counters_errno;
 };
 
 ReOS_Debugger *new_profile_debugger();
 void free_profile_debugger(ReOS_Debugger *);
+int profile_debugger_open_counters(ReOS_Debugger *);
 void profile_debugger_start_timer(ReOS_Debugger *, ReOS_Kernel *);
 void profile_debugger_stop_timer(ReOS_Debugger *, ReOS_Kernel *);
 void profile_debugger_count_inst(ReOS_Debugger *, ReOS_Kernel *);
 void profile_debugger_count_token(ReOS_Debugger *, ReOS_Kernel *);
+void profile_debugger_count_spawn(ReOS_Debugger *, ReOS_Kernel *, int);
+void profile_debugger_count_drop(ReOS_Debugger *, ReOS_Kernel *, int);
+void profile_debugger_count_reject(ReOS_Debugger *, ReOS_Kernel *, int);
 void profile_debugger_print_results(ReOS_Debugger *);
+void profile_debugger_print_listing(ReOS_Debugger *, PrintInstFunc);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,252 @@
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include "reos_kernel.h"
+#include "sample_debugger.h"
+
+#ifdef __linux__
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+// older glibc only has this in the kernel's headers, which clash with its own
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+#endif
+
+/**
+ * \file
+ *
+ * A statistical profiler. Rather than a callback per instruction, which
+ * slows the kernel down several times, it has a timer interrupt the kernel's
+ * thread \c hz times per second of CPU time with SIGPROF, and the signal
+ * handler reads the pc the kernel is running from the kernel's \c pc slot.
+ * The kernel updates that slot in its loop anyway, so the profile costs
+ * little more than the signals themselves.
+ *
+ * Samples are counted per pc, in a table for each pattern, so one sampler
+ * can be attached to many kernels running different patterns on different
+ * threads. On Linux each kernel's thread gets a timer of its own CPU time;
+ * elsewhere a single process-wide profiling timer is used, so only one
+ * kernel should be sampled at a time.
+ *
+ * The sampler takes over SIGPROF from the first time a kernel is sampled.
+ * Its handler stays installed afterwards, ignoring signals on threads not
+ * being sampled, so that a signal still pending when a timer is deleted
+ * can't reach the default action and end the process.
+ */
+
+typedef struct SampleSlot SampleSlot;
+
+struct SampleSlot
+{
+	ReOS_Kernel *k;
+	SampleTable *table;
+	SampleDebuggerData *data;
+#ifdef __linux__
+	timer_t timer;
+	int has_timer; //!< Whether \c timer was created
+#endif
+};
+
+// the kernel running on this thread, if it's being sampled
+static __thread SampleSlot *current_slot;
+
+static void handle_sigprof(int sig)
+{
+	SampleSlot *slot = current_slot;
+	if (!slot)
+		return;
+
+	int pc = slot->k->pc;
+	if (pc >= 0 && pc < slot->table->num_pcs) {
+		__sync_fetch_and_add(&slot->table->counts[pc], 1);
+		__sync_fetch_and_add(&slot->table->samples, 1);
+		__sync_fetch_and_add(&slot->data->samples, 1);
+	}
+	else
+		__sync_fetch_and_add(&slot->data->missed, 1);
+}
+
+static pthread_mutex_t install_lock = PTHREAD_MUTEX_INITIALIZER;
+static int installed;
+
+// call with install_lock held
+static void install_handler()
+{
+	if (!installed) {
+		struct sigaction action;
+		memset(&action, 0, sizeof(action));
+		action.sa_handler = handle_sigprof;
+		action.sa_flags = SA_RESTART;
+		sigemptyset(&action.sa_mask);
+		sigaction(SIGPROF, &action, 0);
+		installed = 1;
+	}
+}
+
+static SampleTable *find_table(SampleDebuggerData *data, ReOS_Pattern *pattern)
+{
+	SampleTable *table;
+	for (table = data->tables; table; table = table->next) {
+		if (table->pattern == pattern)
+			return table;
+	}
+
+	table = calloc(1, sizeof(SampleTable));
+	table->pattern = pattern;
+	while (pattern->get_inst(pattern, table->num_pcs))
+		table->num_pcs++;
+	table->counts = calloc(table->num_pcs ? table->num_pcs : 1, sizeof(long));
+
+	table->next = data->tables;
+	data->tables = table;
+	return table;
+}
+
+static void sample_start(ReOS_Debugger *debugger, ReOS_Kernel *k)
+{
+	SampleDebuggerData *data = debugger->data;
+
+	SampleSlot *slot = malloc(sizeof(SampleSlot));
+	slot->k = k;
+	slot->data = data;
+
+	// kernels on other threads may be starting with the same sampler
+	pthread_mutex_lock(&install_lock);
+	slot->table = find_table(data, k->pattern);
+	install_handler();
+	pthread_mutex_unlock(&install_lock);
+
+	current_slot = slot;
+
+	long interval = 1000000 / data->hz;
+	struct timeval period = {interval / 1000000, interval % 1000000};
+#ifdef __linux__
+	struct sigevent event;
+	memset(&event, 0, sizeof(event));
+	event.sigev_notify = SIGEV_THREAD_ID;
+	event.sigev_signo = SIGPROF;
+	event.sigev_notify_thread_id = syscall(SYS_gettid);
+
+	struct timespec nanos = {period.tv_sec, period.tv_usec * 1000};
+	struct itimerspec spec = {nanos, nanos};
+	slot->has_timer = timer_create(CLOCK_THREAD_CPUTIME_ID, &event, &slot->timer) == 0;
+	if (slot->has_timer)
+		timer_settime(slot->timer, 0, &spec, 0);
+	else
+		fprintf(stderr, "warning: could not create a sampling timer\n");
+#else
+	struct itimerval spec = {period, period};
+	setitimer(ITIMER_PROF, &spec, 0);
+#endif
+}
+
+static void sample_end(ReOS_Debugger *debugger, ReOS_Kernel *k)
+{
+	SampleSlot *slot = current_slot;
+	if (!slot)
+		return;
+
+#ifdef __linux__
+	if (slot->has_timer)
+		timer_delete(slot->timer);
+#else
+	struct itimerval spec = {{0, 0}, {0, 0}};
+	setitimer(ITIMER_PROF, &spec, 0);
+#endif
+
+	current_slot = 0;
+	free(slot);
+}
+
+/**
+ * Creates a sampler.
+ *
+ * \param hz The samples to take per second of the kernel's CPU time, at
+ * most 1000000. CPU time timers only fire on the system's scheduler tick, so
+ * rates above it give fewer samples than asked for.
+ */
+ReOS_Debugger *new_sample_debugger(int hz)
+{
+	ReOS_Debugger *d = malloc(sizeof(ReOS_Debugger));
+	debugger_reset(d);
+
+	d->start = sample_start;
+	d->end = sample_end;
+
+	d->data = calloc(1, sizeof(SampleDebuggerData));
+	SampleDebuggerData *data = d->data;
+	data->hz = hz < 1 ? 1 : hz > 1000000 ? 1000000 : hz;
+	return d;
+}
+
+void free_sample_debugger(ReOS_Debugger *d)
+{
+	SampleDebuggerData *data = d->data;
+	while (data->tables) {
+		SampleTable *next = data->tables->next;
+		free(data->tables->counts);
+		free(data->tables);
+		data->tables = next;
+	}
+
+	free(data);
+	free(d);
+}
+
+static SampleTable *sort_table;
+
+static int compare_pcs(const void *a, const void *b)
+{
+	long count_a = sort_table->counts[*(int *)a];
+	long count_b = sort_table->counts[*(int *)b];
+	return count_a < count_b ? 1 : count_a > count_b ? -1 : *(int *)a - *(int *)b;
+}
+
+/**
+ * Prints the profile of each pattern, hottest pc first. Pcs without samples
+ * are left out.
+ *
+ * \param debugger A sampler that has been run
+ * \param print_inst Prints an instruction of the kernels' instruction set
+ */
+void sample_debugger_print_results(ReOS_Debugger *debugger, PrintInstFunc print_inst)
+{
+	SampleDebuggerData *data = debugger->data;
+	printf("\nSamples: %ld (%d Hz), %ld outside instructions\n", data->samples, data->hz,
+		   data->missed);
+
+	SampleTable *table;
+	for (table = data->tables; table; table = table->next) {
+		printf("\nPattern %p: %ld samples\n", (void *)table->pattern, table->samples);
+		if (!table->samples)
+			continue;
+
+		int *pcs = malloc(sizeof(int) * table->num_pcs);
+		int pc;
+		for (pc = 0; pc < table->num_pcs; pc++)
+			pcs[pc] = pc;
+
+		sort_table = table;
+		qsort(pcs, table->num_pcs, sizeof(int), compare_pcs);
+
+		printf("%5s %10s %7s  %s\n", "pc", "samples", "%", "instruction");
+
+		int i;
+		for (i = 0; i < table->num_pcs && table->counts[pcs[i]]; i++) {
+			long count = table->counts[pcs[i]];
+			printf("%5d %10ld %6.2f%%  ", pcs[i], count, 100.0 * count / table->samples);
+			print_inst(table->pattern->get_inst(table->pattern, pcs[i]));
+			printf("\n");
+		}
+
+		free(pcs);
+	}
+}
@@ -0,0 +1,44 @@
+#ifndef SAMPLE_DEBUGGER_H
+#define SAMPLE_DEBUGGER_H
+
+#include "reos_debugger.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct SampleTable SampleTable;
+typedef struct SampleDebuggerData SampleDebuggerData;
+
+/**
+ * The samples taken while one pattern was running, counted by pc.
+ */
+struct SampleTable
+{
+	ReOS_Pattern *pattern;
+	long *counts;
+	int num_pcs;
+
+	long samples;
+	SampleTable *next;
+};
+
+struct SampleDebuggerData
+{
+	int hz;
+	SampleTable *tables;
+
+	// the tables' totals, and the samples that landed outside any instruction
+	long samples;
+	long missed;
+};
+
+ReOS_Debugger *new_sample_debugger(int);
+void free_sample_debugger(ReOS_Debugger *);
+void sample_debugger_print_results(ReOS_Debugger *, PrintInstFunc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
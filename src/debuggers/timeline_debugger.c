@@ -0,0 +1,191 @@
+#include <stdlib.h>
+#include <string.h>
+#include "reos_kernel.h"
+#include "timeline_debugger.h"
+
+/**
+ * \file
+ *
+ * Records how many threads the kernel carried over each stretch of the
+ * input, to find where a pattern's thread population blows up.
+ *
+ * Input positions are grouped into buckets of \c bucket_size tokens. For
+ * each, the debugger keeps the number of threads at the start of each token
+ * (their mean and maximum), the instructions run, and the threads spawned,
+ * turned away as duplicates and the capture sets copied. Each event is a
+ * counter increment; the thread count is read once per token.
+ *
+ * With \c max_buckets set, memory stays bounded on any input: when the
+ * input outgrows the buckets, neighbouring buckets are merged and the
+ * bucket size doubles.
+ */
+
+static void timeline_start(ReOS_Debugger *, ReOS_Kernel *);
+static void timeline_token(ReOS_Debugger *, ReOS_Kernel *);
+static void timeline_inst(ReOS_Debugger *, ReOS_Kernel *);
+static void timeline_spawn(ReOS_Debugger *, ReOS_Kernel *, int);
+static void timeline_reject(ReOS_Debugger *, ReOS_Kernel *, int);
+static void timeline_detach(ReOS_Debugger *, ReOS_Kernel *, int);
+
+/**
+ * \param bucket_size The number of input positions per bucket at first
+ * \param max_buckets The most buckets to keep before merging them, or 0 to
+ * never merge
+ */
+ReOS_Debugger *new_timeline_debugger(long bucket_size, long max_buckets)
+{
+	ReOS_Debugger *d = malloc(sizeof(ReOS_Debugger));
+	debugger_reset(d);
+
+	d->start = timeline_start;
+	d->before_token = timeline_token;
+	d->after_inst = timeline_inst;
+	d->spawn = timeline_spawn;
+	d->reject = timeline_reject;
+	d->detach = timeline_detach;
+
+	d->data = calloc(1, sizeof(TimelineDebuggerData));
+	TimelineDebuggerData *data = d->data;
+	data->bucket_size = bucket_size > 0 ? bucket_size : 1;
+	data->current_sp = -1;
+
+	// merging halves the buckets in use, so keep an even number of them
+	data->max_buckets = max_buckets > 0 && max_buckets < 2 ? 2 : max_buckets & ~1L;
+	return d;
+}
+
+void free_timeline_debugger(ReOS_Debugger *d)
+{
+	TimelineDebuggerData *data = d->data;
+	free(data->buckets);
+	free(data);
+	free(d);
+}
+
+static void merge_buckets(TimelineDebuggerData *data)
+{
+	long i;
+	for (i = 0; i < data->used_buckets; i += 2) {
+		TimelineBucket merged = data->buckets[i];
+		if (i + 1 < data->used_buckets) {
+			TimelineBucket *b = &data->buckets[i + 1];
+			merged.tokens += b->tokens;
+			merged.threads += b->threads;
+			if (b->max_threads > merged.max_threads)
+				merged.max_threads = b->max_threads;
+			merged.instrs += b->instrs;
+			merged.spawns += b->spawns;
+			merged.rejects += b->rejects;
+			merged.detaches += b->detaches;
+		}
+		data->buckets[i / 2] = merged;
+	}
+
+	long used = (data->used_buckets + 1) / 2;
+	memset(data->buckets + used, 0, sizeof(TimelineBucket) * (data->used_buckets - used));
+	data->used_buckets = used;
+	data->bucket_size *= 2;
+}
+
+static TimelineBucket *bucket(TimelineDebuggerData *data, long sp)
+{
+	if (sp == data->current_sp)
+		return &data->buckets[data->current];
+
+	long index = (sp - data->start_sp) / data->bucket_size;
+	if (index < 0)
+		index = 0;
+
+	while (data->max_buckets && index >= data->max_buckets) {
+		merge_buckets(data);
+		index = (sp - data->start_sp) / data->bucket_size;
+	}
+
+	if (index >= data->num_buckets) {
+		long num_buckets = data->num_buckets ? data->num_buckets : 64;
+		while (num_buckets <= index)
+			num_buckets *= 2;
+		if (data->max_buckets && num_buckets > data->max_buckets)
+			num_buckets = data->max_buckets;
+
+		data->buckets = realloc(data->buckets, sizeof(TimelineBucket) * num_buckets);
+		memset(data->buckets + data->num_buckets, 0,
+			   sizeof(TimelineBucket) * (num_buckets - data->num_buckets));
+		data->num_buckets = num_buckets;
+	}
+
+	if (index >= data->used_buckets)
+		data->used_buckets = index + 1;
+
+	data->current_sp = sp;
+	data->current = index;
+	return &data->buckets[index];
+}
+
+static void timeline_start(ReOS_Debugger *debugger, ReOS_Kernel *k)
+{
+	TimelineDebuggerData *data = debugger->data;
+
+	// the kernel spawns its first thread before starting its debuggers, so
+	// forget that and count from where the first run starts
+	if (!data->started) {
+		data->started = 1;
+		data->start_sp = k->sp;
+		data->current_sp = -1;
+		data->used_buckets = 0;
+		memset(data->buckets, 0, sizeof(TimelineBucket) * data->num_buckets);
+	}
+}
+
+static void timeline_token(ReOS_Debugger *debugger, ReOS_Kernel *k)
+{
+	TimelineBucket *b = bucket(debugger->data, k->sp);
+	long threads = reos_compoundlist_length(k->state.current_thread_list->list);
+
+	b->tokens++;
+	b->threads += threads;
+	if (threads > b->max_threads)
+		b->max_threads = threads;
+}
+
+static void timeline_inst(ReOS_Debugger *debugger, ReOS_Kernel *k)
+{
+	bucket(debugger->data, k->sp)->instrs++;
+}
+
+static void timeline_spawn(ReOS_Debugger *debugger, ReOS_Kernel *k, int pc)
+{
+	bucket(debugger->data, k->sp)->spawns++;
+}
+
+static void timeline_reject(ReOS_Debugger *debugger, ReOS_Kernel *k, int pc)
+{
+	bucket(debugger->data, k->sp)->rejects++;
+}
+
+static void timeline_detach(ReOS_Debugger *debugger, ReOS_Kernel *k, int pc)
+{
+	bucket(debugger->data, k->sp)->detaches++;
+}
+
+/**
+ * Writes the timeline, one bucket per line after a header, as
+ * whitespace-separated columns ready for gnuplot or a spreadsheet.
+ */
+void timeline_debugger_write(ReOS_Debugger *debugger, FILE *f)
+{
+	TimelineDebuggerData *data = debugger->data;
+
+	fprintf(f, "# bucket size %ld\n", data->bucket_size);
+	fprintf(f, "# %-10s %8s %10s %10s %12s %10s %10s %10s\n", "position", "tokens", "threads",
+			"max", "instrs", "spawns", "rejects", "detaches");
+
+	long i;
+	for (i = 0; i < data->used_buckets; i++) {
+		TimelineBucket *b = &data->buckets[i];
+		fprintf(f, "%12ld %8ld %10.1f %10ld %12ld %10ld %10ld %10ld\n",
+				data->start_sp + i * data->bucket_size, b->tokens,
+				b->tokens ? (double)b->threads / b->tokens : 0.0, b->max_threads, b->instrs,
+				b->spawns, b->rejects, b->detaches);
+	}
+}
@@ -0,0 +1,55 @@
+#ifndef TIMELINE_DEBUGGER_H
+#define TIMELINE_DEBUGGER_H
+
+#include <stdio.h>
+#include "reos_debugger.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct TimelineBucket TimelineBucket;
+typedef struct TimelineDebuggerData TimelineDebuggerData;
+
+/**
+ * What the kernel did over one range of input positions.
+ */
+struct TimelineBucket
+{
+	long tokens;
+
+	// summed over the bucket's tokens, for the mean
+	long threads;
+	long max_threads;
+
+	long instrs;
+	long spawns;
+	long rejects;
+	long detaches;
+};
+
+struct TimelineDebuggerData
+{
+	long bucket_size;
+	long max_buckets;
+	long start_sp;
+	int started;
+
+	TimelineBucket *buckets;
+	long num_buckets;
+	long used_buckets;
+
+	// the bucket of the last position seen, so most events skip the division
+	long current_sp;
+	long current;
+};
+
+ReOS_Debugger *new_timeline_debugger(long, long);
+void free_timeline_debugger(ReOS_Debugger *);
+void timeline_debugger_write(ReOS_Debugger *, FILE *);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
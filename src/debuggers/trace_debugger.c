@@ -0,0 +1,308 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "reos_kernel.h"
+#include "trace_debugger.h"
+
+/**
+ * \file
+ *
+ * Records what the kernel does as compact binary events in a ring buffer,
+ * for looking at a run after the fact without stopping it.
+ *
+ * Each event is a timestamp, the input position, a pc and a type, written
+ * into the next slot of a fixed-size, power-of-two ring and published by
+ * advancing \c head. Only the kernel's own thread writes, so recording needs
+ * no lock, and once the ring is full the oldest events are overwritten.
+ *
+ * Another thread can take a copy of the newest events at any time with
+ * trace_debugger_snapshot() or save them with trace_debugger_write(). Saved
+ * traces are read back with trace_read() and exported to Chrome's trace
+ * viewer (chrome://tracing, or Perfetto) with trace_export_chrome(), or to a
+ * CSV timeline with trace_export_csv(). The reos-trace example does both.
+ */
+
+#define TRACE_MAGIC "REOSTRC"
+
+typedef struct TraceFileHeader TraceFileHeader;
+
+struct TraceFileHeader
+{
+	char magic[8];
+	long event_size;
+	long num_events;
+};
+
+static const char *event_names[TraceNumEvents] = {
+	"start", "token", "spawn", "drop", "reject", "match", "detach", "branch", "end"
+};
+
+static unsigned long long now_ns()
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+static void record(ReOS_Debugger *debugger, ReOS_Kernel *k, int type, int pc)
+{
+	TraceDebuggerData *data = debugger->data;
+	unsigned long head = data->head;
+
+	TraceEvent *e = &data->events[head & data->mask];
+	e->time = now_ns() - data->base_time;
+	e->sp = k->sp;
+	e->pc = pc;
+	e->type = type;
+
+	// the event has to be complete before a reader can see it
+	__sync_synchronize();
+	data->head = head + 1;
+}
+
+static void trace_start(ReOS_Debugger *debugger, ReOS_Kernel *k)
+{
+	record(debugger, k, TraceStart, -1);
+}
+
+static void trace_token(ReOS_Debugger *debugger, ReOS_Kernel *k)
+{
+	record(debugger, k, TraceToken, -1);
+}
+
+static void trace_match(ReOS_Debugger *debugger, ReOS_Kernel *k)
+{
+	record(debugger, k, TraceMatch, k->pc);
+}
+
+static void trace_end(ReOS_Debugger *debugger, ReOS_Kernel *k)
+{
+	record(debugger, k, TraceEnd, -1);
+}
+
+static void trace_spawn(ReOS_Debugger *debugger, ReOS_Kernel *k, int pc)
+{
+	record(debugger, k, TraceSpawn, pc);
+}
+
+static void trace_drop(ReOS_Debugger *debugger, ReOS_Kernel *k, int pc)
+{
+	record(debugger, k, TraceDrop, pc);
+}
+
+static void trace_reject(ReOS_Debugger *debugger, ReOS_Kernel *k, int pc)
+{
+	record(debugger, k, TraceReject, pc);
+}
+
+static void trace_detach(ReOS_Debugger *debugger, ReOS_Kernel *k, int pc)
+{
+	record(debugger, k, TraceDetach, pc);
+}
+
+static void trace_branch(ReOS_Debugger *debugger, ReOS_Kernel *k, int pc)
+{
+	record(debugger, k, TraceBranch, pc);
+}
+
+/**
+ * Creates a trace debugger. Attach it to one kernel only, since the ring
+ * has a single writer.
+ *
+ * \param capacity The number of events to keep, rounded up to a power of 2
+ */
+ReOS_Debugger *new_trace_debugger(long capacity)
+{
+	ReOS_Debugger *d = malloc(sizeof(ReOS_Debugger));
+	debugger_reset(d);
+
+	d->start = trace_start;
+	d->before_token = trace_token;
+	d->match = trace_match;
+	d->end = trace_end;
+	d->spawn = trace_spawn;
+	d->drop = trace_drop;
+	d->reject = trace_reject;
+	d->detach = trace_detach;
+	d->branch = trace_branch;
+
+	unsigned long size = 1;
+	while (size < capacity)
+		size <<= 1;
+
+	TraceDebuggerData *data = malloc(sizeof(TraceDebuggerData));
+	data->events = malloc(sizeof(TraceEvent) * size);
+	data->mask = size - 1;
+	data->head = 0;
+	data->base_time = now_ns();
+
+	d->data = data;
+	return d;
+}
+
+void free_trace_debugger(ReOS_Debugger *d)
+{
+	TraceDebuggerData *data = d->data;
+	free(data->events);
+	free(data);
+	free(d);
+}
+
+/**
+ * Copies the newest events, oldest first. This may be called from another
+ * thread while the kernel is running: events the kernel overwrites during
+ * the copy are left out.
+ *
+ * \param events Where to copy the events
+ * \param max_events The most events to copy
+ * \return The number of events copied
+ */
+long trace_debugger_snapshot(ReOS_Debugger *debugger, TraceEvent *events, long max_events)
+{
+	TraceDebuggerData *data = debugger->data;
+	unsigned long size = data->mask + 1;
+
+	unsigned long head = data->head;
+	__sync_synchronize();
+
+	unsigned long first = head > size ? head - size : 0;
+	if (head - first > max_events)
+		first = head - max_events;
+
+	unsigned long i;
+	for (i = first; i < head; i++)
+		events[i - first] = data->events[i & data->mask];
+
+	// the writer may have lapped us, and may be partway through the slot of
+	// the event after its newest
+	__sync_synchronize();
+	unsigned long new_head = data->head;
+	unsigned long valid = new_head + 1 > size ? new_head + 1 - size : 0;
+	if (valid > first) {
+		if (valid >= head)
+			return 0;
+
+		memmove(events, events + (valid - first), sizeof(TraceEvent) * (head - valid));
+		first = valid;
+	}
+
+	return head - first;
+}
+
+/**
+ * Saves a snapshot of the events to a file, to be read by trace_read().
+ *
+ * \return The number of events saved, or -1 if the file couldn't be written
+ */
+long trace_debugger_write(ReOS_Debugger *debugger, const char *path)
+{
+	TraceDebuggerData *data = debugger->data;
+	long max_events = data->mask + 1;
+
+	TraceEvent *events = malloc(sizeof(TraceEvent) * max_events);
+	TraceFileHeader header;
+	memset(&header, 0, sizeof(header));
+	strcpy(header.magic, TRACE_MAGIC);
+	header.event_size = sizeof(TraceEvent);
+	header.num_events = trace_debugger_snapshot(debugger, events, max_events);
+
+	FILE *f = fopen(path, "wb");
+	long written = -1;
+	if (f) {
+		if (fwrite(&header, sizeof(header), 1, f) == 1
+			&& fwrite(events, sizeof(TraceEvent), header.num_events, f) == header.num_events)
+			written = header.num_events;
+		if (fclose(f))
+			written = -1;
+	}
+
+	free(events);
+	return written;
+}
+
+/**
+ * Reads a trace saved by trace_debugger_write().
+ *
+ * \param path The trace file
+ * \param num_events Set to the number of events read
+ * \return The events, to be freed by the caller, or NULL if \a path isn't a
+ * trace written by this build
+ */
+TraceEvent *trace_read(const char *path, long *num_events)
+{
+	FILE *f = fopen(path, "rb");
+	if (!f) {
+		fprintf(stderr, "error: could not open %s\n", path);
+		return 0;
+	}
+
+	TraceFileHeader header;
+	if (fread(&header, sizeof(header), 1, f) != 1 || strcmp(header.magic, TRACE_MAGIC)
+		|| header.event_size != sizeof(TraceEvent) || header.num_events < 0) {
+		fprintf(stderr, "error: %s is not a ReOS trace\n", path);
+		fclose(f);
+		return 0;
+	}
+
+	TraceEvent *events = malloc(sizeof(TraceEvent) * (header.num_events ? header.num_events : 1));
+	*num_events = fread(events, sizeof(TraceEvent), header.num_events, f);
+	if (*num_events != header.num_events)
+		fprintf(stderr, "warning: %s is truncated\n", path);
+
+	fclose(f);
+	return events;
+}
+
+const char *trace_event_name(int type)
+{
+	return type >= 0 && type < TraceNumEvents ? event_names[type] : "unknown";
+}
+
+/**
+ * Writes events in Chrome's trace event format. Each token is a slice
+ * lasting until the next one, and the other events are instants within it.
+ */
+void trace_export_chrome(FILE *f, TraceEvent *events, long num_events)
+{
+	fprintf(f, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+
+	long i, j = 0;
+	for (i = 0; i < num_events; i++) {
+		TraceEvent *e = &events[i];
+		fprintf(f, i ? ",\n" : "");
+
+		if (e->type == TraceToken) {
+			// a token lasts until the next token or the end of the run
+			if (j <= i)
+				j = i + 1;
+			while (j < num_events && events[j].type != TraceToken && events[j].type != TraceEnd)
+				j++;
+			unsigned long long end = events[j < num_events ? j : num_events - 1].time;
+
+			fprintf(f, "{\"name\": \"token %ld\", \"cat\": \"token\", \"ph\": \"X\", "
+					"\"ts\": %.3f, \"dur\": %.3f, \"pid\": 1, \"tid\": 1, \"args\": {\"sp\": %ld}}",
+					e->sp, e->time / 1000.0, (end - e->time) / 1000.0, e->sp);
+		}
+		else {
+			fprintf(f, "{\"name\": \"%s\", \"cat\": \"kernel\", \"ph\": \"i\", \"s\": \"t\", "
+					"\"ts\": %.3f, \"pid\": 1, \"tid\": 1, \"args\": {\"sp\": %ld, \"pc\": %d}}",
+					trace_event_name(e->type), e->time / 1000.0, e->sp, e->pc);
+		}
+	}
+
+	fprintf(f, "\n]}\n");
+}
+
+/**
+ * Writes events as CSV, one per line, with a header line.
+ */
+void trace_export_csv(FILE *f, TraceEvent *events, long num_events)
+{
+	fprintf(f, "time_ns,event,sp,pc\n");
+
+	long i;
+	for (i = 0; i < num_events; i++) {
+		fprintf(f, "%llu,%s,%ld,%d\n", events[i].time, trace_event_name(events[i].type),
+				events[i].sp, events[i].pc);
+	}
+}
@@ -0,0 +1,62 @@
+#ifndef TRACE_DEBUGGER_H
+#define TRACE_DEBUGGER_H
+
+#include <stdio.h>
+#include "reos_debugger.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct TraceEvent TraceEvent;
+typedef struct TraceDebuggerData TraceDebuggerData;
+
+enum
+{
+	TraceStart,
+	TraceToken,
+	TraceSpawn,
+	TraceDrop,
+	TraceReject,
+	TraceMatch,
+	TraceDetach,
+	TraceBranch,
+	TraceEnd,
+	TraceNumEvents
+};
+
+struct TraceEvent
+{
+	// nanoseconds since the debugger was created
+	unsigned long long time;
+	long sp;
+	int pc;
+	int type;
+};
+
+struct TraceDebuggerData
+{
+	TraceEvent *events;
+	unsigned long mask;
+
+	// the number of events ever recorded; the newest is at (head - 1) & mask
+	volatile unsigned long head;
+
+	unsigned long long base_time;
+};
+
+ReOS_Debugger *new_trace_debugger(long);
+void free_trace_debugger(ReOS_Debugger *);
+long trace_debugger_snapshot(ReOS_Debugger *, TraceEvent *, long);
+long trace_debugger_write(ReOS_Debugger *, const char *);
+
+TraceEvent *trace_read(const char *, long *);
+const char *trace_event_name(int);
+void trace_export_chrome(FILE *, TraceEvent *, long);
+void trace_export_csv(FILE *, TraceEvent *, long);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
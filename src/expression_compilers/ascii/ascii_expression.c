@@ -1,11 +1,68 @@
 #include "ascii_expression.h"
+#include "ascii_inst.h"
 #include "ascii_parse.h"
 #include "ascii_lex.h"
+#include "ascii_tree.h"
+#include "reos_pattern.h"
+#include "standard_inst.h"
 
 TreeNode *ascii_expression_compile(char *string)
 {
-	YY_BUFFER_STATE buffer = yy_scan_string(string);
-	TreeNode *tree = ascii_expression_parse(string);
-	yy_delete_buffer(buffer);
+	return ascii_expression_compile_arena(string, 0);
+}
+
+/**
+ * Parses \a string with a scanner and parser of its own, so strings can be
+ * parsed on many threads at once.
+ *
+ * \param arena The arena to allocate the tree's nodes from, or 0 to
+ * malloc() them
+ * \return The tree, to be freed with free_ascii_tree_node() before
+ * \a arena is freed, or 0 if \a string doesn't parse
+ */
+TreeNode *ascii_expression_compile_arena(char *string, TreeArena *arena)
+{
+	yyscan_t scanner;
+	if (yylex_init(&scanner))
+		return 0;
+
+	YY_BUFFER_STATE buffer = yy_scan_string(string, scanner);
+	TreeNode *tree = ascii_expression_parse(scanner, arena);
+	yy_delete_buffer(buffer, scanner);
+	yylex_destroy(scanner);
 	return tree;
 }
+
+/**
+ * Compiles \a string to a pattern of the ascii instruction set, as
+ * ascii_pattern_compiler does for a ReOS_PatternCache.
+ *
+ * \param options ASCII_COMPILE_* flags
+ * \param info Set to what standard_pattern_info() finds
+ * \return The pattern, to be freed with free_mem_pattern(), or 0 if
+ * \a string doesn't parse
+ */
+ReOS_Pattern *ascii_pattern_compile(const char *string, int options, ReOS_PatternInfo *info, void *data)
+{
+	TreeArena *arena = new_tree_arena();
+	TreeNode *tree = ascii_expression_compile_arena((char *)string, arena);
+	if (!tree) {
+		free_tree_arena(arena);
+		return 0;
+	}
+
+	if (options & ASCII_COMPILE_OPTIMIZE)
+		tree = ascii_tree_optimize(tree);
+
+	ReOS_Pattern *pattern = new_mem_pattern();
+	standard_tree_compile(pattern, tree, ascii_inst_factory, ascii_tree_node_compile);
+	if (!(options & ASCII_COMPILE_NO_CLOSURES))
+		standard_pattern_compute_closures(pattern);
+	free_ascii_tree_node(tree);
+	free_tree_arena(arena);
+
+	standard_pattern_info(pattern, info);
+	return pattern;
+}
+
+ReOS_PatternCompiler ascii_pattern_compiler = {ascii_pattern_compile, (VoidPtrFunc)free_mem_pattern, 0};
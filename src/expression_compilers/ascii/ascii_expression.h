@@ -1,14 +1,29 @@
 #ifndef ASCII_EXPRESSION_COMPILE_H
 #define ASCII_EXPRESSION_COMPILE_H
 
+#include "reos_cache.h"
 #include "standard_tree.h"
 
+/**
+ * Optimizes the expression's tree.
+ */
+#define ASCII_COMPILE_OPTIMIZE 1
+
+/**
+ * Leaves the jmps and splits in the program for the kernel to run one at a
+ * time, instead of replacing them with closures.
+ */
+#define ASCII_COMPILE_NO_CLOSURES 2
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 TreeNode *ascii_expression_compile(char *);
-TreeNode *ascii_expression_parse(char *); // in the grammar file
+TreeNode *ascii_expression_compile_arena(char *, TreeArena *);
+ReOS_Pattern *ascii_pattern_compile(const char *, int, ReOS_PatternInfo *, void *);
+
+extern ReOS_PatternCompiler ascii_pattern_compiler;
 
 #ifdef __cplusplus
 }
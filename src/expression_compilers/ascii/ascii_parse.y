@@ -2,6 +2,32 @@
 // Use of this source code is governed by a BSD-style
 // license that can be found in the LICENSE file.
 
+%code requires {
+
+#ifndef YY_TYPEDEF_YY_SCANNER_T
+#define YY_TYPEDEF_YY_SCANNER_T
+typedef void *yyscan_t;
+#endif
+
+/*
+ * The state of one parse, so that expressions can be parsed on many
+ * threads at once.
+ */
+typedef struct AsciiParse
+{
+	struct TreeNode *tree;
+	struct TreeArena *arena; //!< Nodes are allocated from it, or malloc()ed if 0
+	int nparen;
+} AsciiParse;
+
+}
+
+%code provides {
+
+struct TreeNode *ascii_expression_parse(yyscan_t, struct TreeArena *);
+
+}
+
 %{
 
 #include <ctype.h>
@@ -11,10 +37,7 @@
 #include <string.h>
 #include "ascii_tree.h"
 
-extern int yylex();
-static void yyerror(char*);
-TreeNode *parsed_ascii_tree;
-static int nparen;
+#define node(type, left, right) new_ascii_arena_node(parse->arena, (type), (left), (right))
 
 struct TreeNode;
 
@@ -22,6 +45,11 @@ struct TreeNode;
 
 %}
 
+%define api.pure
+%lex-param {yyscan_t scanner}
+%parse-param {yyscan_t scanner}
+%parse-param {AsciiParse *parse}
+
 /* pisses me off that the preprocessor inserts this before including
    ascii_tree.h for whatever reason */
 %union {
@@ -35,19 +63,26 @@ struct TreeNode;
 %type	<node>	 		lit alt concat repeat single line range repeatrange
 %type	<nparen>		count
 
+%{
+
+int yylex(YYSTYPE *, yyscan_t);
+static void yyerror(yyscan_t, AsciiParse *, const char *);
+
+%}
+
 %%
 
 line: alt END
 	{
-		parsed_ascii_tree = $1;
-		return 1;
+		parse->tree = $1;
+		YYACCEPT;
 	}
 
 alt:
 	concat
 |	alt '|' concat
 	{
-		$$ = new_ascii_tree_node(NodeAlt, $1, $3);
+		$$ = node(NodeAlt, $1, $3);
 	}
 ;
 
@@ -55,7 +90,7 @@ concat:
 	repeat
 |	concat repeat
 	{
-		$$ = new_ascii_tree_node(NodeCat, $1, $2);
+		$$ = node(NodeCat, $1, $2);
 	}
 ;
 
@@ -63,80 +98,80 @@ repeat:
 	single
 |	single '*'
 	{
-		$$ = new_ascii_tree_node(NodeStar, $1, 0);
+		$$ = node(NodeStar, $1, 0);
 	}
 |	single '*' '?'
 	{
-		$$ = new_ascii_tree_node(NodeStar, $1, 0);
+		$$ = node(NodeStar, $1, 0);
 		$$->x = 1;
 	}
 |	single '+'
 	{
-		$$ = new_ascii_tree_node(NodePlus, $1, 0);
+		$$ = node(NodePlus, $1, 0);
 	}
 |	single '+' '?'
 	{
-		$$ = new_ascii_tree_node(NodePlus, $1, 0);
+		$$ = node(NodePlus, $1, 0);
 		$$->x = 1;
 	}
 |	single '?'
 	{
-		$$ = new_ascii_tree_node(NodeQuest, $1, 0);
+		$$ = node(NodeQuest, $1, 0);
 	}
 |	single '?' '?'
 	{
-		$$ = new_ascii_tree_node(NodeQuest, $1, 0);
+		$$ = node(NodeQuest, $1, 0);
 		$$->x = 1;
 	}
 |	single REP_START '}'
 	{
-		$$ = new_ascii_tree_node(NodeRepCount, $1, 0);
+		$$ = node(NodeRepCount, $1, 0);
 		$$->x = $2;
 		$$->y = 0;
 	}
 |	single REP_START ',' '}'
 	{
-		$$ = new_ascii_tree_node(NodeRepCount, $1, 0);
+		$$ = node(NodeRepCount, $1, 0);
 		$$->x = $2;
 		$$->y = -1;
 	}
 |	single '{' ',' REP_END
 	{
-		$$ = new_ascii_tree_node(NodeRepCount, $1, 0);
+		$$ = node(NodeRepCount, $1, 0);
 		$$->x = 0;
 		$$->y = $4;
 	}
 |	single REP_START ',' REP_END
 	{
-		$$ = new_ascii_tree_node(NodeRepCount, $1, 0);
+		$$ = node(NodeRepCount, $1, 0);
 		$$->x = $2;
 		$$->y = $4;
 	}
 |	'(' '?' '=' alt ')'
 	{
-		$$ = new_ascii_tree_node(NodePosAhead, $4, 0);
+		$$ = node(NodePosAhead, $4, 0);
 	}
 |	'(' '?' '!' alt ')'
 	{
-		$$ = new_ascii_tree_node(NodeNegAhead, $4, 0);
+		$$ = node(NodeNegAhead, $4, 0);
 	}
 |	'(' QUESTION_NUM ')'
 	{
-		$$ = new_ascii_tree_node(NodeRecurse, 0, 0);
+		$$ = node(NodeRecurse, 0, 0);
 		$$->x = $2;
 	}
 ;
 
 count:
 	{
-		$$ = nparen++;
+		$$ = parse->nparen++;
 	}
 ;
 
 single:
 	'(' count alt ')'
 	{
-		$$ = new_ascii_tree_node(NodeParen, $3, 0);
+		$$ = node(NodeParen, $3, 0);
 		$$->x = $2;
 	}
 |	'(' '?' ':' alt ')'
@@ -145,10 +180,10 @@ single:
 	}
 |	'[' '^' range ']'
 	{
-		TreeNode *negahead = new_ascii_tree_node(NodeNegAhead, $3, 0);
-		TreeNode *dot = new_ascii_tree_node(NodeDot, 0, 0);
+		TreeNode *negahead = node(NodeNegAhead, $3, 0);
+		TreeNode *dot = node(NodeDot, 0, 0);
 
-		$$ = new_ascii_tree_node(NodeCat, negahead, dot);
+		$$ = node(NodeCat, negahead, dot);
 	}
 |	'[' range ']'
 	{
@@ -156,20 +191,20 @@ single:
 	}
 |	'^'
 	{
-		$$ = new_ascii_tree_node(NodeStart, 0, 0);
+		$$ = node(NodeStart, 0, 0);
 	}
 |	'$'
 	{
-		$$ = new_ascii_tree_node(NodeEnd, 0, 0);
+		$$ = node(NodeEnd, 0, 0);
 	}
 |	ESCAPED_NUM
 	{
-		$$ = new_ascii_tree_node(NodeBacktrack, 0, 0);
+		$$ = node(NodeBacktrack, 0, 0);
 		$$->x = $1-48-1;
 	}
 |	'.'
 	{
-		$$ = new_ascii_tree_node(NodeDot, 0, 0);
+		$$ = node(NodeDot, 0, 0);
 	}
 |	lit
 ;
@@ -178,14 +213,14 @@ range:
 	repeatrange
 |	range repeatrange
 	{
-		$$ = new_ascii_tree_node(NodeAlt, $1, $2);
+		$$ = node(NodeAlt, $1, $2);
 	}
 ;
 
 repeatrange:
 	char '-' char
 	{
-		$$ = new_ascii_tree_node(NodeAsciiRange, 0, 0);
+		$$ = node(NodeAsciiRange, 0, 0);
 		AsciiTreeNodeArgs *args = $$->args;
 		args->c1 = $1;
 		args->c2 = $3;
@@ -193,7 +228,7 @@ repeatrange:
 |	lit
 |	'?'
 	{
-		$$ = new_ascii_tree_node(NodeAsciiChar, 0, 0);
+		$$ = node(NodeAsciiChar, 0, 0);
 		((AsciiTreeNodeArgs *)$$->args)->c1 = '?';
 	}
 ;
@@ -205,35 +240,39 @@ char:
 lit:
 	char
 	{
-		$$ = new_ascii_tree_node(NodeAsciiChar, 0, 0);
+		$$ = node(NodeAsciiChar, 0, 0);
 		((AsciiTreeNodeArgs *)$$->args)->c1 = $1;
 	}
 |	SPECIAL
 	{
-		$$ = new_ascii_tree_node(NodeAsciiChar, 0, 0);
+		$$ = node(NodeAsciiChar, 0, 0);
 		((AsciiTreeNodeArgs *)$$->args)->c1 = -1;
 		((AsciiTreeNodeArgs *)$$->args)->c2 = $1;
 	}
 |	':'
 	{
-		$$ = new_ascii_tree_node(NodeAsciiChar, 0, 0);
+		$$ = node(NodeAsciiChar, 0, 0);
 		((AsciiTreeNodeArgs *)$$->args)->c1 = ':';
 	}
 ;
 
 %%
 
-static void yyerror(char *s)
+static void yyerror(yyscan_t scanner, AsciiParse *parse, const char *s)
 {
 	fprintf(stderr, "Yacc error: %s\n", s);
 }
 
-TreeNode* ascii_expression_parse(char *s)
+/**
+ * Parses the string \a scanner was set up to scan.
+ *
+ * \param arena The arena to allocate nodes from, or 0 to malloc() them
+ * \return The tree, or 0 if the string doesn't parse
+ */
+TreeNode* ascii_expression_parse(yyscan_t scanner, TreeArena *arena)
 {
-	parsed_ascii_tree = 0;
-	nparen = 0;
-
-	if (yyparse() != 1)
-		yyerror("did not parse");
-	return parsed_ascii_tree;
+	AsciiParse parse = {0, arena, 0};
+	if (yyparse(scanner, &parse))
+		yyerror(scanner, &parse, "did not parse");
+	return parse.tree;
 }
@@ -9,8 +9,14 @@ options {
 	#include "string_tree.h"
 }
 
-@postinclude {
-	static int nparen = 1;
+// kept in the parser rather than in a global, so expressions can be parsed
+// on many threads at once
+@parser::context {
+	int nparen;
+}
+
+@parser::apifuncs {
+	ctx->nparen = 1;
 }
 
 line returns [TreeNode *node]:
@@ -91,7 +97,7 @@ single returns [TreeNode *node]:
 	'(' alt ')'
 	{
 		$node = new_string_tree_node(NodeParen, $alt.node, 0);
-		$node->x = nparen++;
+		$node->x = ctx->nparen++;
 	}
 |	'(' '?' ':' alt ')'
 	{
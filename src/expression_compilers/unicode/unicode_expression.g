@@ -10,8 +10,14 @@ options {
 	#include "unicode/ustring.h"
 }
 
-@postinclude {
-	static int nparen = 1;
+// kept in the parser rather than in a global, so expressions can be parsed
+// on many threads at once
+@parser::context {
+	int nparen;
+}
+
+@parser::apifuncs {
+	ctx->nparen = 1;
 }
 
 line returns [TreeNode *node]:
@@ -92,7 +98,7 @@ single returns [TreeNode *node]:
 	'(' alt ')'
 	{
 		$node = new_unicode_tree_node(NodeParen, $alt.node, 0);
-		$node->x = nparen++;
+		$node->x = ctx->nparen++;
 	}
 |	'(' '?' ':' alt ')'
 	{
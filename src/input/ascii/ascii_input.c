@@ -1,6 +1,10 @@
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "ascii_input.h"
 
 ReOS_Input *new_ascii_string_input(char *string)
@@ -13,6 +17,9 @@ ReOS_Input *new_ascii_string_input(char *string)
 	ReOS_Input *input = malloc(sizeof(ReOS_Input));
 	input->indexed_read = input_ascii_string_indexed_read;
 	input->stream_read = input_ascii_string_stream_read;
+	input->map_read = 0;
+	input->span = input_ascii_string_span;
+	input->seek = input_ascii_string_seek;
 	input->token_size = sizeof(char);
 	input->buffer_size = 64;
 	input->free_token = 0;
@@ -36,6 +43,19 @@ int input_ascii_string_indexed_read(void *buf, int size, long index, void *d)
 	return copied;
 }
 
+void *input_ascii_string_span(long *len, void *d)
+{
+	AsciiStringInputData *data = (AsciiStringInputData *)d;
+	*len = data->len;
+	return data->string;
+}
+
+void input_ascii_string_seek(long index, void *d)
+{
+	AsciiStringInputData *data = (AsciiStringInputData *)d;
+	data->pos = index < data->len ? index : data->len;
+}
+
 int input_ascii_string_stream_read(void *buf, int size, void *d)
 {
 	AsciiStringInputData *data = (AsciiStringInputData *)d;
@@ -50,6 +70,9 @@ ReOS_Input *new_ascii_file_input(char *path)
 	ReOS_Input *input = malloc(sizeof(ReOS_Input));
 	input->indexed_read = input_ascii_file_indexed_read;
 	input->stream_read = input_ascii_file_stream_read;
+	input->map_read = 0;
+	input->span = 0;
+	input->seek = input_ascii_file_seek;
 	input->token_size = sizeof(char);
 	input->buffer_size = 1024;
 	input->free_token = 0;
@@ -75,10 +98,122 @@ int input_ascii_file_stream_read(void *buf, int size, void *file)
 	return fread(buf, 1, size, file);
 }
 
+void input_ascii_file_seek(long index, void *file)
+{
+	fseek(file, index, SEEK_SET);
+}
+
 int input_ascii_file_indexed_read(void *buf, int size, long index, void *file)
 {
+	// the file is shared with input_ascii_file_stream_read(), so put it back
+	// where we found it when we're done
+	long stream_pos = ftell(file);
 	fseek(file, index, SEEK_SET);
-	return fread(buf, 1, size, file);
+	int read = fread(buf, 1, size, file);
+	fseek(file, stream_pos, SEEK_SET);
+	return read;
+}
+
+/**
+ * Creates an input that maps the file at \a path into memory. The token
+ * buffer walks the mapping directly, so no input is ever copied, and indexed
+ * reads are a single memcpy().
+ */
+ReOS_Input *new_ascii_mmap_input(char *path)
+{
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+	if (fd == -1 || fstat(fd, &st) == -1) {
+		fprintf(stderr, "error: could not open file ");
+		perror(path);
+		exit(1);
+	}
+
+	AsciiMmapInputData *data = malloc(sizeof(AsciiMmapInputData));
+	data->pos = 0;
+	data->len = st.st_size;
+	data->map = 0;
+
+	// mmap() refuses zero-length mappings, and an empty input needs none
+	if (data->len > 0) {
+		data->map = mmap(0, data->len, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data->map == MAP_FAILED) {
+			fprintf(stderr, "error: could not map file ");
+			perror(path);
+			exit(1);
+		}
+
+		madvise(data->map, data->len, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+		madvise(data->map, data->len, MADV_HUGEPAGE);
+#endif
+	}
+	close(fd);
+
+	ReOS_Input *input = malloc(sizeof(ReOS_Input));
+	input->indexed_read = input_ascii_mmap_indexed_read;
+	input->stream_read = input_ascii_mmap_stream_read;
+	input->map_read = input_ascii_mmap_map_read;
+	input->span = input_ascii_mmap_span;
+	input->seek = input_ascii_mmap_seek;
+	input->token_size = sizeof(char);
+	input->buffer_size = 1 << 20;
+	input->free_token = 0;
+	input->data = data;
+	return input;
+}
+
+void free_ascii_mmap_input(ReOS_Input *input)
+{
+	if (input) {
+		AsciiMmapInputData *data = (AsciiMmapInputData *)input->data;
+		if (data->map)
+			munmap(data->map, data->len);
+		free(data);
+		free(input);
+	}
+}
+
+void *input_ascii_mmap_span(long *len, void *d)
+{
+	AsciiMmapInputData *data = (AsciiMmapInputData *)d;
+	*len = data->len;
+	return data->map;
+}
+
+int input_ascii_mmap_map_read(void **buf, int size, void *d)
+{
+	AsciiMmapInputData *data = (AsciiMmapInputData *)d;
+	int mapped = data->pos+size < data->len ? size : data->len-data->pos;
+	*buf = data->map+data->pos;
+	data->pos += mapped;
+	return mapped;
+}
+
+void input_ascii_mmap_seek(long index, void *d)
+{
+	AsciiMmapInputData *data = (AsciiMmapInputData *)d;
+	data->pos = index < data->len ? index : data->len;
+}
+
+int input_ascii_mmap_stream_read(void *buf, int size, void *d)
+{
+	AsciiMmapInputData *data = (AsciiMmapInputData *)d;
+	int copied = data->pos+size < data->len ? size : data->len-data->pos;
+	memcpy(buf, data->map+data->pos, copied);
+	data->pos += copied;
+	return copied;
+}
+
+int input_ascii_mmap_indexed_read(void *buf, int size, long index, void *d)
+{
+	AsciiMmapInputData *data = (AsciiMmapInputData *)d;
+	if (index < 0 || index >= data->len)
+		return 0;
+
+	int copied = size < data->len-index ? size : data->len-index;
+	memcpy(buf, data->map+index, copied);
+	return copied;
 }
 
 void print_ascii_string_input(ReOS_Kernel *k)
@@ -8,6 +8,7 @@ extern "C" {
 #endif
 
 typedef struct AsciiStringInputData AsciiStringInputData;
+typedef struct AsciiMmapInputData AsciiMmapInputData;
 
 struct AsciiStringInputData
 {
@@ -16,16 +17,34 @@ struct AsciiStringInputData
 	long len;
 };
 
+struct AsciiMmapInputData
+{
+	char *map;
+	long pos;
+	long len;
+};
+
 ReOS_Input *new_ascii_string_input(char *);
 void free_ascii_string_input(ReOS_Input *);
+void *input_ascii_string_span(long *, void *);
+void input_ascii_string_seek(long, void *);
 int input_ascii_string_stream_read(void *, int, void *);
 int input_ascii_string_indexed_read(void *, int, long, void *);
 
 ReOS_Input *new_ascii_file_input(char *);
 void free_ascii_file_input(ReOS_Input *);
+void input_ascii_file_seek(long, void *);
 int input_ascii_file_stream_read(void *, int, void *);
 int input_ascii_file_indexed_read(void *, int, long, void *);
 
+ReOS_Input *new_ascii_mmap_input(char *);
+void free_ascii_mmap_input(ReOS_Input *);
+void *input_ascii_mmap_span(long *, void *);
+int input_ascii_mmap_map_read(void **, int, void *);
+void input_ascii_mmap_seek(long, void *);
+int input_ascii_mmap_stream_read(void *, int, void *);
+int input_ascii_mmap_indexed_read(void *, int, long, void *);
+
 void print_ascii_string_input(ReOS_Kernel *);
 
 #ifdef __cplusplus
@@ -0,0 +1,178 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "compressed_input.h"
+
+/**
+ * \file
+ *
+ * Compressed inputs decompress a file straight into a window that the token
+ * buffer reads from through \c map_read, so there is no temporary file and no
+ * extra copy. When the window fills up, its last COMPRESSED_RETAIN_SIZE bytes
+ * are kept and the rest is discarded.
+ *
+ * Indexed reads inside the window are a memcpy(). Older input is
+ * decompressed again by a second decoder, which only moves forward unless a
+ * read asks for something behind it, in which case it starts over. Reads of
+ * captures in increasing order therefore decompress the file at most once
+ * more.
+ */
+
+/**
+ * Size of the scratch buffer that skipped input is decompressed into.
+ */
+#define COMPRESSED_SKIP_SIZE 4096
+
+/**
+ * Decompresses more input into the window, first sliding it if it is full.
+ *
+ * \return The number of bytes decompressed, or 0 at the end of input
+ */
+static long window_fill(CompressedInputData *data)
+{
+	if (data->window_len == COMPRESSED_WINDOW_SIZE) {
+		long discard = data->window_len - COMPRESSED_RETAIN_SIZE;
+		memmove(data->window, data->window + discard, COMPRESSED_RETAIN_SIZE);
+		data->window_start += discard;
+		data->window_len -= discard;
+		data->window_pos -= discard;
+	}
+
+	long len = data->decoder->read(data->stream, data->window + data->window_len,
+								   COMPRESSED_WINDOW_SIZE - data->window_len);
+	data->window_len += len;
+	return len;
+}
+
+/**
+ * Creates an input that decompresses the file at \a path with \a decoder.
+ * Usually called through a wrapper such as new_gzip_input().
+ */
+ReOS_Input *new_compressed_input(char *path, CompressedDecoder *decoder)
+{
+	CompressedInputData *data = malloc(sizeof(CompressedInputData));
+	data->decoder = decoder;
+	data->path = strdup(path);
+	data->stream = decoder->open(path);
+	data->window = malloc(COMPRESSED_WINDOW_SIZE);
+	data->window_start = 0;
+	data->window_len = 0;
+	data->window_pos = 0;
+	data->indexed = 0;
+	data->indexed_pos = 0;
+
+	ReOS_Input *input = malloc(sizeof(ReOS_Input));
+	input->indexed_read = input_compressed_indexed_read;
+	input->stream_read = input_compressed_stream_read;
+	input->map_read = input_compressed_map_read;
+	input->span = 0;
+	input->seek = input_compressed_seek;
+	input->token_size = sizeof(char);
+	input->buffer_size = COMPRESSED_WINDOW_SIZE;
+	input->free_token = 0;
+	input->data = data;
+	return input;
+}
+
+void free_compressed_input(ReOS_Input *input)
+{
+	if (input) {
+		CompressedInputData *data = (CompressedInputData *)input->data;
+		data->decoder->close(data->stream);
+		if (data->indexed)
+			data->decoder->close(data->indexed);
+
+		free(data->window);
+		free(data->path);
+		free(data);
+		free(input);
+	}
+}
+
+int input_compressed_map_read(void **buf, int size, void *d)
+{
+	CompressedInputData *data = (CompressedInputData *)d;
+	if (data->window_pos == data->window_len && !window_fill(data))
+		return 0;
+
+	long len = data->window_len - data->window_pos;
+	if (len > size)
+		len = size;
+
+	*buf = data->window + data->window_pos;
+	data->window_pos += len;
+	return len;
+}
+
+int input_compressed_stream_read(void *buf, int size, void *d)
+{
+	void *tokens;
+	int len = input_compressed_map_read(&tokens, size, d);
+	if (len)
+		memcpy(buf, tokens, len);
+	return len;
+}
+
+int input_compressed_indexed_read(void *buf, int size, long index, void *d)
+{
+	CompressedInputData *data = (CompressedInputData *)d;
+	if (index >= data->window_start && index + size <= data->window_start + data->window_len) {
+		memcpy(buf, data->window + index - data->window_start, size);
+		return size;
+	}
+
+	if (!data->indexed)
+		data->indexed = data->decoder->open(data->path);
+	else if (index < data->indexed_pos) {
+		data->decoder->rewind(data->indexed);
+		data->indexed_pos = 0;
+	}
+
+	char skipped[COMPRESSED_SKIP_SIZE];
+	while (data->indexed_pos < index) {
+		long skip = index - data->indexed_pos;
+		if (skip > COMPRESSED_SKIP_SIZE)
+			skip = COMPRESSED_SKIP_SIZE;
+
+		long len = data->decoder->read(data->indexed, skipped, skip);
+		if (!len)
+			return 0;
+		data->indexed_pos += len;
+	}
+
+	long copied = 0;
+	while (copied < size) {
+		long len = data->decoder->read(data->indexed, (char *)buf + copied, size - copied);
+		if (!len)
+			break;
+		copied += len;
+	}
+
+	data->indexed_pos += copied;
+	return copied;
+}
+
+/**
+ * Moves the stream to \a index. Seeking within the window is free; seeking
+ * past it decompresses and discards everything in between, and seeking
+ * behind it starts over from the beginning of the file.
+ */
+void input_compressed_seek(long index, void *d)
+{
+	CompressedInputData *data = (CompressedInputData *)d;
+	if (index < data->window_start) {
+		data->decoder->rewind(data->stream);
+		data->window_start = 0;
+		data->window_len = 0;
+	}
+
+	while (index > data->window_start + data->window_len) {
+		data->window_pos = data->window_len;
+		if (!window_fill(data))
+			break;
+	}
+
+	data->window_pos = index - data->window_start;
+	if (data->window_pos > data->window_len)
+		data->window_pos = data->window_len;
+}
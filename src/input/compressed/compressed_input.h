@@ -0,0 +1,64 @@
+#ifndef COMPRESSED_INPUT_H
+#define COMPRESSED_INPUT_H
+
+#include "reos_types.h"
+
+/**
+ * Bytes of decompressed input kept in memory at once. The kernel reads
+ * directly out of this window.
+ */
+#define COMPRESSED_WINDOW_SIZE (1 << 22)
+
+/**
+ * Bytes of already consumed input kept at the front of the window when it
+ * slides, so that indexed reads of recent captures don't have to decompress
+ * anything.
+ */
+#define COMPRESSED_RETAIN_SIZE (1 << 20)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct CompressedDecoder CompressedDecoder;
+typedef struct CompressedInputData CompressedInputData;
+
+/**
+ * A streaming decompressor. \c read fills up to the given number of bytes and
+ * returns how many it produced, which is 0 only at the end of the stream.
+ */
+struct CompressedDecoder
+{
+	void *(*open)(char *);
+	long (*read)(void *, char *, long);
+	void (*rewind)(void *);
+	void (*close)(void *);
+};
+
+struct CompressedInputData
+{
+	CompressedDecoder *decoder;
+	char *path;
+
+	void *stream; //!< Feeds the window
+	char *window;
+	long window_start; //!< Input index of window[0]
+	long window_len;
+	long window_pos; //!< Bytes of the window handed out so far
+
+	void *indexed; //!< Serves indexed reads outside the window, opened on demand
+	long indexed_pos;
+};
+
+ReOS_Input *new_compressed_input(char *, CompressedDecoder *);
+void free_compressed_input(ReOS_Input *);
+int input_compressed_map_read(void **, int, void *);
+int input_compressed_stream_read(void *, int, void *);
+int input_compressed_indexed_read(void *, int, long, void *);
+void input_compressed_seek(long, void *);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#include "gzip_input.h"
+
+typedef struct GzipStream GzipStream;
+
+struct GzipStream
+{
+	FILE *file;
+	z_stream z;
+	int end;
+	unsigned char in[GZIP_READ_SIZE];
+};
+
+static void *gzip_stream_open(char *path)
+{
+	GzipStream *s = malloc(sizeof(GzipStream));
+	s->file = fopen(path, "rb");
+	if (!s->file) {
+		fprintf(stderr, "error: could not open file %s\n", path);
+		exit(1);
+	}
+
+	// 32 added to the window bits detects both gzip and zlib headers
+	memset(&s->z, 0, sizeof(z_stream));
+	if (inflateInit2(&s->z, 15 + 32) != Z_OK) {
+		fprintf(stderr, "error: could not initialize zlib\n");
+		exit(1);
+	}
+
+	s->end = 0;
+	return s;
+}
+
+static void gzip_stream_rewind(void *d)
+{
+	GzipStream *s = (GzipStream *)d;
+	fseek(s->file, 0, SEEK_SET);
+	inflateReset(&s->z);
+	s->z.avail_in = 0;
+	s->end = 0;
+}
+
+static void gzip_stream_close(void *d)
+{
+	GzipStream *s = (GzipStream *)d;
+	inflateEnd(&s->z);
+	fclose(s->file);
+	free(s);
+}
+
+static long gzip_stream_read(void *d, char *out, long size)
+{
+	GzipStream *s = (GzipStream *)d;
+	s->z.next_out = (Bytef *)out;
+	s->z.avail_out = size;
+
+	while (s->z.avail_out && !s->end) {
+		if (!s->z.avail_in) {
+			s->z.next_in = s->in;
+			s->z.avail_in = fread(s->in, 1, GZIP_READ_SIZE, s->file);
+			if (!s->z.avail_in) {
+				s->end = 1;
+				break;
+			}
+		}
+
+		int ret = inflate(&s->z, Z_NO_FLUSH);
+		if (ret == Z_STREAM_END) {
+			// concatenated gzip members decompress as one input
+			if (!s->z.avail_in) {
+				s->z.next_in = s->in;
+				s->z.avail_in = fread(s->in, 1, GZIP_READ_SIZE, s->file);
+			}
+
+			if (s->z.avail_in)
+				inflateReset(&s->z);
+			else
+				s->end = 1;
+		}
+		else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+			fprintf(stderr, "error: gzip: %s\n", s->z.msg ? s->z.msg : "corrupt input");
+			s->end = 1;
+		}
+	}
+
+	return size - s->z.avail_out;
+}
+
+static CompressedDecoder gzip_decoder = {
+	gzip_stream_open,
+	gzip_stream_read,
+	gzip_stream_rewind,
+	gzip_stream_close
+};
+
+/**
+ * Creates an input that decompresses a gzip or zlib file. Free it with
+ * free_compressed_input().
+ */
+ReOS_Input *new_gzip_input(char *path)
+{
+	return new_compressed_input(path, &gzip_decoder);
+}
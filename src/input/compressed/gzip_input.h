@@ -0,0 +1,18 @@
+#ifndef GZIP_INPUT_H
+#define GZIP_INPUT_H
+
+#include "compressed_input.h"
+
+#define GZIP_READ_SIZE (1 << 16)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+ReOS_Input *new_gzip_input(char *);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
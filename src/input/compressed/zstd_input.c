@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <zstd.h>
+#include "zstd_input.h"
+
+typedef struct ZstdStream ZstdStream;
+
+struct ZstdStream
+{
+	FILE *file;
+	ZSTD_DCtx *dctx;
+	ZSTD_inBuffer in;
+	void *in_buf;
+	size_t in_size;
+	int end;
+};
+
+static void *zstd_stream_open(char *path)
+{
+	ZstdStream *s = malloc(sizeof(ZstdStream));
+	s->file = fopen(path, "rb");
+	if (!s->file) {
+		fprintf(stderr, "error: could not open file %s\n", path);
+		exit(1);
+	}
+
+	s->dctx = ZSTD_createDCtx();
+	s->in_size = ZSTD_DStreamInSize();
+	s->in_buf = malloc(s->in_size);
+	s->in.src = s->in_buf;
+	s->in.size = 0;
+	s->in.pos = 0;
+	s->end = 0;
+	return s;
+}
+
+static void zstd_stream_rewind(void *d)
+{
+	ZstdStream *s = (ZstdStream *)d;
+	fseek(s->file, 0, SEEK_SET);
+	ZSTD_DCtx_reset(s->dctx, ZSTD_reset_session_only);
+	s->in.size = 0;
+	s->in.pos = 0;
+	s->end = 0;
+}
+
+static void zstd_stream_close(void *d)
+{
+	ZstdStream *s = (ZstdStream *)d;
+	ZSTD_freeDCtx(s->dctx);
+	free(s->in_buf);
+	fclose(s->file);
+	free(s);
+}
+
+static long zstd_stream_read(void *d, char *out, long size)
+{
+	ZstdStream *s = (ZstdStream *)d;
+	ZSTD_outBuffer out_buf = { out, size, 0 };
+
+	while (out_buf.pos < out_buf.size && !s->end) {
+		if (s->in.pos == s->in.size) {
+			s->in.size = fread(s->in_buf, 1, s->in_size, s->file);
+			s->in.pos = 0;
+		}
+
+		// at the end of the file, keep going only while the decoder is still
+		// flushing buffered output
+		size_t before = out_buf.pos;
+		size_t ret = ZSTD_decompressStream(s->dctx, &out_buf, &s->in);
+		if (ZSTD_isError(ret)) {
+			fprintf(stderr, "error: zstd: %s\n", ZSTD_getErrorName(ret));
+			s->end = 1;
+		}
+		else if (!s->in.size && out_buf.pos == before)
+			s->end = 1;
+	}
+
+	return out_buf.pos;
+}
+
+static CompressedDecoder zstd_decoder = {
+	zstd_stream_open,
+	zstd_stream_read,
+	zstd_stream_rewind,
+	zstd_stream_close
+};
+
+/**
+ * Creates an input that decompresses a zstd file. Free it with
+ * free_compressed_input().
+ */
+ReOS_Input *new_zstd_input(char *path)
+{
+	return new_compressed_input(path, &zstd_decoder);
+}
@@ -0,0 +1,16 @@
+#ifndef ZSTD_INPUT_H
+#define ZSTD_INPUT_H
+
+#include "compressed_input.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+ReOS_Input *new_zstd_input(char *);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
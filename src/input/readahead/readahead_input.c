@@ -0,0 +1,223 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "readahead_input.h"
+
+/**
+ * \file
+ *
+ * A read-ahead input wraps another input and calls its \c stream_read from a
+ * background thread, filling a ring of \c depth blocks of \c block_size
+ * tokens each while the kernel consumes earlier ones. The kernel gets each
+ * filled block through \c map_read, so blocks are never copied. Any stream
+ * input can be wrapped, and decoding (as in the Unicode inputs) happens on the
+ * reader thread too.
+ *
+ * Calls into the wrapped input are serialized, so \c indexed_read is safe
+ * while the reader thread runs. The wrapped input is not owned by the
+ * wrapper and must outlive it.
+ */
+
+static void *readahead_reader(void *d)
+{
+	ReadaheadInputData *data = (ReadaheadInputData *)d;
+	ReOS_Input *inner = data->inner;
+
+	for (;;) {
+		pthread_mutex_lock(&data->lock);
+		while (data->count == data->depth && !data->stop)
+			pthread_cond_wait(&data->cond, &data->lock);
+
+		if (data->stop) {
+			pthread_mutex_unlock(&data->lock);
+			break;
+		}
+
+		// blocks past the filled ones are only touched by this thread
+		ReadaheadBlock *block = &data->blocks[(data->head + data->count) % data->depth];
+		pthread_mutex_unlock(&data->lock);
+
+		pthread_mutex_lock(&data->inner_lock);
+		int len = inner->stream_read(block->tokens, data->block_size, inner->data);
+		pthread_mutex_unlock(&data->inner_lock);
+
+		pthread_mutex_lock(&data->lock);
+		block->len = len;
+		if (len)
+			data->count++;
+		else
+			data->eof = 1;
+		pthread_cond_broadcast(&data->cond);
+		pthread_mutex_unlock(&data->lock);
+
+		if (!len)
+			break;
+	}
+
+	return 0;
+}
+
+static void readahead_start(ReadaheadInputData *data)
+{
+	data->head = 0;
+	data->count = 0;
+	data->head_pos = 0;
+	data->eof = 0;
+	data->stop = 0;
+
+	if (pthread_create(&data->reader, 0, readahead_reader, data)) {
+		fprintf(stderr, "error: could not start read-ahead thread\n");
+		exit(1);
+	}
+	data->started = 1;
+}
+
+static void readahead_stop(ReadaheadInputData *data)
+{
+	if (data->started) {
+		pthread_mutex_lock(&data->lock);
+		data->stop = 1;
+		pthread_cond_broadcast(&data->cond);
+		pthread_mutex_unlock(&data->lock);
+
+		pthread_join(data->reader, 0);
+		data->started = 0;
+	}
+}
+
+/**
+ * Hands out up to \a size tokens from the head block, first releasing the
+ * head block to the reader thread if it has been handed out entirely.
+ *
+ * \return The number of tokens handed out, or 0 at the end of input
+ */
+static int readahead_next(ReadaheadInputData *data, int size, void **tokens)
+{
+	if (!data->started)
+		readahead_start(data);
+
+	pthread_mutex_lock(&data->lock);
+	if (data->count && data->head_pos == data->blocks[data->head].len) {
+		data->head = (data->head + 1) % data->depth;
+		data->count--;
+		data->head_pos = 0;
+		pthread_cond_broadcast(&data->cond);
+	}
+
+	while (!data->count && !data->eof)
+		pthread_cond_wait(&data->cond, &data->lock);
+
+	int len = 0;
+	if (data->count) {
+		ReadaheadBlock *block = &data->blocks[data->head];
+		len = block->len - data->head_pos;
+		if (len > size)
+			len = size;
+
+		*tokens = (char *)block->tokens + data->head_pos * data->inner->token_size;
+		data->head_pos += len;
+	}
+	pthread_mutex_unlock(&data->lock);
+	return len;
+}
+
+/**
+ * Wraps \a inner in a read-ahead input.
+ *
+ * \param inner The input to read from in the background
+ * \param block_size The number of tokens to read per block, or 0 for
+ * READAHEAD_DEFAULT_BLOCK_SIZE
+ * \param depth The number of blocks to read ahead, or 0 for
+ * READAHEAD_DEFAULT_DEPTH
+ */
+ReOS_Input *new_readahead_input(ReOS_Input *inner, int block_size, int depth)
+{
+	ReadaheadInputData *data = malloc(sizeof(ReadaheadInputData));
+	data->inner = inner;
+	data->block_size = block_size > 0 ? block_size : READAHEAD_DEFAULT_BLOCK_SIZE;
+	data->depth = depth > 0 ? depth : READAHEAD_DEFAULT_DEPTH;
+	data->started = 0;
+
+	data->blocks = malloc(sizeof(ReadaheadBlock) * data->depth);
+	int i;
+	for (i = 0; i < data->depth; i++) {
+		data->blocks[i].tokens = malloc(inner->token_size * data->block_size);
+		data->blocks[i].len = 0;
+	}
+
+	pthread_mutex_init(&data->lock, 0);
+	pthread_mutex_init(&data->inner_lock, 0);
+	pthread_cond_init(&data->cond, 0);
+
+	ReOS_Input *input = malloc(sizeof(ReOS_Input));
+	input->indexed_read = input_readahead_indexed_read;
+	input->stream_read = input_readahead_stream_read;
+	input->map_read = input_readahead_map_read;
+	input->span = 0;
+	input->seek = inner->seek ? input_readahead_seek : 0;
+	input->token_size = inner->token_size;
+	input->buffer_size = data->block_size;
+	input->free_token = inner->free_token;
+	input->data = data;
+	return input;
+}
+
+/**
+ * Stops the reader thread and frees the wrapper. The wrapped input is not
+ * freed.
+ */
+void free_readahead_input(ReOS_Input *input)
+{
+	if (input) {
+		ReadaheadInputData *data = (ReadaheadInputData *)input->data;
+		readahead_stop(data);
+
+		int i;
+		for (i = 0; i < data->depth; i++)
+			free(data->blocks[i].tokens);
+		free(data->blocks);
+
+		pthread_mutex_destroy(&data->lock);
+		pthread_mutex_destroy(&data->inner_lock);
+		pthread_cond_destroy(&data->cond);
+		free(data);
+		free(input);
+	}
+}
+
+int input_readahead_map_read(void **buf, int size, void *d)
+{
+	return readahead_next((ReadaheadInputData *)d, size, buf);
+}
+
+int input_readahead_stream_read(void *buf, int size, void *d)
+{
+	ReadaheadInputData *data = (ReadaheadInputData *)d;
+
+	void *tokens;
+	int len = readahead_next(data, size, &tokens);
+	if (len)
+		memcpy(buf, tokens, len * data->inner->token_size);
+	return len;
+}
+
+int input_readahead_indexed_read(void *buf, int size, long index, void *d)
+{
+	ReadaheadInputData *data = (ReadaheadInputData *)d;
+
+	pthread_mutex_lock(&data->inner_lock);
+	int len = data->inner->indexed_read(buf, size, index, data->inner->data);
+	pthread_mutex_unlock(&data->inner_lock);
+	return len;
+}
+
+/**
+ * Discards everything read ahead and seeks the wrapped input. Reading
+ * resumes from \a index on the next read.
+ */
+void input_readahead_seek(long index, void *d)
+{
+	ReadaheadInputData *data = (ReadaheadInputData *)d;
+	readahead_stop(data);
+	data->inner->seek(index, data->inner->data);
+}
@@ -0,0 +1,59 @@
+#ifndef READAHEAD_INPUT_H
+#define READAHEAD_INPUT_H
+
+#include <pthread.h>
+#include "reos_types.h"
+
+#define READAHEAD_DEFAULT_BLOCK_SIZE (1 << 16)
+#define READAHEAD_DEFAULT_DEPTH 4
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct ReadaheadBlock ReadaheadBlock;
+typedef struct ReadaheadInputData ReadaheadInputData;
+
+struct ReadaheadBlock
+{
+	void *tokens;
+	int len;
+};
+
+/**
+ * The blocks form a ring. Starting at \c head, \c count of them are filled,
+ * and the first of those may be lent to the token buffer. The reader thread
+ * fills the block after the last filled one whenever there is room.
+ */
+struct ReadaheadInputData
+{
+	ReOS_Input *inner;
+	int block_size;
+	int depth;
+	ReadaheadBlock *blocks;
+
+	int head;
+	int count;
+	int head_pos; //!< Tokens of the head block already handed out
+	int eof;
+	int stop;
+	int started;
+
+	pthread_t reader;
+	pthread_mutex_t lock; //!< Protects the ring
+	pthread_mutex_t inner_lock; //!< Serializes calls into \c inner
+	pthread_cond_t cond;
+};
+
+ReOS_Input *new_readahead_input(ReOS_Input *, int, int);
+void free_readahead_input(ReOS_Input *);
+int input_readahead_map_read(void **, int, void *);
+int input_readahead_stream_read(void *, int, void *);
+int input_readahead_indexed_read(void *, int, long, void *);
+void input_readahead_seek(long, void *);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,19 +1,93 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "unicode_input.h"
 #include "unicode/ubrk.h"
+#include "unicode/ucnv.h"
 #include "unicode/ustdio.h"
 
+/**
+ * \file
+ *
+ * Unicode inputs decode their source one code point at a time, so the native
+ * offset of code point \c n can't be computed; it can only be found by
+ * decoding every code point before it. To keep indexed reads (capture
+ * reconstruction and backreferences) from rescanning the input from the
+ * beginning, each input keeps a UnicodeCheckpoints table, filled in as the
+ * stream is read. An indexed read seeks to the nearest checkpoint at or before
+ * its index and decodes at most UNICODE_CHECKPOINT_INTERVAL code points from
+ * there.
+ *
+ * Seeking to a checkpoint resets the codepage converter, so file checkpoints
+ * are only exact for stateless codepages, such as UTF-8 or ISO-8859-1.
+ */
+
+/**
+ * Keep at least this many undecoded bytes in a UnicodeFileCursor's window, so
+ * that no character straddles the end of it.
+ */
+#define UNICODE_FILE_MIN_LOOKAHEAD 16
+
+static void checkpoints_init(UnicodeCheckpoints *c)
+{
+	c->max_len = 16;
+	c->offsets = malloc(sizeof(long) * c->max_len);
+
+	// code point 0 is always at native offset 0
+	c->offsets[0] = 0;
+	c->len = 1;
+}
+
+static void checkpoints_free(UnicodeCheckpoints *c)
+{
+	free(c->offsets);
+}
+
+/**
+ * Records \a offset as the native offset of code point \a pos, if \a pos is
+ * the next checkpoint missing from the table.
+ */
+static void checkpoints_record(UnicodeCheckpoints *c, long pos, long offset)
+{
+	if (pos % UNICODE_CHECKPOINT_INTERVAL == 0
+			&& pos / UNICODE_CHECKPOINT_INTERVAL == c->len) {
+		if (c->len == c->max_len) {
+			c->max_len *= 2;
+			c->offsets = realloc(c->offsets, sizeof(long) * c->max_len);
+		}
+		c->offsets[c->len++] = offset;
+	}
+}
+
+/**
+ * Returns the native offset of the last recorded checkpoint at or before code
+ * point \a index, and stores that checkpoint's code point index in \a pos.
+ */
+static long checkpoints_find(UnicodeCheckpoints *c, long index, long *pos)
+{
+	long i = index / UNICODE_CHECKPOINT_INTERVAL;
+	if (i >= c->len)
+		i = c->len - 1;
+
+	*pos = i * UNICODE_CHECKPOINT_INTERVAL;
+	return c->offsets[i];
+}
+
 ReOS_Input *new_unicode_string_input(char *utf8)
 {
 	UnicodeStringInputData *data = malloc(sizeof(UnicodeStringInputData));
 	data->utf8 = utf8;
 	data->status = U_ZERO_ERROR;
 	data->utext = utext_openUTF8(0, utf8, -1, &data->status);
+	data->pos = 0;
+	checkpoints_init(&data->checkpoints);
 
 	ReOS_Input *input = malloc(sizeof(ReOS_Input));
 	input->indexed_read = input_unicode_string_indexed_read;
 	input->stream_read = input_unicode_string_stream_read;
+	input->map_read = 0;
+	input->span = 0;
+	input->seek = input_unicode_string_seek;
 	input->token_size = sizeof(UChar32);
 	input->buffer_size = 1024;
 	input->free_token = 0;
@@ -24,8 +98,10 @@ ReOS_Input *new_unicode_string_input(char *utf8)
 void free_unicode_string_input(ReOS_Input *input)
 {
 	if (input) {
-		utext_close(((UnicodeStringInputData *)input->data)->utext);
-		free(input->data);
+		UnicodeStringInputData *data = (UnicodeStringInputData *)input->data;
+		utext_close(data->utext);
+		checkpoints_free(&data->checkpoints);
+		free(data);
 		free(input);
 	}
 }
@@ -33,23 +109,55 @@ void free_unicode_string_input(ReOS_Input *input)
 int input_unicode_string_indexed_read(void *buf, int size, long index, void *d)
 {
 	UnicodeStringInputData *data = (UnicodeStringInputData *)d;
-	UTEXT_SETNATIVEINDEX(data->utext, 0);
 
-	long i;
-	for (i = 0; i < index; i++) {
+	// the UText is shared with input_unicode_string_stream_read(), so put it
+	// back where we found it when we're done
+	int64_t stream_offset = UTEXT_GETNATIVEINDEX(data->utext);
+
+	long pos;
+	UTEXT_SETNATIVEINDEX(data->utext, checkpoints_find(&data->checkpoints, index, &pos));
+
+	for (; pos < index; pos++) {
+		checkpoints_record(&data->checkpoints, pos, UTEXT_GETNATIVEINDEX(data->utext));
 		if (UTEXT_NEXT32(data->utext) == U_SENTINEL)
 			break;
 	}
 
+	long i;
 	for (i = 0; i < size; i++) {
 		UChar32 next = UTEXT_NEXT32(data->utext);
 		if (next == U_SENTINEL)
 			break;
 		((UChar32 *)buf)[i] = next;
 	}
+
+	UTEXT_SETNATIVEINDEX(data->utext, stream_offset);
 	return i;
 }
 
+/**
+ * Moves the stream to code point \a index. The UText only has to be walked
+ * from the nearest checkpoint, or from the current position if that's closer.
+ */
+void input_unicode_string_seek(long index, void *d)
+{
+	UnicodeStringInputData *data = (UnicodeStringInputData *)d;
+
+	long pos;
+	long offset = checkpoints_find(&data->checkpoints, index, &pos);
+	if (index < data->pos || pos > data->pos)
+		UTEXT_SETNATIVEINDEX(data->utext, offset);
+	else
+		pos = data->pos;
+
+	for (; pos < index; pos++) {
+		checkpoints_record(&data->checkpoints, pos, UTEXT_GETNATIVEINDEX(data->utext));
+		if (UTEXT_NEXT32(data->utext) == U_SENTINEL)
+			break;
+	}
+	data->pos = pos;
+}
+
 int input_unicode_string_stream_read(void *buf, int size, void *d)
 {
 	UnicodeStringInputData *data = (UnicodeStringInputData *)d;
@@ -57,30 +165,106 @@ int input_unicode_string_stream_read(void *buf, int size, void *d)
 	int i;
 	UChar32 next;
 	for (i = 0; i < size; i++) {
+		checkpoints_record(&data->checkpoints, data->pos, UTEXT_GETNATIVEINDEX(data->utext));
 		next = UTEXT_NEXT32(data->utext);
 		if (next == U_SENTINEL)
 			break;
 		((UChar32 *)buf)[i] = next;
+		data->pos++;
 	}
 	return i;
 }
 
+static void unicode_file_cursor_open(UnicodeFileCursor *cur, char *path, char *codepage)
+{
+	cur->file = fopen(path, "rb");
+	if (!cur->file) {
+		fprintf(stderr, "error: could not open file %s\n", path);
+		exit(1);
+	}
+
+	UErrorCode status = U_ZERO_ERROR;
+	cur->conv = ucnv_open(codepage, &status);
+	if (U_FAILURE(status)) {
+		fprintf(stderr, "error: could not open codepage %s: %s\n", codepage, u_errorName(status));
+		exit(1);
+	}
+
+	cur->window_offset = 0;
+	cur->window_pos = 0;
+	cur->window_len = 0;
+	cur->pos = 0;
+}
+
+static void unicode_file_cursor_close(UnicodeFileCursor *cur)
+{
+	ucnv_close(cur->conv);
+	fclose(cur->file);
+}
+
+/**
+ * Moves \a cur to native \a offset, which must be the offset of code point \a
+ * pos.
+ */
+static void unicode_file_cursor_seek(UnicodeFileCursor *cur, long offset, long pos)
+{
+	fseek(cur->file, offset, SEEK_SET);
+	ucnv_resetToUnicode(cur->conv);
+	cur->window_offset = offset;
+	cur->window_pos = 0;
+	cur->window_len = 0;
+	cur->pos = pos;
+}
+
+#define unicode_file_cursor_offset(cur) ((cur)->window_offset + (cur)->window_pos)
+
+/**
+ * Decodes the code point at \a cur and advances past it.
+ *
+ * \return The decoded code point, or U_SENTINEL at the end of the file or on
+ * an unrecoverable conversion error
+ */
+static UChar32 unicode_file_cursor_next(UnicodeFileCursor *cur)
+{
+	if (cur->window_len - cur->window_pos < UNICODE_FILE_MIN_LOOKAHEAD && !feof(cur->file)) {
+		int remaining = cur->window_len - cur->window_pos;
+		memmove(cur->window, cur->window + cur->window_pos, remaining);
+		cur->window_offset += cur->window_pos;
+		cur->window_pos = 0;
+		cur->window_len = remaining + fread(cur->window + remaining, 1,
+											UNICODE_FILE_WINDOW_SIZE - remaining, cur->file);
+	}
+
+	if (cur->window_pos == cur->window_len)
+		return U_SENTINEL;
+
+	UErrorCode status = U_ZERO_ERROR;
+	const char *source = cur->window + cur->window_pos;
+	UChar32 next = ucnv_getNextUChar(cur->conv, &source, cur->window + cur->window_len, &status);
+	cur->window_pos = source - cur->window;
+	if (U_FAILURE(status))
+		return U_SENTINEL;
+
+	cur->pos++;
+	return next;
+}
+
 ReOS_Input *new_unicode_file_input(char *path, char *codepage)
 {
 	ReOS_Input *input = malloc(sizeof(ReOS_Input));
 	input->indexed_read = input_unicode_file_indexed_read;
 	input->stream_read = input_unicode_file_stream_read;
+	input->map_read = 0;
+	input->span = 0;
+	input->seek = input_unicode_file_seek;
 	input->token_size = sizeof(UChar32);
 	input->buffer_size = 1024;
 	input->free_token = 0;
 
 	UnicodeFileInputData *data = malloc(sizeof(UnicodeFileInputData));
-	data->status = U_ZERO_ERROR;
-	data->file = u_fopen(path, "r", NULL, codepage);
-	if (!data->file) {
-		fprintf(stderr, "error: could not open file %s", path);
-		exit(1);
-	}
+	unicode_file_cursor_open(&data->stream, path, codepage);
+	unicode_file_cursor_open(&data->indexed, path, codepage);
+	checkpoints_init(&data->checkpoints);
 
 	input->data = data;
 	return input;
@@ -89,8 +273,11 @@ ReOS_Input *new_unicode_file_input(char *path, char *codepage)
 void free_unicode_file_input(ReOS_Input *input)
 {
 	if (input) {
-		u_fclose(((UnicodeFileInputData *)input->data)->file);
-		free(input->data);
+		UnicodeFileInputData *data = (UnicodeFileInputData *)input->data;
+		unicode_file_cursor_close(&data->stream);
+		unicode_file_cursor_close(&data->indexed);
+		checkpoints_free(&data->checkpoints);
+		free(data);
 		free(input);
 	}
 }
@@ -98,32 +285,53 @@ void free_unicode_file_input(ReOS_Input *input)
 int input_unicode_file_stream_read(void *buf, int size, void *d)
 {
 	UnicodeFileInputData *data = (UnicodeFileInputData *)d;
+	UnicodeFileCursor *cur = &data->stream;
 
 	int i;
 	for (i = 0; i < size; i++) {
-		UChar32 next = u_fgetcx(data->file);
-		if (next == U_SENTINEL || next == U_EOF)
+		checkpoints_record(&data->checkpoints, cur->pos, unicode_file_cursor_offset(cur));
+		UChar32 next = unicode_file_cursor_next(cur);
+		if (next == U_SENTINEL)
 			break;
 		((UChar32 *)buf)[i] = next;
 	}
 	return i;
 }
 
-int input_unicode_file_indexed_read(void *buf, int size, long index, void *d)
+/**
+ * Moves \a cur to code point \a index, decoding from the nearest checkpoint,
+ * or from the cursor's current position if that's closer.
+ */
+static void unicode_file_cursor_move(UnicodeFileInputData *data, UnicodeFileCursor *cur, long index)
 {
-	UnicodeFileInputData *data = (UnicodeFileInputData *)d;
-	u_frewind(data->file);
+	long pos;
+	long offset = checkpoints_find(&data->checkpoints, index, &pos);
+	if (index < cur->pos || pos > cur->pos)
+		unicode_file_cursor_seek(cur, offset, pos);
 
-	long i;
-	for (i = 0; i < index; i++) {
-		if (u_fgetcx(data->file) == U_EOF)
+	while (cur->pos < index) {
+		checkpoints_record(&data->checkpoints, cur->pos, unicode_file_cursor_offset(cur));
+		if (unicode_file_cursor_next(cur) == U_SENTINEL)
 			break;
 	}
+}
 
-	UChar32 next;
+void input_unicode_file_seek(long index, void *d)
+{
+	UnicodeFileInputData *data = (UnicodeFileInputData *)d;
+	unicode_file_cursor_move(data, &data->stream, index);
+}
+
+int input_unicode_file_indexed_read(void *buf, int size, long index, void *d)
+{
+	UnicodeFileInputData *data = (UnicodeFileInputData *)d;
+	UnicodeFileCursor *cur = &data->indexed;
+	unicode_file_cursor_move(data, cur, index);
+
+	long i;
 	for (i = 0; i < size; i++) {
-		next = u_fgetcx(data->file);
-		if (next == U_EOF)
+		UChar32 next = unicode_file_cursor_next(cur);
+		if (next == U_SENTINEL)
 			break;
 		((UChar32 *)buf)[i] = next;
 	}
@@ -1,38 +1,84 @@
 #ifndef UNICODE_INPUT_H
 #define UNICODE_INPUT_H
 
+#include <stdio.h>
 #include "reos_types.h"
 
+/**
+ * Number of code points between two entries of a UnicodeCheckpoints table.
+ * An indexed read never has to decode more than this many code points before
+ * reaching the requested index.
+ */
+#define UNICODE_CHECKPOINT_INTERVAL 1024
+
+/**
+ * Size, in bytes, of the window UnicodeFileCursor decodes from.
+ */
+#define UNICODE_FILE_WINDOW_SIZE 4096
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+typedef struct UnicodeCheckpoints UnicodeCheckpoints;
+typedef struct UnicodeFileCursor UnicodeFileCursor;
 typedef struct UnicodeStringInputData UnicodeStringInputData;
 typedef struct UnicodeFileInputData UnicodeFileInputData;
-struct UFILE;
+struct UConverter;
 struct UText;
 
+/**
+ * A sparse map from code point index to native offset. Entry \c i holds the
+ * native offset of code point <tt>i * UNICODE_CHECKPOINT_INTERVAL</tt>.
+ */
+struct UnicodeCheckpoints
+{
+	long *offsets;
+	long len;
+	long max_len;
+};
+
+struct UnicodeFileCursor
+{
+	FILE *file;
+	struct UConverter *conv;
+	char window[UNICODE_FILE_WINDOW_SIZE];
+	long window_offset; //!< File offset of window[0]
+	int window_pos;
+	int window_len;
+	long pos; //!< Code point index of the next character to be decoded
+};
+
 struct UnicodeStringInputData
 {
 	char *utf8;
 	struct UText *utext;
 	int status;
+
+	long pos;
+	UnicodeCheckpoints checkpoints;
 };
 
+/**
+ * Stream and indexed reads each decode through their own cursor, so that
+ * reconstructing a capture never disturbs the position of the stream.
+ */
 struct UnicodeFileInputData
 {
-	char *utf8;
-	struct UFILE *file;
-	int status;
+	UnicodeFileCursor stream;
+	UnicodeFileCursor indexed;
+	UnicodeCheckpoints checkpoints;
 };
 
 ReOS_Input *new_unicode_string_input(char *);
 void free_unicode_string_input(ReOS_Input *);
+void input_unicode_string_seek(long, void *);
 int input_unicode_string_stream_read(void *, int, void *);
 int input_unicode_string_indexed_read(void *, int, long, void *);
 
 ReOS_Input *new_unicode_file_input(char *, char *);
 void free_unicode_file_input(ReOS_Input *);
+void input_unicode_file_seek(long, void *);
 int input_unicode_file_stream_read(void *, int, void *);
 int input_unicode_file_indexed_read(void *, int, long, void *);
 
@@ -3,20 +3,29 @@
 #include <stdlib.h>
 #include "ascii_inst.h"
 #include "reos_kernel.h"
+#include "reos_stdlib.h"
 #include "standard_inst.h"
 
 ReOS_Inst *ascii_inst_factory(int opcode)
 {
 	if (opcode == OpAsciiChar || opcode == OpAsciiRange) {
-		ReOS_Inst *inst = malloc(sizeof(ReOS_Inst));
+		ReOS_Inst *inst = reos_malloc(ReOS_MemPattern, sizeof(ReOS_Inst));
 		inst->opcode = opcode;
-		inst->args = malloc(sizeof(AsciiInstArgs));
+		inst->args = reos_malloc(ReOS_MemPattern, sizeof(AsciiInstArgs));
 		return inst;
 	}
 	else
 		return standard_inst_factory(opcode);
 }
 
+int ascii_inst_args_size(ReOS_Inst *inst)
+{
+	if (inst->opcode == OpAsciiChar || inst->opcode == OpAsciiRange)
+		return sizeof(AsciiInstArgs);
+	else
+		return standard_inst_args_size(inst);
+}
+
 void print_ascii_inst(ReOS_Inst *inst)
 {
 	AsciiInstArgs *args = inst->args;
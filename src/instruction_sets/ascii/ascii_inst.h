@@ -2,6 +2,14 @@
 #define ASCII_INST_H
 
 #include "reos_types.h"
+#include "standard_inst.h"
+
+/**
+ * Names the ascii instruction set, with the standard one it extends, for
+ * pattern images. Bump it whenever OpAsciiChar, OpAsciiRange or their args
+ * change.
+ */
+#define ASCII_INST_SET "ascii/1+" STANDARD_INST_SET
 
 #ifdef __cplusplus
 extern "C" {
@@ -22,6 +30,7 @@ struct AsciiInstArgs
 };
 
 ReOS_Inst *ascii_inst_factory(int);
+int ascii_inst_args_size(ReOS_Inst *);
 int ascii_test_backref(ReOS_Kernel *, void *, void *);
 int execute_ascii_inst(ReOS_Kernel *, ReOS_Thread *, ReOS_Inst *, int);
 void print_ascii_inst(ReOS_Inst *);
@@ -1,7 +1,9 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "reos_kernel.h"
+#include "reos_stdlib.h"
 #include "standard_inst.h"
 
 /**
@@ -24,7 +26,7 @@
 
 ReOS_Inst *standard_inst_factory(int opcode)
 {
-	ReOS_Inst *inst = malloc(sizeof(ReOS_Inst));
+	ReOS_Inst *inst = reos_malloc(ReOS_MemPattern, sizeof(ReOS_Inst));
 	inst->opcode = opcode;
 
 	switch (opcode) {
@@ -37,7 +39,7 @@ ReOS_Inst *standard_inst_factory(int opcode)
 	case OpBranch:
 	case OpNegBranch:
 	case OpRecurse:
-		inst->args = malloc(sizeof(StandardInstArgs));
+		inst->args = reos_malloc(ReOS_MemPattern, sizeof(StandardInstArgs));
 		break;
 
 	case OpAny:
@@ -46,6 +48,11 @@ ReOS_Inst *standard_inst_factory(int opcode)
 		inst->args = 0;
 		break;
 
+	// its StandardClosure is attached by standard_pattern_compute_closures
+	case OpClosure:
+		inst->args = 0;
+		break;
+
 	default:
 		fprintf(stderr, "error: unrecognized standard opcode %d\n", opcode);
 		exit(0);
@@ -56,20 +63,17 @@ ReOS_Inst *standard_inst_factory(int opcode)
 }
 
 /**
- * The following is no longer correct:
- * Since more than one capture range can correspond to \a capture_num, this
- * function tries to match all of them and then decides how to proceed to the
- * next input token after all have been tried. There can be one or more of three
- * possible outcomes:
- * -# If any of the capture ranges have further tokens to match, the buffer
- * indexes are updated and a clone of \a thread is appended to \c
- * next_thread_list.
- * -# If any of the capture ranges have matched all their tokens, the buffer
- * is deleted and a clone of \a thread is appended to \c next_thread_list.
- * -# In the special case of a zero-length range, the buffer is deleted and a
- * clone of \a thread is appended to \c current_thread_list.
- * \todo Fix this documentation, since there is now only one capture range per
- * capture_num.
+ * Matches one input token against the next token of the interval captured by
+ * \a capture_num. \c thread->backref_index counts the tokens matched so far;
+ * while more remain, the thread is pushed onto \c next_thread_list to wait
+ * for the next input token.
+ *
+ * The referenced tokens are read from the token buffer's history when the
+ * start of the interval is still in it. The distance between the input
+ * position and the referenced token stays constant while matching, so if the
+ * first referenced token is available, all of them will be. Otherwise, the
+ * interval is copied into a ReOS_BackrefBuffer with the input's \c
+ * indexed_read when matching begins.
  */
 static int execute_backtrack(ReOS_Kernel *k, ReOS_Thread *thread, int capture_num)
 {
@@ -79,22 +83,27 @@ static int execute_backtrack(ReOS_Kernel *k, ReOS_Thread *thread, int capture_nu
 	if (cap->start == -1 || cap->end == -1)
 		return ReOS_InstRetDrop;
 
-	// if we've just started matching against this backreference, we have to
-	// create a buffer to hold the tokens to test and state
-	if (!thread->backref_buffer)
-		thread->backref_buffer = new_reos_backrefbuffer(cap, k->token_buf->input);
-
 	// zero length ranges automatically succeed
-	if (thread->backref_buffer->length == 0) {
-		free_reos_backrefbuffer(thread->backref_buffer);
-		thread->backref_buffer = 0;
+	long length = cap->end - cap->start;
+	if (length == 0)
 		return ReOS_InstRetStep;
+
+	void *ref_token = 0;
+	if (!thread->backref_buffer)
+		ref_token = reos_tokenbuffer_history_get(k->token_buf, cap->start + thread->backref_index, k->sp);
+
+	if (!ref_token) {
+		// if we've just started matching against this backreference and the
+		// history can't serve it, we have to copy the tokens to test
+		if (!thread->backref_buffer)
+			thread->backref_buffer = new_reos_backrefbuffer(cap, k->token_buf->input);
+		ref_token = &((char *)thread->backref_buffer->tokens)[thread->backref_index * k->token_buf->token_size];
 	}
-	// otherwise test the token at the current position of this buffer against
-	// the input token
-	else if (k->test_backref(k, k->current_token, &((char *)thread->backref_buffer->tokens)[(thread->backref_buffer->index++) * k->token_buf->input->token_size])) {
+
+	// test the referenced token against the input token
+	if (k->test_backref(k, k->current_token, ref_token)) {
 		// there are more tokens to match
-		if (thread->backref_buffer->index < thread->backref_buffer->length) {
+		if (++thread->backref_index < length) {
 			reos_kernel_push_next_threadlist(k, thread, 1);
 			return 0;
 		}
@@ -102,6 +111,7 @@ static int execute_backtrack(ReOS_Kernel *k, ReOS_Thread *thread, int capture_nu
 		else {
 			free_reos_backrefbuffer(thread->backref_buffer);
 			thread->backref_buffer = 0;
+			thread->backref_index = 0;
 			return ReOS_InstRetConsume;
 		}
 	}
@@ -160,12 +170,12 @@ static int execute_branch(ReOS_Kernel *k, ReOS_Thread *thread, int jmp_pc,
 		reos_compoundlist_unshare(thread->deps);
 	}
 
-	ReOS_Thread *branch_thread = reos_thread_clone(thread);
+	ReOS_Thread *branch_thread = reos_kernel_clone_thread(k, thread);
 	branch_thread->pc = branch_pc;
 	thread->pc = jmp_pc;
 
 	if (!thread->ref) {
-		thread->ref = new_reos_branch(0);
+		thread->ref = reos_kernel_new_branch(k, 0);
 		reos_branch_strong_ref(thread->ref);
 	}
 	
@@ -175,14 +185,14 @@ static int execute_branch(ReOS_Kernel *k, ReOS_Thread *thread, int jmp_pc,
 	if (branch_thread->ref)
 		reos_branch_strong_deref(branch_thread->ref);
 
-	branch_thread->ref = new_reos_branch(negated);
+	branch_thread->ref = reos_kernel_new_branch(k, negated);
 	reos_branch_strong_ref(branch_thread->ref);
 
 	reos_compoundlist_push_tail(thread->deps, branch_thread->ref);
 	reos_branch_strong_ref(branch_thread->ref);
 
-	reos_threadlist_push_head(k->state.current_thread_list, thread, 0);
-	reos_threadlist_push_head(k->state.current_thread_list, branch_thread, 0);
+	reos_kernel_push_current_threadlist_head(k, thread, 0);
+	reos_kernel_push_current_threadlist_head(k, branch_thread, 0);
 
 	return 0;
 }
@@ -261,6 +271,97 @@ static int check_match_list(ReOS_CompoundList *deps, int tabs)
 	}
 }
 
+// the nodes of a closure's code
+enum
+{
+	ClosureFork, //!< Followed by the first, middle and last targets and the left side's length
+	ClosureTarget //!< Followed by the target's index
+};
+
+#define CLOSURE_FORK_LEN 5
+
+static int closure_targets_free(ReOS_ThreadList *threadlist, StandardClosure *closure,
+								int first, int last)
+{
+	int *targets = standard_closure_targets(closure);
+	int i;
+	for (i = first; i < last; i++) {
+		if (!reos_threadlist_has_pc(threadlist, targets[i]))
+			return 1;
+	}
+	return 0;
+}
+
+/**
+ * Runs \a thread through a closure's code from \a at, collecting the threads
+ * that reach targets in \a threads in priority order. Sides of forks whose
+ * targets other threads have already taken this token are skipped, rather
+ * than cloning threads only for the thread list to turn them away.
+ */
+static void run_closure(ReOS_Kernel *k, StandardClosure *closure, int at, ReOS_Thread *thread,
+						ReOS_Thread **threads, int *num_threads)
+{
+	ReOS_ThreadList *threadlist = k->state.current_thread_list;
+	int *code = standard_closure_code(closure);
+
+	while (1) {
+		switch (code[at]) {
+		case ClosureFork:
+		{
+			int left = closure_targets_free(threadlist, closure, code[at+1], code[at+2]);
+			int right = closure_targets_free(threadlist, closure, code[at+2], code[at+3]);
+			int right_at = at + CLOSURE_FORK_LEN + code[at+4];
+			if (left && right) {
+				ReOS_Thread *clone = reos_kernel_clone_thread(k, thread);
+				run_closure(k, closure, at + CLOSURE_FORK_LEN, thread, threads, num_threads);
+				thread = clone;
+				at = right_at;
+			}
+			else if (left)
+				at += CLOSURE_FORK_LEN;
+			else if (right)
+				at = right_at;
+			else {
+				free_reos_thread(thread);
+				return;
+			}
+			break;
+		}
+
+		case ClosureTarget:
+			thread->pc = standard_closure_targets(closure)[code[at+1]];
+			threads[(*num_threads)++] = thread;
+			return;
+		}
+	}
+}
+
+/**
+ * Sends a thread on to every target of its closure, in place of the jmps
+ * and splits between them.
+ */
+static int execute_closure(ReOS_Kernel *k, ReOS_Thread *thread, StandardClosure *closure, int ops)
+{
+	// finding every capture means revisiting pcs the closure has passed, so
+	// run the instruction it replaced instead
+	if (k->state.current_thread_list->backtrack_captures) {
+		ReOS_Inst inst = {closure->opcode, &closure->args};
+		return execute_standard_inst(k, thread, &inst, ops);
+	}
+
+	if (!closure->num_targets)
+		return ReOS_InstRetDrop;
+
+	ReOS_Thread *threads[STANDARD_CLOSURE_MAX_TARGETS];
+	int num_threads = 0;
+	run_closure(k, closure, 0, thread, threads, &num_threads);
+
+	// the head of the thread list runs next, so push the lowest priority first
+	while (num_threads--)
+		reos_kernel_push_current_threadlist_head(k, threads[num_threads], 0);
+	return 0;
+}
+
 int execute_standard_inst(ReOS_Kernel *k, ReOS_Thread *thread, ReOS_Inst *inst, int ops)
 {
 	StandardInstArgs *args = (StandardInstArgs *)inst->args;
@@ -300,7 +401,7 @@ int execute_standard_inst(ReOS_Kernel *k, ReOS_Thread *thread, ReOS_Inst *inst,
 
 	case OpJmp:
 		thread->pc = args->x;
-		reos_threadlist_push_head(k->state.current_thread_list, thread, 0);
+		reos_kernel_push_current_threadlist_head(k, thread, 0);
 		return 0;
 
 	case OpSplit:
@@ -308,21 +409,21 @@ int execute_standard_inst(ReOS_Kernel *k, ReOS_Thread *thread, ReOS_Inst *inst,
 		thread->pc = args->x;
 
 		// clone the thread
-		ReOS_Thread *split = reos_thread_clone(thread);
+		ReOS_Thread *split = reos_kernel_clone_thread(k, thread);
 		split->pc = args->y;
 
 		// reuse the original and stick both back on the current thread list
-		reos_threadlist_push_head(k->state.current_thread_list, split, 0);
-		reos_threadlist_push_head(k->state.current_thread_list, thread, 0);
+		reos_kernel_push_current_threadlist_head(k, split, 0);
+		reos_kernel_push_current_threadlist_head(k, thread, 0);
 		return 0;
 	}
 
 	case OpSaveStart:
-		reos_captureset_save_start(&thread->capture_set, args->x, k->sp);
+		reos_kernel_save_capture(k, thread, args->x, 0);
 		return ReOS_InstRetStep;
 
 	case OpSaveEnd:
-		reos_captureset_save_end(&thread->capture_set, args->x, k->sp);
+		reos_kernel_save_capture(k, thread, args->x, 1);
 		return ReOS_InstRetStep;
 
 	case OpBacktrack:
@@ -346,6 +447,9 @@ int execute_standard_inst(ReOS_Kernel *k, ReOS_Thread *thread, ReOS_Inst *inst,
 	case OpNegBranch:
 		return execute_branch(k, thread, args->y, args->x, 1);
 
+	case OpClosure:
+		return execute_closure(k, thread, inst->args, ops);
+
 //	case OpRecurse:
 	//	return ReOS_InstRet
 	}
@@ -354,6 +458,466 @@ int execute_standard_inst(ReOS_Kernel *k, ReOS_Thread *thread, ReOS_Inst *inst,
 	return ReOS_InstRetHalt;
 }
 
+/**
+ * Returns how many consumed tokens a kernel running \a pattern should
+ * remember for backreferences, to be stored in its \c history_size: 0 if the
+ * pattern has none, STANDARD_BACKREF_HISTORY_SIZE otherwise.
+ */
+long standard_pattern_history_size(ReOS_Pattern *pattern)
+{
+	int pc;
+	ReOS_Inst *inst;
+	for (pc = 0; (inst = pattern->get_inst(pattern, pc)); pc++) {
+		if (inst->opcode == OpBacktrack)
+			return STANDARD_BACKREF_HISTORY_SIZE;
+	}
+	return 0;
+}
+
+/**
+ * Returns the size of a standard instruction's args, for writing pattern
+ * images.
+ */
+int standard_inst_args_size(ReOS_Inst *inst)
+{
+	switch (inst->opcode) {
+	case OpClosure:
+	{
+		StandardClosure *closure = inst->args;
+		return sizeof(StandardClosure) + sizeof(int) * (closure->num_targets + closure->code_len);
+	}
+
+	default:
+		return inst->args ? sizeof(StandardInstArgs) : 0;
+	}
+}
+
+/**
+ * Combines the longest match lengths of two alternatives.
+ */
+static long max_length_either(long a, long b)
+{
+	if (a < 0 || b < 0)
+		return a < b ? a : b;
+	return a > b ? a : b;
+}
+
+/**
+ * Returns the most tokens consumed on any path from \a pc to a match.
+ * \a state marks instructions as unvisited (0), on the current path (1) or
+ * finished (2), in which case their result is in \a longest.
+ */
+static long max_length_from(ReOS_Pattern *pattern, int pc, long *longest, char *state)
+{
+	ReOS_Inst *inst = pattern->get_inst(pattern, pc);
+	if (!inst)
+		return 0;
+	if (state[pc] == 1)
+		return REOS_LENGTH_UNBOUNDED;
+	if (state[pc] == 2)
+		return longest[pc];
+
+	state[pc] = 1;
+
+	long len;
+	StandardInstArgs *args = (StandardInstArgs *)inst->args;
+	switch (inst->opcode) {
+	case OpMatch:
+		len = 0;
+		break;
+
+	case OpJmp:
+		len = max_length_from(pattern, args->x, longest, state);
+		break;
+
+	case OpSplit:
+		len = max_length_either(max_length_from(pattern, args->x, longest, state),
+								max_length_from(pattern, args->y, longest, state));
+		break;
+
+	case OpClosure:
+	{
+		StandardClosure *closure = inst->args;
+		int *targets = standard_closure_targets(closure);
+		len = 0;
+		int i;
+		for (i = 0; i < closure->num_targets; i++)
+			len = max_length_either(len, max_length_from(pattern, targets[i], longest, state));
+		break;
+	}
+
+	case OpSaveStart:
+	case OpSaveEnd:
+	case OpStart:
+	case OpEnd:
+		len = max_length_from(pattern, pc + 1, longest, state);
+		break;
+
+	case OpBacktrack:
+	case OpBranch:
+	case OpNegBranch:
+	case OpRecurse:
+		len = REOS_LENGTH_UNKNOWN;
+		break;
+
+	// OpAny, and every opcode of the instruction set the pattern was
+	// compiled with, consumes exactly one token
+	default:
+		len = max_length_from(pattern, pc + 1, longest, state);
+		if (len >= 0)
+			len++;
+		break;
+	}
+
+	state[pc] = 2;
+	longest[pc] = len;
+	return len;
+}
+
+/**
+ * Returns the most tokens any match of \a pattern can span,
+ * REOS_LENGTH_UNBOUNDED if it has a loop, or REOS_LENGTH_UNKNOWN if it has
+ * backreferences, lookaround or recursion.
+ */
+long standard_pattern_max_length(ReOS_Pattern *pattern)
+{
+	int len;
+	for (len = 0; pattern->get_inst(pattern, len); len++);
+
+	long *longest = malloc(sizeof(long) * (len + 1));
+	char *state = calloc(len + 1, sizeof(char));
+	long max_length = max_length_from(pattern, 0, longest, state);
+
+	free(longest);
+	free(state);
+	return max_length;
+}
+
+/**
+ * Returns one more than the highest capture number \a pattern saves.
+ */
+static int standard_pattern_num_captures(ReOS_Pattern *pattern)
+{
+	int num_captures = 0;
+	int pc;
+	ReOS_Inst *inst;
+	for (pc = 0; (inst = pattern->get_inst(pattern, pc)); pc++) {
+		StandardInstArgs *args = (StandardInstArgs *)inst->args;
+		switch (inst->opcode) {
+		case OpSaveStart:
+		case OpSaveEnd:
+			if (args->x >= num_captures)
+				num_captures = args->x + 1;
+			break;
+		}
+	}
+
+	return num_captures;
+}
+
+/**
+ * Fills in what the standard analyses find out about \a pattern, to be
+ * saved with it in an image.
+ */
+void standard_pattern_info(ReOS_Pattern *pattern, ReOS_PatternInfo *info)
+{
+	info->num_captures = standard_pattern_num_captures(pattern);
+	info->history_size = standard_pattern_history_size(pattern);
+	info->max_length = standard_pattern_max_length(pattern);
+	info->hash = 0;
+}
+
+// whether a thread at \a pc can get to pc+1 without a jump
+static int falls_through(ReOS_Inst **insts, int pc)
+{
+	switch (insts[pc]->opcode) {
+	case OpMatch:
+	case OpJmp:
+	case OpSplit:
+	case OpBranch:
+	case OpNegBranch:
+		return 0;
+
+	default:
+		return 1;
+	}
+}
+
+/**
+ * Counts the ways threads get to each pc: jumps, splits and branches to it,
+ * the instruction before it going on to it, and for pc 0, being started.
+ * Threads that get to a pc more than one way meet there.
+ */
+static int *count_preds(ReOS_Inst **insts, int num_insts)
+{
+	int *preds = calloc(num_insts + 1, sizeof(int));
+	preds[0]++;
+
+	int pc;
+	for (pc = 0; pc < num_insts; pc++) {
+		StandardInstArgs *args = (StandardInstArgs *)insts[pc]->args;
+		switch (insts[pc]->opcode) {
+		case OpSplit:
+		case OpBranch:
+		case OpNegBranch:
+			preds[args->y]++;
+			// fall through
+
+		case OpJmp:
+			preds[args->x]++;
+			break;
+
+		default:
+			if (falls_through(insts, pc))
+				preds[pc+1]++;
+			break;
+		}
+	}
+	return preds;
+}
+
+typedef struct ClosureBuilder ClosureBuilder;
+
+struct ClosureBuilder
+{
+	ReOS_Pattern *pattern;
+	int num_insts;
+	char *visited;
+	int *preds;
+	int entry;
+
+	int targets[STANDARD_CLOSURE_MAX_TARGETS];
+	int num_targets;
+	int too_many;
+
+	// the jmps and splits the closure stands for
+	int num_moves;
+
+	int *code;
+	int code_len;
+	int max_code_len;
+};
+
+static void emit_closure_code(ClosureBuilder *b, int node, int arg)
+{
+	if (b->code_len + CLOSURE_FORK_LEN > b->max_code_len) {
+		b->max_code_len = 2 * b->max_code_len + 16;
+		b->code = realloc(b->code, sizeof(int) * b->max_code_len);
+	}
+	b->code[b->code_len++] = node;
+	b->code[b->code_len++] = arg;
+}
+
+// takes \a pc for the closure, as pushing a thread there takes it on a thread list
+static int claim_closure_pc(ClosureBuilder *b, int pc)
+{
+	if (pc >= b->num_insts || b->visited[pc])
+		return 0;
+	b->visited[pc] = 1;
+	return 1;
+}
+
+/**
+ * Follows the epsilon moves from \a pc, which has been claimed, adding code
+ * for the forks on the way to each instruction they end at. Like the kernel,
+ * it claims both sides of a split before following the first, and goes
+ * through each pc at most once. Returns the number of targets added; paths
+ * that add none leave no code.
+ *
+ * Jmps and splits other threads can get to too are targets, left for the
+ * kernel to run: a thread already on the list may have taken them, and the
+ * closure would otherwise go past where the kernel drops it.
+ */
+static int add_closure_code(ClosureBuilder *b, int pc)
+{
+	if (b->too_many)
+		return 0;
+
+	ReOS_Inst *inst = b->pattern->get_inst(b->pattern, pc);
+	StandardInstArgs *args = (StandardInstArgs *)inst->args;
+	int start = b->code_len;
+	if (pc == b->entry || b->preds[pc] == 1) {
+		switch (inst->opcode) {
+		case OpJmp:
+			b->num_moves++;
+			return claim_closure_pc(b, args->x) ? add_closure_code(b, args->x) : 0;
+
+		case OpSplit:
+		{
+			b->num_moves++;
+
+			// the middle and last targets and the left side's length are
+			// filled in once they're known
+			emit_closure_code(b, ClosureFork, b->num_targets);
+			b->code_len += CLOSURE_FORK_LEN - 2;
+
+			int claimed_right = claim_closure_pc(b, args->y);
+			int claimed_left = claim_closure_pc(b, args->x);
+
+			int left = claimed_left ? add_closure_code(b, args->x) : 0;
+			int mid = b->num_targets;
+			int left_len = b->code_len - start - CLOSURE_FORK_LEN;
+			int right = claimed_right ? add_closure_code(b, args->y) : 0;
+
+			// a side without targets needs no fork
+			if (!left || !right) {
+				memmove(b->code + start, b->code + start + CLOSURE_FORK_LEN,
+						sizeof(int) * (b->code_len - start - CLOSURE_FORK_LEN));
+				b->code_len -= CLOSURE_FORK_LEN;
+			}
+			else {
+				b->code[start+2] = mid;
+				b->code[start+3] = b->num_targets;
+				b->code[start+4] = left_len;
+			}
+			return left + right;
+		}
+		}
+	}
+
+	if (b->num_targets == STANDARD_CLOSURE_MAX_TARGETS) {
+		b->too_many = 1;
+		return 0;
+	}
+
+	emit_closure_code(b, ClosureTarget, b->num_targets);
+	b->targets[b->num_targets++] = pc;
+	return 1;
+}
+
+/**
+ * Returns the closure of the instruction at \a pc, packed in one block, or 0
+ * if it has too many targets or would save the kernel nothing, standing for
+ * that one instruction only.
+ */
+static StandardClosure *new_closure(ClosureBuilder *b, int pc)
+{
+	memset(b->visited, 0, b->num_insts);
+	b->num_targets = 0;
+	b->too_many = 0;
+	b->num_moves = 0;
+	b->code_len = 0;
+	b->entry = pc;
+	claim_closure_pc(b, pc);
+	add_closure_code(b, pc);
+	if (b->too_many || b->num_moves < 2)
+		return 0;
+
+	size_t size = sizeof(StandardClosure) + sizeof(int) * (b->num_targets + b->code_len);
+	StandardClosure *closure = reos_malloc(ReOS_MemPattern, size);
+
+	ReOS_Inst *inst = b->pattern->get_inst(b->pattern, pc);
+	closure->opcode = inst->opcode;
+	closure->args = *(StandardInstArgs *)inst->args;
+	closure->num_targets = b->num_targets;
+	closure->code_len = b->code_len;
+	memcpy(standard_closure_targets(closure), b->targets, sizeof(int) * b->num_targets);
+	memcpy(standard_closure_code(closure), b->code, sizeof(int) * b->code_len);
+	return closure;
+}
+
+/**
+ * Marks the pcs threads arrive at from outside an epsilon chain: the start,
+ * and the pc after each instruction that steps or consumes.
+ */
+static char *closure_entries(ReOS_Pattern *pattern, int num_insts)
+{
+	char *entries = calloc(num_insts + 1, sizeof(char));
+	entries[0] = 1;
+
+	int pc;
+	for (pc = 0; pc < num_insts; pc++) {
+		switch (pattern->get_inst(pattern, pc)->opcode) {
+		case OpMatch:
+		case OpJmp:
+		case OpSplit:
+			break;
+
+		default:
+			entries[pc + 1] = 1;
+			break;
+		}
+	}
+
+	return entries;
+}
+
+/**
+ * Replaces each jmp or split that threads start from with an OpClosure
+ * holding every instruction the thread would go on to through jmps and
+ * splits. The kernel then goes straight to them, rather than running the
+ * same jmps and splits again for every thread on every token.
+ *
+ * A closure takes pcs in the order the kernel would, and ends at anything
+ * other threads can meet it on (see can_insert_thread() in reos_thread.c):
+ * jmps and splits with other ways in, and saves and assertions, which the
+ * kernel runs after the threads already on the list. Every match is then the
+ * same as without closures. Patterns with
+ * lookahead or backreferences are left alone, and kernels set to find every
+ * capture with REOS_BACKTRACK_MATCHING run the replaced instructions
+ * instead.
+ *
+ * \param pattern A pattern compiled to standard instructions and
+ * instructions that each go on to the next pc
+ */
+void standard_pattern_compute_closures(ReOS_Pattern *pattern)
+{
+	int num_insts, pc;
+	for (num_insts = 0; pattern->get_inst(pattern, num_insts); num_insts++);
+	if (!num_insts)
+		return;
+
+	ReOS_Inst **insts = malloc(sizeof(ReOS_Inst *) * num_insts);
+	for (pc = 0; pc < num_insts; pc++) {
+		insts[pc] = pattern->get_inst(pattern, pc);
+		switch (insts[pc]->opcode) {
+		case OpBranch:
+		case OpNegBranch:
+		case OpBacktrack:
+			free(insts);
+			return;
+		}
+	}
+
+	ClosureBuilder b;
+	memset(&b, 0, sizeof(b));
+	b.pattern = pattern;
+	b.num_insts = num_insts;
+	b.visited = malloc(num_insts);
+	b.preds = count_preds(insts, num_insts);
+	free(insts);
+
+	// work from the original instructions, then replace them
+	char *entries = closure_entries(pattern, num_insts);
+	StandardClosure **closures = calloc(num_insts, sizeof(StandardClosure *));
+	for (pc = 0; pc < num_insts; pc++) {
+		if (!entries[pc])
+			continue;
+
+		switch (pattern->get_inst(pattern, pc)->opcode) {
+		case OpJmp:
+		case OpSplit:
+			closures[pc] = new_closure(&b, pc);
+			break;
+		}
+	}
+
+	for (pc = 0; pc < num_insts; pc++) {
+		if (closures[pc]) {
+			free_reos_inst(pattern->get_inst(pattern, pc));
+			ReOS_Inst *inst = standard_inst_factory(OpClosure);
+			inst->args = closures[pc];
+			pattern->set_inst(pattern, inst, pc);
+		}
+	}
+
+	free(closures);
+	free(entries);
+	free(b.code);
+	free(b.preds);
+	free(b.visited);
+}
+
 void print_standard_inst(ReOS_Inst *inst)
 {
 	StandardInstArgs *args = (StandardInstArgs *)inst->args;
@@ -403,6 +967,17 @@ void print_standard_inst(ReOS_Inst *inst)
 		printf("neg-branch %d, %d", args->x, args->y);
 		break;
 
+	case OpClosure:
+	{
+		StandardClosure *closure = inst->args;
+		printf("closure");
+
+		int i;
+		for (i = 0; i < closure->num_targets; i++)
+			printf("%s %d", i ? "," : "", standard_closure_targets(closure)[i]);
+		break;
+	}
+
 	default:
 		printf("unknown-opcode %d", inst->opcode);
 		break;
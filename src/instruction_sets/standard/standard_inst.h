@@ -3,11 +3,30 @@
 
 #include "reos_types.h"
 
+/**
+ * Tokens of history kept for patterns with backreferences. Captures that
+ * started further back than this are re-read from the input.
+ */
+#define STANDARD_BACKREF_HISTORY_SIZE 65536
+
+/**
+ * The most targets a precomputed closure may have. Instructions whose
+ * closures would have more are left to run one at a time.
+ */
+#define STANDARD_CLOSURE_MAX_TARGETS 256
+
+/**
+ * Names the standard opcodes and the layout of their args in pattern images.
+ * Bump it whenever either changes, so that older images are refused.
+ */
+#define STANDARD_INST_SET "standard/1"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 typedef struct StandardInstArgs StandardInstArgs;
+typedef struct StandardClosure StandardClosure;
 
 enum
 {
@@ -22,7 +41,8 @@ enum
 	OpEnd,
 	OpBranch,
 	OpNegBranch,
-	OpRecurse
+	OpRecurse,
+	OpClosure
 };
 
 struct StandardInstArgs
@@ -31,8 +51,35 @@ struct StandardInstArgs
 	int y;
 };
 
+/**
+ * The args of an OpClosure: the instructions a thread at its pc reaches
+ * through jmps and splits, highest priority first, and its code, a tree of
+ * the forks on the way to them, so that forks whose targets are all taken
+ * are skipped together. The instruction it replaced is kept, for kernels
+ * that revisit pcs to find every capture.
+ *
+ * The targets and then the code follow the struct in the same block, so
+ * freeing the args frees it all, and the block can be copied as it is.
+ */
+struct StandardClosure
+{
+	int opcode;
+	StandardInstArgs args;
+
+	int num_targets;
+	int code_len;
+};
+
+#define standard_closure_targets(closure) ((int *)((closure) + 1))
+#define standard_closure_code(closure) (standard_closure_targets(closure) + (closure)->num_targets)
+
 ReOS_Inst *standard_inst_factory(int);
 int execute_standard_inst(ReOS_Kernel *, ReOS_Thread *, ReOS_Inst *, int);
+long standard_pattern_history_size(ReOS_Pattern *);
+long standard_pattern_max_length(ReOS_Pattern *);
+void standard_pattern_info(ReOS_Pattern *, ReOS_PatternInfo *);
+int standard_inst_args_size(ReOS_Inst *);
+void standard_pattern_compute_closures(ReOS_Pattern *);
 void print_standard_inst(ReOS_Inst *);
 
 #ifdef __cplusplus
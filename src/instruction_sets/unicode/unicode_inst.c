@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "reos_kernel.h"
+#include "reos_stdlib.h"
 #include "standard_inst.h"
 #include "unicode_inst.h"
 #include "unicode/uchar.h"
@@ -9,15 +10,23 @@
 ReOS_Inst *unicode_inst_factory(int opcode)
 {
 	if (opcode == OpUnicodeChar || opcode == OpUnicodeRange) {
-		ReOS_Inst *inst = malloc(sizeof(ReOS_Inst));
+		ReOS_Inst *inst = reos_malloc(ReOS_MemPattern, sizeof(ReOS_Inst));
 		inst->opcode = opcode;
-		inst->args = malloc(sizeof(UnicodeInstArgs));
+		inst->args = reos_malloc(ReOS_MemPattern, sizeof(UnicodeInstArgs));
 		return inst;
 	}
 	else
 		return standard_inst_factory(opcode);
 }
 
+int unicode_inst_args_size(ReOS_Inst *inst)
+{
+	if (inst->opcode == OpUnicodeChar || inst->opcode == OpUnicodeRange)
+		return sizeof(UnicodeInstArgs);
+	else
+		return standard_inst_args_size(inst);
+}
+
 void print_unicode_inst(ReOS_Inst *inst)
 {
 	UnicodeInstArgs *args = inst->args;
@@ -2,6 +2,14 @@
 #define UNICODE_INST_H
 
 #include "reos_types.h"
+#include "standard_inst.h"
+
+/**
+ * Names the unicode instruction set, with the standard one it extends, for
+ * pattern images. Bump it whenever OpUnicodeChar, OpUnicodeRange or their args
+ * change.
+ */
+#define UNICODE_INST_SET "unicode/1+" STANDARD_INST_SET
 
 #ifdef __cplusplus
 extern "C" {
@@ -22,6 +30,7 @@ struct UnicodeInstArgs
 };
 
 ReOS_Inst *unicode_inst_factory(int);
+int unicode_inst_args_size(ReOS_Inst *);
 int execute_unicode_inst(ReOS_Kernel *, ReOS_Thread *, ReOS_Inst *, int);
 void print_unicode_inst(ReOS_Inst *);
 
@@ -70,10 +70,27 @@
 		(l)->impl = reos_judylistimpl_clone((l)->impl); \
 	}
 
+/*
+ * Runs \a op, which may resize the Judy array \a list, and with
+ * REOS_MEMORY_STATS accounts the change in the memory libJudy holds for it
+ * to ReOS_MemJudy.
+ */
+#ifdef REOS_MEMORY_STATS
+#define judy_account(list, op) \
+	{ \
+		Word_t judy_used = JudyLMemUsed(list); \
+		op; \
+		reos_stats_judy(judy_used, JudyLMemUsed(list)); \
+	}
+#else
+#define judy_account(list, op) \
+	op;
+#endif
+
 #define judy_insert(list, index, data) \
 	{ \
 		void **pvalue; \
-		JLI(pvalue, (list), (index)); \
+		judy_account((list), JLI(pvalue, (list), (index))) \
 		*pvalue = (data); \
 	}
 
@@ -118,7 +135,7 @@
 #define judy_delete(list, index) \
 	{ \
 		int rc; \
-		JLD(rc, (list), (index)); \
+		judy_account((list), JLD(rc, (list), (index))) \
 	}
 
 #define reos_judylist_delete(list, index) \
@@ -0,0 +1,272 @@
+#include "reos_batch.h"
+#include "reos_capture.h"
+#include "reos_kernel.h"
+#include "reos_stdlib.h"
+
+/**
+ * \file
+ *
+ * Matches one pattern against many independent inputs, such as the records
+ * of a file, on a fixed pool of threads. Each thread keeps its own kernel,
+ * along with its thread and capture set pools, from one input and one batch
+ * to the next.
+ *
+ * A batch's inputs are split evenly between the workers up front. A worker
+ * that runs out steals the second half of the remaining inputs of whichever
+ * worker has the most left, so a few long inputs don't leave the other cores
+ * idle.
+ */
+
+static void *batch_worker_main(void *);
+
+/**
+ * Starts a pool of \a num_workers threads, each running a kernel with the
+ * pattern and settings of \a proto.
+ */
+ReOS_Batch *new_reos_batch(ReOS_Kernel *proto, int num_workers)
+{
+	ReOS_Batch *batch = malloc(sizeof(ReOS_Batch));
+	batch->num_workers = num_workers;
+	batch->job = 0;
+	batch->running = 0;
+	batch->stop = 0;
+	pthread_mutex_init(&batch->lock, 0);
+	pthread_cond_init(&batch->start, 0);
+	pthread_cond_init(&batch->done, 0);
+
+	batch->workers = malloc(sizeof(ReOS_BatchWorker) * num_workers);
+	int i;
+	for (i = 0; i < num_workers; i++) {
+		ReOS_BatchWorker *w = &batch->workers[i];
+		w->batch = batch;
+		w->k = new_reos_kernel(proto->pattern, proto->execute_inst, proto->max_capturesets);
+		w->k->test_backref = proto->test_backref;
+		w->k->history_size = proto->history_size;
+		w->next = 0;
+		w->end = 0;
+		pthread_mutex_init(&w->lock, 0);
+	}
+
+	for (i = 0; i < num_workers; i++)
+		pthread_create(&batch->workers[i].thread, 0, batch_worker_main, &batch->workers[i]);
+
+	return batch;
+}
+
+void free_reos_batch(ReOS_Batch *batch)
+{
+	if (batch) {
+		pthread_mutex_lock(&batch->lock);
+		batch->stop = 1;
+		pthread_cond_broadcast(&batch->start);
+		pthread_mutex_unlock(&batch->lock);
+
+		int i;
+		for (i = 0; i < batch->num_workers; i++) {
+			ReOS_BatchWorker *w = &batch->workers[i];
+			pthread_join(w->thread, 0);
+			free_reos_kernel(w->k);
+			pthread_mutex_destroy(&w->lock);
+		}
+
+		pthread_cond_destroy(&batch->start);
+		pthread_cond_destroy(&batch->done);
+		pthread_mutex_destroy(&batch->lock);
+		free(batch->workers);
+		free(batch);
+	}
+}
+
+/**
+ * Frees the matches held by \a result.
+ */
+void reos_batchresult_clear(ReOS_BatchResult *result)
+{
+	// the capture sets return to the free list as the matches are freed, so
+	// it has to go last
+	free_reos_simplelist(result->matches);
+	free_reos_compoundlist(result->free_captureset_list);
+	result->matches = 0;
+	result->free_captureset_list = 0;
+	result->num_matches = 0;
+}
+
+/**
+ * Matches input \a index and stores its matches in its result.
+ */
+static void batch_worker_execute(ReOS_BatchWorker *w, long index)
+{
+	ReOS_Batch *batch = w->batch;
+	ReOS_Kernel *k = w->k;
+	ReOS_BatchResult *result = &batch->results[index];
+
+	ReOS_Input *input = batch->producer->open(index, batch->producer->data);
+	reos_kernel_clear_matches(k);
+	reos_kernel_execute(k, input, 0, batch->ops);
+
+	result->num_matches = k->num_capturesets;
+	result->matches = 0;
+	result->free_captureset_list = 0;
+
+	// hand the matches over whole, and give them a free list of their own so
+	// that freeing them later doesn't touch the kernel's pool from another
+	// thread
+	if (reos_simplelist_has_next(k->matches)) {
+		result->matches = k->matches;
+		result->free_captureset_list = new_reos_compoundlist(4, (VoidPtrFunc)delete_reos_captureset, 0);
+		foreach_simple(ReOS_CaptureSet, capture_set, result->matches)
+			capture_set->free_list = result->free_captureset_list;
+
+		k->matches = new_reos_simplelist((VoidPtrFunc)reos_captureset_deref);
+	}
+
+	free_reos_tokenbuffer(k->token_buf);
+	k->token_buf = 0;
+	if (batch->producer->close)
+		batch->producer->close(input);
+}
+
+/**
+ * Takes the next input from \a w's own range.
+ *
+ * \return The input's index, or -1 if the range is empty
+ */
+static long batch_worker_take(ReOS_BatchWorker *w)
+{
+	long index = -1;
+	pthread_mutex_lock(&w->lock);
+	if (w->next < w->end)
+		index = w->next++;
+	pthread_mutex_unlock(&w->lock);
+	return index;
+}
+
+/**
+ * Moves the second half of the remaining range of the worker with the most
+ * inputs left into \a w's own range.
+ *
+ * \return False if there was nothing left to steal
+ */
+static int batch_worker_steal(ReOS_BatchWorker *w)
+{
+	ReOS_Batch *batch = w->batch;
+
+	for (;;) {
+		// pick a victim without locking anything; its range is checked again
+		// once it's locked
+		ReOS_BatchWorker *victim = 0;
+		long most = 0;
+		int i;
+		for (i = 0; i < batch->num_workers; i++) {
+			ReOS_BatchWorker *other = &batch->workers[i];
+			long left = other->end - other->next;
+			if (other != w && left > most) {
+				victim = other;
+				most = left;
+			}
+		}
+
+		if (!victim)
+			return 0;
+
+		pthread_mutex_lock(&victim->lock);
+		long left = victim->end - victim->next;
+		long start = victim->end - (left + 1) / 2;
+		long end = victim->end;
+		if (left > 0)
+			victim->end = start;
+		pthread_mutex_unlock(&victim->lock);
+
+		if (left > 0) {
+			pthread_mutex_lock(&w->lock);
+			w->next = start;
+			w->end = end;
+			pthread_mutex_unlock(&w->lock);
+			return 1;
+		}
+	}
+}
+
+static void *batch_worker_main(void *d)
+{
+	ReOS_BatchWorker *w = (ReOS_BatchWorker *)d;
+	ReOS_Batch *batch = w->batch;
+	long job = 0;
+
+	for (;;) {
+		pthread_mutex_lock(&batch->lock);
+		while (batch->job == job && !batch->stop)
+			pthread_cond_wait(&batch->start, &batch->lock);
+		job = batch->job;
+		int stop = batch->stop;
+		pthread_mutex_unlock(&batch->lock);
+
+		if (stop)
+			return 0;
+
+		do {
+			long index;
+			while ((index = batch_worker_take(w)) != -1)
+				batch_worker_execute(w, index);
+		} while (batch_worker_steal(w));
+
+		pthread_mutex_lock(&batch->lock);
+		if (--batch->running == 0)
+			pthread_cond_signal(&batch->done);
+		pthread_mutex_unlock(&batch->lock);
+	}
+}
+
+/**
+ * Matches the \a num_inputs inputs opened by \a producer, storing the
+ * matches of input \c n in \c results[n], and returns once all of them are
+ * done. Each input is closed as soon as it has been matched. Results from a
+ * previous batch have to be cleared with reos_batchresult_clear() first.
+ */
+void reos_batch_execute_producer(ReOS_Batch *batch, ReOS_InputProducer *producer,
+								 long num_inputs, ReOS_BatchResult *results, int ops)
+{
+	pthread_mutex_lock(&batch->lock);
+	batch->producer = producer;
+	batch->results = results;
+	batch->ops = ops;
+
+	int i;
+	for (i = 0; i < batch->num_workers; i++) {
+		ReOS_BatchWorker *w = &batch->workers[i];
+		pthread_mutex_lock(&w->lock);
+		w->next = num_inputs * i / batch->num_workers;
+		w->end = num_inputs * (i + 1) / batch->num_workers;
+		pthread_mutex_unlock(&w->lock);
+
+		// reos_kernel_execute() only ever turns backtrack matching on, and the
+		// kernels are kept from one batch to the next
+		int backtrack = (ops & REOS_BACKTRACK_MATCHING) != 0;
+		w->k->state.current_thread_list->backtrack_captures = backtrack;
+		w->k->state.next_thread_list->backtrack_captures = backtrack;
+	}
+
+	batch->running = batch->num_workers;
+	batch->job++;
+	pthread_cond_broadcast(&batch->start);
+
+	while (batch->running)
+		pthread_cond_wait(&batch->done, &batch->lock);
+	pthread_mutex_unlock(&batch->lock);
+}
+
+static ReOS_Input *batch_array_open(long index, void *inputs)
+{
+	return ((ReOS_Input **)inputs)[index];
+}
+
+/**
+ * Like reos_batch_execute_producer(), for inputs that are already open. The
+ * inputs are left open.
+ */
+void reos_batch_execute(ReOS_Batch *batch, ReOS_Input **inputs, long num_inputs,
+						ReOS_BatchResult *results, int ops)
+{
+	ReOS_InputProducer producer = { batch_array_open, 0, inputs };
+	reos_batch_execute_producer(batch, &producer, num_inputs, results, ops);
+}
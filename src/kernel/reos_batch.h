@@ -0,0 +1,75 @@
+#ifndef REOS_BATCH_H
+#define REOS_BATCH_H
+
+#include <pthread.h>
+#include "reos_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct ReOS_Batch ReOS_Batch;
+typedef struct ReOS_BatchWorker ReOS_BatchWorker;
+typedef struct ReOS_BatchResult ReOS_BatchResult;
+
+/**
+ * The matches of one input of a batch.
+ */
+struct ReOS_BatchResult
+{
+	int num_matches;
+
+	/*!
+	 *  The capture sets of the matches, or 0 if there are none. Owned by the
+	 *  result until reos_batchresult_clear() is called on it.
+	 */
+	ReOS_SimpleList *matches;
+	ReOS_CompoundList *free_captureset_list;
+};
+
+/**
+ * A worker of a ReOS_Batch, which matches the inputs in [\c next, \c end)
+ * with its own kernel, then steals from the other workers.
+ */
+struct ReOS_BatchWorker
+{
+	ReOS_Batch *batch;
+	ReOS_Kernel *k;
+	pthread_t thread;
+
+	pthread_mutex_t lock; //!< Guards \c next and \c end
+	long next;
+	long end;
+};
+
+/**
+ * A pool of threads that match one pattern against many independent inputs.
+ */
+struct ReOS_Batch
+{
+	ReOS_BatchWorker *workers;
+	int num_workers;
+
+	pthread_mutex_t lock;
+	pthread_cond_t start;
+	pthread_cond_t done;
+	long job; //!< Incremented to start each batch
+	int running; //!< Workers still busy with the current batch
+	int stop;
+
+	ReOS_InputProducer *producer;
+	ReOS_BatchResult *results;
+	int ops;
+};
+
+ReOS_Batch *new_reos_batch(ReOS_Kernel *, int);
+void free_reos_batch(ReOS_Batch *);
+void reos_batch_execute(ReOS_Batch *, ReOS_Input **, long, ReOS_BatchResult *, int);
+void reos_batch_execute_producer(ReOS_Batch *, ReOS_InputProducer *, long, ReOS_BatchResult *, int);
+void reos_batchresult_clear(ReOS_BatchResult *);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,51 +1,154 @@
 #include "reos_buffer.h"
 #include "reos_stdlib.h"
 
+/**
+ * \file
+ *
+ * A ReOS_TokenBuffer hands the kernel one token at a time, by walking \c next
+ * up to \c end. How that range gets filled depends on which capabilities the
+ * input provides, in order of preference:
+ *
+ * - \c span: the whole input is stored contiguously, so the range covers all
+ *   of it from the start and is never refilled.
+ * - \c map_read: the range is refilled with windows into the input's own
+ *   storage.
+ * - \c stream_read: the range is refilled by copying tokens into \c buf,
+ *   which the token buffer owns.
+ *
+ * Independently of how it's filled, a token buffer can keep a \c history of
+ * the tokens the kernel has consumed, which backreferences compare against.
+ */
+
 ReOS_TokenBuffer *new_reos_tokenbuffer(ReOS_Input *input)
 {
-	ReOS_TokenBuffer *token_buf = malloc(sizeof(ReOS_TokenBuffer));
-	token_buf->len = 0;
-	token_buf->pos = 0;
-	token_buf->buf = malloc(input->token_size * input->buffer_size);
+	ReOS_TokenBuffer *token_buf = reos_malloc(ReOS_MemTokenBuffer, sizeof(ReOS_TokenBuffer));
+	token_buf->token_size = input->token_size;
 	token_buf->input = input;
+	token_buf->history = 0;
+	token_buf->history_size = 0;
+
+	if (input->span) {
+		long len;
+		token_buf->buf = input->span(&len, input->data);
+		token_buf->next = token_buf->buf;
+		token_buf->end = token_buf->next + len * token_buf->token_size;
+	}
+	else {
+		// mapped inputs lend us their own storage
+		if (input->map_read)
+			token_buf->buf = 0;
+		else
+			token_buf->buf = reos_malloc(ReOS_MemTokenBuffer, input->token_size * input->buffer_size);
+
+		token_buf->next = token_buf->buf;
+		token_buf->end = token_buf->buf;
+	}
 	return token_buf;
 }
 
 void free_reos_tokenbuffer(ReOS_TokenBuffer *token_buf)
 {
 	if (token_buf) {
-		free(token_buf->buf);
-		free(token_buf);
+		if (!token_buf->input->span && !token_buf->input->map_read)
+			reos_free(ReOS_MemTokenBuffer, token_buf->buf);
+		reos_free(ReOS_MemTokenBuffer, token_buf->history);
+		reos_free(ReOS_MemTokenBuffer, token_buf);
 	}
 }
 
-void reos_tokenbuffer_input(ReOS_TokenBuffer *token_buf)
+/**
+ * Replaces the buffered tokens with the next ones from the input.
+ *
+ * \return The number of tokens now buffered, or 0 at the end of input
+ */
+int reos_tokenbuffer_input(ReOS_TokenBuffer *token_buf)
 {
-	if (token_buf->input->free_token) {
-		int i;
-		for (i = 0; i < token_buf->len; i++)
-			token_buf->input->free_token(token_at(token_buf, i));
+	ReOS_Input *input = token_buf->input;
+
+	// a span was handed over whole when the buffer was created
+	if (input->span) {
+		token_buf->next = token_buf->end;
+		return 0;
+	}
+
+	if (input->free_token) {
+		char *token;
+		for (token = token_buf->buf; token < token_buf->end; token += token_buf->token_size)
+			input->free_token(token);
 	}
 
-	token_buf->len = token_buf->input->stream_read(token_buf->buf, token_buf->input->buffer_size,
-												   token_buf->input->data);
-	token_buf->pos = 0;
+	int len;
+	if (input->map_read)
+		len = input->map_read(&token_buf->buf, input->buffer_size, input->data);
+	else
+		len = input->stream_read(token_buf->buf, input->buffer_size, input->data);
+
+	token_buf->next = token_buf->buf;
+	token_buf->end = token_buf->next + len * token_buf->token_size;
+	return len;
 }
 
-void reos_tokenbuffer_fastforward(ReOS_TokenBuffer *token_buf, int offset)
+/**
+ * Skips the first \a offset tokens of the input. Must be called before any
+ * tokens are read from \a token_buf.
+ *
+ * Span inputs just move \c next, and inputs with \c seek seek there. Other
+ * inputs have to read and discard every token before \a offset.
+ */
+void reos_tokenbuffer_fastforward(ReOS_TokenBuffer *token_buf, long offset)
 {
 	ReOS_Input *input = token_buf->input;
-	if (input->stream_read) {
-		void **buffer = token_buf->buf;
+	if (!input->span && input->seek) {
+		input->seek(offset, input->data);
+		return;
+	}
 
-		int read = 0;
-		int remaining = offset;
-		while (read <= offset) {
-			remaining -= token_buf->len;
-			token_buf->len = input->stream_read(buffer, input->buffer_size, input->data);
-			read += token_buf->len;
-		}
+	long available;
+	while (offset >= (available = (token_buf->end - token_buf->next) / token_buf->token_size)) {
+		offset -= available;
+		token_buf->next = token_buf->end;
+		if (!reos_tokenbuffer_input(token_buf))
+			return;
+	}
+
+	token_buf->next += offset * token_buf->token_size;
+}
+
+/**
+ * Allocates room to remember the last \a size consumed tokens, rounded up to
+ * a power of two. Does nothing for span inputs, whose tokens all stay
+ * addressable.
+ */
+void reos_tokenbuffer_set_history(ReOS_TokenBuffer *token_buf, long size)
+{
+	if (token_buf->input->span || size <= 0)
+		return;
+
+	long history_size = 1;
+	while (history_size < size)
+		history_size <<= 1;
 
-		token_buf->pos = remaining;
+	reos_free(ReOS_MemTokenBuffer, token_buf->history);
+	token_buf->history = reos_malloc(ReOS_MemTokenBuffer, history_size * token_buf->token_size);
+	token_buf->history_size = history_size;
+}
+
+/**
+ * Finds a previously consumed token.
+ *
+ * \param index The input index of the token to find
+ * \param sp The input index of the most recently remembered token
+ * \return A pointer to the token, or 0 if it is no longer buffered
+ */
+void *reos_tokenbuffer_history_get(ReOS_TokenBuffer *token_buf, long index, long sp)
+{
+	if (token_buf->input->span) {
+		char *token = (char *)token_buf->buf + index * token_buf->token_size;
+		return token < token_buf->end ? token : 0;
 	}
+
+	if (!token_buf->history || index > sp || index <= sp - token_buf->history_size)
+		return 0;
+
+	return &token_buf->history[(index & (token_buf->history_size - 1)) * token_buf->token_size];
 }
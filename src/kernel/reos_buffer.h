@@ -1,14 +1,16 @@
 #ifndef REOS_BUFFER_H
 #define REOS_BUFFER_H
 
+#include <string.h>
 #include "reos_types.h"
 
 #define token_at(token_buf, index) \
-	(&((char *)(token_buf)->buf)[(index) * (token_buf)->input->token_size])
+	(&((char *)(token_buf)->buf)[(index) * (token_buf)->token_size])
 
 #ifndef reos_tokenbuffer_consume
 #define reos_tokenbuffer_consume(token_buf) \
-	token_at(token_buf, (token_buf)->pos++)
+	((token_buf)->next += (token_buf)->token_size, \
+	 (token_buf)->next - (token_buf)->token_size)
 #endif
 
 /*
@@ -21,23 +23,29 @@
 */
 #ifndef reos_tokenbuffer_read
 #define reos_tokenbuffer_read(token_buf) \
-	(((token_buf)->pos == (token_buf)->len) ? \
-		reos_tokenbuffer_input(token_buf), \
-		(!(token_buf)->len ? 0 \
+	(((token_buf)->next == (token_buf)->end) ? \
+		(!reos_tokenbuffer_input(token_buf) ? 0 \
 			: \
 			reos_tokenbuffer_consume(token_buf)) \
 		: \
 		reos_tokenbuffer_consume(token_buf))
 #endif
 
+#define reos_tokenbuffer_remember(token_buf, index, token) \
+	memcpy(&(token_buf)->history[((index) & ((token_buf)->history_size - 1)) \
+								 * (token_buf)->token_size], \
+		   (token), (token_buf)->token_size)
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 ReOS_TokenBuffer *new_reos_tokenbuffer(ReOS_Input *);
 void free_reos_tokenbuffer(ReOS_TokenBuffer *);
-void reos_tokenbuffer_input(ReOS_TokenBuffer *);
-void reos_tokenbuffer_fastforward(ReOS_TokenBuffer *, int);
+int reos_tokenbuffer_input(ReOS_TokenBuffer *);
+void reos_tokenbuffer_fastforward(ReOS_TokenBuffer *, long);
+void reos_tokenbuffer_set_history(ReOS_TokenBuffer *, long);
+void *reos_tokenbuffer_history_get(ReOS_TokenBuffer *, long, long);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,230 @@
+#include <stdlib.h>
+#include <string.h>
+#include "reos_cache.h"
+
+/**
+ * \file
+ *
+ * Caches compiled patterns, so that code compiling the same expressions
+ * again and again, say once per request, compiles each only once. Patterns
+ * are looked up in a hash table by expression, front-end and options, and
+ * kept on a list from the most to the least recently used, from whose end
+ * they're evicted.
+ *
+ * Entries are reference counted. The cache holds one reference while an
+ * entry is cached, and each reos_pattern_cache_get() another until it's
+ * released, so that evicting a pattern doesn't free it from under a kernel
+ * running it on another thread.
+ *
+ * Patterns are compiled without holding the cache's lock, so a slow compile
+ * doesn't hold up lookups of other patterns. An entry is cached before it's
+ * compiled, and threads asking for it meanwhile wait for that compile rather
+ * than starting their own.
+ */
+
+static unsigned long hash_key(ReOS_PatternCompiler *compiler, const char *expression, int options)
+{
+	unsigned long hash = 2166136261UL;
+	const unsigned char *c;
+	for (c = (const unsigned char *)expression; *c; c++) {
+		hash ^= *c;
+		hash *= 16777619UL;
+	}
+
+	hash ^= (unsigned int)options;
+	hash *= 16777619UL;
+	hash ^= (unsigned long)compiler >> 4;
+	hash *= 16777619UL;
+	return hash;
+}
+
+/**
+ * Creates a cache holding up to \a capacity patterns.
+ */
+ReOS_PatternCache *new_reos_pattern_cache(int capacity)
+{
+	ReOS_PatternCache *cache = malloc(sizeof(ReOS_PatternCache));
+	pthread_mutex_init(&cache->lock, 0);
+	pthread_cond_init(&cache->compiled, 0);
+
+	cache->capacity = capacity < 1 ? 1 : capacity;
+	cache->size = 0;
+
+	// at least two buckets per pattern, a power of two to mask hashes with
+	cache->num_buckets = 1;
+	while (cache->num_buckets < 2 * (unsigned long)cache->capacity)
+		cache->num_buckets <<= 1;
+	cache->buckets = calloc(cache->num_buckets, sizeof(ReOS_PatternCacheEntry *));
+
+	cache->lru_head = 0;
+	cache->lru_tail = 0;
+	cache->hits = 0;
+	cache->misses = 0;
+	cache->evictions = 0;
+	return cache;
+}
+
+// call with the cache's lock held
+static void drop_ref(ReOS_PatternCacheEntry *entry)
+{
+	if (--entry->refs == 0) {
+		if (entry->pattern)
+			entry->compiler->free_pattern(entry->pattern);
+		free(entry->expression);
+		free(entry);
+	}
+}
+
+static void lru_unlink(ReOS_PatternCache *cache, ReOS_PatternCacheEntry *entry)
+{
+	if (entry->lru_prev)
+		entry->lru_prev->lru_next = entry->lru_next;
+	else
+		cache->lru_head = entry->lru_next;
+
+	if (entry->lru_next)
+		entry->lru_next->lru_prev = entry->lru_prev;
+	else
+		cache->lru_tail = entry->lru_prev;
+}
+
+static void lru_push_head(ReOS_PatternCache *cache, ReOS_PatternCacheEntry *entry)
+{
+	entry->lru_prev = 0;
+	entry->lru_next = cache->lru_head;
+	if (cache->lru_head)
+		cache->lru_head->lru_prev = entry;
+	else
+		cache->lru_tail = entry;
+	cache->lru_head = entry;
+}
+
+// call with the cache's lock held
+static void uncache(ReOS_PatternCache *cache, ReOS_PatternCacheEntry *entry)
+{
+	ReOS_PatternCacheEntry **link = &cache->buckets[entry->hash & (cache->num_buckets - 1)];
+	while (*link != entry)
+		link = &(*link)->bucket_next;
+	*link = entry->bucket_next;
+
+	lru_unlink(cache, entry);
+	cache->size--;
+	entry->cached = 0;
+	drop_ref(entry);
+}
+
+/**
+ * Frees the cache and the patterns in it. Every entry returned by
+ * reos_pattern_cache_get() must have been released first.
+ */
+void free_reos_pattern_cache(ReOS_PatternCache *cache)
+{
+	if (cache) {
+		while (cache->lru_head)
+			uncache(cache, cache->lru_head);
+
+		free(cache->buckets);
+		pthread_cond_destroy(&cache->compiled);
+		pthread_mutex_destroy(&cache->lock);
+		free(cache);
+	}
+}
+
+/**
+ * Returns the pattern \a compiler compiles \a expression to with \a options,
+ * compiling it if it isn't cached.
+ *
+ * \return The cache's entry for the pattern, to be released with
+ * reos_pattern_cache_release() once nothing runs it anymore, or 0 if
+ * \a expression doesn't compile
+ */
+ReOS_PatternCacheEntry *reos_pattern_cache_get(ReOS_PatternCache *cache, ReOS_PatternCompiler *compiler,
+											   const char *expression, int options)
+{
+	unsigned long hash = hash_key(compiler, expression, options);
+	ReOS_PatternCacheEntry **bucket = &cache->buckets[hash & (cache->num_buckets - 1)];
+
+	pthread_mutex_lock(&cache->lock);
+
+	ReOS_PatternCacheEntry *entry;
+	for (entry = *bucket; entry; entry = entry->bucket_next) {
+		if (entry->hash == hash && entry->compiler == compiler && entry->options == options
+			&& !strcmp(entry->expression, expression))
+			break;
+	}
+
+	if (entry) {
+		cache->hits++;
+		entry->refs++;
+		lru_unlink(cache, entry);
+		lru_push_head(cache, entry);
+
+		while (!entry->compiled)
+			pthread_cond_wait(&cache->compiled, &cache->lock);
+	}
+	else {
+		cache->misses++;
+		entry = malloc(sizeof(ReOS_PatternCacheEntry));
+		entry->expression = strdup(expression);
+		entry->compiler = compiler;
+		entry->options = options;
+		entry->hash = hash;
+		entry->pattern = 0;
+		entry->compiled = 0;
+		entry->cached = 1;
+		entry->refs = 2;
+
+		entry->bucket_next = *bucket;
+		*bucket = entry;
+		lru_push_head(cache, entry);
+		cache->size++;
+
+		while (cache->size > cache->capacity) {
+			uncache(cache, cache->lru_tail);
+			cache->evictions++;
+		}
+
+		pthread_mutex_unlock(&cache->lock);
+		ReOS_Pattern *pattern = compiler->compile(expression, options, &entry->info, compiler->data);
+		pthread_mutex_lock(&cache->lock);
+
+		entry->pattern = pattern;
+		entry->compiled = 1;
+		pthread_cond_broadcast(&cache->compiled);
+
+		// let the next caller try again
+		if (!pattern && entry->cached)
+			uncache(cache, entry);
+	}
+
+	if (!entry->pattern) {
+		drop_ref(entry);
+		entry = 0;
+	}
+
+	pthread_mutex_unlock(&cache->lock);
+	return entry;
+}
+
+/**
+ * Gives back an entry returned by reos_pattern_cache_get(). Its pattern is
+ * freed if it's been evicted and no one else holds it.
+ */
+void reos_pattern_cache_release(ReOS_PatternCache *cache, ReOS_PatternCacheEntry *entry)
+{
+	if (entry) {
+		pthread_mutex_lock(&cache->lock);
+		drop_ref(entry);
+		pthread_mutex_unlock(&cache->lock);
+	}
+}
+
+void reos_pattern_cache_get_stats(ReOS_PatternCache *cache, ReOS_PatternCacheStats *stats)
+{
+	pthread_mutex_lock(&cache->lock);
+	stats->hits = cache->hits;
+	stats->misses = cache->misses;
+	stats->evictions = cache->evictions;
+	stats->size = cache->size;
+	pthread_mutex_unlock(&cache->lock);
+}
@@ -0,0 +1,100 @@
+#ifndef REOS_CACHE_H
+#define REOS_CACHE_H
+
+#include <pthread.h>
+#include "reos_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct ReOS_PatternCompiler ReOS_PatternCompiler;
+typedef struct ReOS_PatternCache ReOS_PatternCache;
+typedef struct ReOS_PatternCacheEntry ReOS_PatternCacheEntry;
+typedef struct ReOS_PatternCacheStats ReOS_PatternCacheStats;
+
+/**
+ * Compiles an expression with a front-end's options, filling in the info of
+ * the pattern, or returns 0 if the expression doesn't compile. Called from
+ * any thread using the cache, so it must be thread safe.
+ */
+typedef ReOS_Pattern *(*CompilePatternFunc)(const char *, int, ReOS_PatternInfo *, void *);
+
+/**
+ * A front-end, from expressions to patterns. The cache tells front-ends
+ * apart by the address of this struct, so each should have one.
+ */
+struct ReOS_PatternCompiler
+{
+	CompilePatternFunc compile; //!< Called with \c data
+	VoidPtrFunc free_pattern; //!< Called with a pattern returned by \c compile
+	void *data;
+};
+
+/**
+ * A compiled pattern in the cache. Neither it nor its pattern may be changed,
+ * since other threads may be running it.
+ */
+struct ReOS_PatternCacheEntry
+{
+	char *expression;
+	ReOS_PatternCompiler *compiler;
+	int options;
+	unsigned long hash;
+
+	//! 0 while it's being compiled, and if it didn't compile
+	ReOS_Pattern *pattern;
+	ReOS_PatternInfo info;
+	int compiled;
+	int cached; //!< Whether it's still in the cache, rather than evicted
+
+	//! Held by the cache while it's cached, and by each reos_pattern_cache_get()
+	int refs;
+
+	ReOS_PatternCacheEntry *bucket_next;
+	ReOS_PatternCacheEntry *lru_prev; //!< Towards the most recently used
+	ReOS_PatternCacheEntry *lru_next;
+};
+
+struct ReOS_PatternCacheStats
+{
+	long hits;
+	long misses; //!< Each a compile
+	long evictions;
+	int size;
+};
+
+/**
+ * A thread-safe cache of compiled patterns, keyed by expression, front-end
+ * and options, which evicts the least recently used once it holds
+ * \c capacity of them.
+ */
+struct ReOS_PatternCache
+{
+	pthread_mutex_t lock;
+	pthread_cond_t compiled; //!< Broadcast as each compile finishes
+
+	ReOS_PatternCacheEntry **buckets;
+	unsigned long num_buckets;
+	int capacity;
+	int size;
+
+	ReOS_PatternCacheEntry *lru_head; //!< The most recently used
+	ReOS_PatternCacheEntry *lru_tail;
+
+	long hits;
+	long misses;
+	long evictions;
+};
+
+ReOS_PatternCache *new_reos_pattern_cache(int);
+void free_reos_pattern_cache(ReOS_PatternCache *);
+ReOS_PatternCacheEntry *reos_pattern_cache_get(ReOS_PatternCache *, ReOS_PatternCompiler *, const char *, int);
+void reos_pattern_cache_release(ReOS_PatternCache *, ReOS_PatternCacheEntry *);
+void reos_pattern_cache_get_stats(ReOS_PatternCache *, ReOS_PatternCacheStats *);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
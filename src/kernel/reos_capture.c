@@ -159,7 +159,7 @@ ReOS_CaptureSet *new_reos_captureset(ReOS_CompoundList *free_list)
 	else
 #endif
 	{
-		set = malloc(sizeof(ReOS_CaptureSet));
+		set = reos_malloc(ReOS_MemCaptureSets, sizeof(ReOS_CaptureSet));
 		set->captures = 0;
 		set->version = 0;
 		set->free_list = free_list;
@@ -204,7 +204,7 @@ void delete_reos_captureset(ReOS_CaptureSet *set)
 {
 	if (set) {
 		free_reos_judylist(set->captures);
-		free(set);
+		reos_free(ReOS_MemCaptureSets, set);
 	}
 }
 
@@ -216,7 +216,7 @@ void delete_reos_captureset(ReOS_CaptureSet *set)
  */
 ReOS_Capture *new_reos_capture()
 {
-	ReOS_Capture *cap = malloc(sizeof(ReOS_Capture));
+	ReOS_Capture *cap = reos_malloc(ReOS_MemCaptures, sizeof(ReOS_Capture));
 	cap->start = -1;
 	cap->end = -1;
 	cap->partial = 0;
@@ -232,11 +232,16 @@ ReOS_Capture *new_reos_capture()
  */
 ReOS_Capture *reos_capture_clone(ReOS_Capture *cap)
 {
-	ReOS_Capture *clone = malloc(sizeof(ReOS_Capture));
+	ReOS_Capture *clone = reos_malloc(ReOS_MemCaptures, sizeof(ReOS_Capture));
 	memcpy(clone, cap, sizeof(ReOS_Capture));
 	return clone;
 }
 
+static void free_reos_capture(ReOS_Capture *cap)
+{
+	reos_free(ReOS_MemCaptures, cap);
+}
+
 /**
  * Returns a write-safe copy of a ReOS_CaptureSet object.
  *
@@ -292,7 +297,7 @@ static ReOS_Capture *reos_captureset_find_capture(ReOS_CaptureSet *set, int capt
 		set->captures = new_reos_judylist((VoidPtrFunc)free_reos_compoundlist, 0, 0, 0);
 
 	reos_judylist_fail_get(set->captures, capture_num, ReOS_CompoundList, capture_list) {
-		capture_list = new_reos_compoundlist(4, (VoidPtrFunc)free, (CloneFunc)reos_capture_clone);
+		capture_list = new_reos_compoundlist(4, (VoidPtrFunc)free_reos_capture, (CloneFunc)reos_capture_clone);
 		reos_judylist_insert(set->captures, capture_num, capture_list);
 	}
 
@@ -422,12 +427,19 @@ long reos_capture_reconstruct(ReOS_Capture *cap, ReOS_Input *input, void *buf)
 	return input->indexed_read(buf, cap->end - cap->start, cap->start, input->data);
 }
 
+/**
+ * Copies the tokens of a capture interval into a new buffer, for
+ * backreferences whose capture is no longer in the token buffer's history.
+ *
+ * \param cap The ReOS_Capture object whose interval to copy
+ * \param input The ReOS_Input object to read tokens from
+ * \return A new ReOS_BackrefBuffer object
+ */
 ReOS_BackrefBuffer *new_reos_backrefbuffer(ReOS_Capture *cap, ReOS_Input *input)
 {
-	ReOS_BackrefBuffer *b = malloc(sizeof(ReOS_BackrefBuffer));
-	b->index = 0;
+	ReOS_BackrefBuffer *b = reos_malloc(ReOS_MemTokenBuffer, sizeof(ReOS_BackrefBuffer));
 	b->length = cap->end - cap->start;
-	b->tokens = malloc(sizeof(void *)*b->length);
+	b->tokens = reos_malloc(ReOS_MemTokenBuffer, input->token_size * b->length);
 	reos_capture_reconstruct(cap, input, b->tokens);
 
 	return b;
@@ -436,7 +448,7 @@ ReOS_BackrefBuffer *new_reos_backrefbuffer(ReOS_Capture *cap, ReOS_Input *input)
 void free_reos_backrefbuffer(ReOS_BackrefBuffer *b)
 {
 	if (b) {
-		free(b->tokens);
-		free(b);
+		reos_free(ReOS_MemTokenBuffer, b->tokens);
+		reos_free(ReOS_MemTokenBuffer, b);
 	}
 }
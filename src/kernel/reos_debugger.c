@@ -10,4 +10,9 @@ void debugger_reset(ReOS_Debugger *d)
 	d->match = 0;
 	d->failure = 0;
 	d->end = 0;
+	d->spawn = 0;
+	d->drop = 0;
+	d->reject = 0;
+	d->detach = 0;
+	d->branch = 0;
 }
@@ -0,0 +1,298 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "reos_image.h"
+#include "reos_stdlib.h"
+
+/**
+ * \file
+ *
+ * Saves compiled patterns as images that load without parsing or
+ * compiling them again. An image is a header, a table of the pattern's
+ * instructions, and their args, which are copied byte for byte; args must
+ * hold no pointers. It is loaded by mapping it read-only, so the processes
+ * loading the same image share its pages, and the only work done is to
+ * check its hash and point an instruction table into the mapping.
+ *
+ * The hash covers the header as well as the data, and the header names the
+ * instruction set the pattern was compiled to, so that a damaged image, or
+ * one of another instruction set or layout of args, is refused rather than
+ * run.
+ *
+ * Images are written in the byte order and word size of the machine that
+ * writes them, and are refused elsewhere.
+ */
+
+#define IMAGE_MAGIC "REOSPAT"
+
+// args start on multiples of this, so they can be read in place
+#define IMAGE_ALIGN 8
+
+typedef struct ImageHeader ImageHeader;
+typedef struct ImageInst ImageInst;
+typedef struct ImagePatternData ImagePatternData;
+
+struct ImageHeader
+{
+	char magic[8];
+	int version;
+	int header_size;
+	int inst_size;
+	int num_insts;
+	char inst_set[REOS_IMAGE_INST_SET_LEN + 1];
+
+	int num_captures;
+	long history_size;
+	long max_length;
+
+	// the bytes after the header, and the hash of the header, taken with
+	// this 0, and those bytes
+	long data_size;
+	unsigned long long hash;
+};
+
+struct ImageInst
+{
+	int opcode;
+	int args_size;
+	long args_offset; //!< From the start of the data, or -1 without args
+};
+
+struct ImagePatternData
+{
+	void *map;
+	long len;
+	ReOS_Inst *insts;
+	int num_insts;
+};
+
+#define IMAGE_HASH_BASIS 14695981039346656037ULL
+
+/**
+ * FNV-1a, which is fast enough to check an image as it's paged in. Goes on
+ * from \a hash, so that the header and data hash as one.
+ */
+static unsigned long long image_hash(unsigned long long hash, const unsigned char *data, long len)
+{
+	long i;
+	for (i = 0; i < len; i++) {
+		hash ^= data[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+static unsigned long long image_header_hash(const ImageHeader *header)
+{
+	ImageHeader copy;
+	memcpy(&copy, header, sizeof(copy));
+	copy.hash = 0;
+	return image_hash(IMAGE_HASH_BASIS, (unsigned char *)&copy, sizeof(copy));
+}
+
+static long align(long offset)
+{
+	return (offset + IMAGE_ALIGN - 1) & ~(long)(IMAGE_ALIGN - 1);
+}
+
+/**
+ * Writes \a pattern as an image, to be loaded with new_image_pattern(). The
+ * image is written next to \a path and renamed over it, so processes
+ * loading it see either the old image or the new one.
+ *
+ * \param args_size Returns the size of an instruction's args, from the
+ * instruction set the pattern was compiled with
+ * \param inst_set Names that instruction set and the layout of its args,
+ * such as ASCII_INST_SET, for new_image_pattern() to check
+ * \param info What's known about the pattern. Its \c hash is set to the
+ * image's.
+ * \return 0, or -1 if the image couldn't be written
+ */
+int reos_pattern_write_image(ReOS_Pattern *pattern, InstArgsSizeFunc args_size, const char *inst_set,
+							 ReOS_PatternInfo *info, const char *path)
+{
+	if (strlen(inst_set) > REOS_IMAGE_INST_SET_LEN)
+		return -1;
+
+	int num_insts, pc;
+	for (num_insts = 0; pattern->get_inst(pattern, num_insts); num_insts++);
+
+	// lay the args out after the instruction table
+	long data_size = align(sizeof(ImageInst) * num_insts);
+	for (pc = 0; pc < num_insts; pc++) {
+		ReOS_Inst *inst = pattern->get_inst(pattern, pc);
+		if (inst->args)
+			data_size = align(data_size + args_size(inst));
+	}
+
+	char *data = calloc(data_size ? data_size : 1, 1);
+	ImageInst *image_insts = (ImageInst *)data;
+	long offset = align(sizeof(ImageInst) * num_insts);
+	for (pc = 0; pc < num_insts; pc++) {
+		ReOS_Inst *inst = pattern->get_inst(pattern, pc);
+		image_insts[pc].opcode = inst->opcode;
+		image_insts[pc].args_size = inst->args ? args_size(inst) : 0;
+		image_insts[pc].args_offset = inst->args ? offset : -1;
+
+		if (inst->args) {
+			memcpy(data + offset, inst->args, image_insts[pc].args_size);
+			offset = align(offset + image_insts[pc].args_size);
+		}
+	}
+
+	ImageHeader header;
+	memset(&header, 0, sizeof(header));
+	strcpy(header.magic, IMAGE_MAGIC);
+	header.version = REOS_IMAGE_VERSION;
+	header.header_size = sizeof(ImageHeader);
+	header.inst_size = sizeof(ImageInst);
+	header.num_insts = num_insts;
+	strcpy(header.inst_set, inst_set);
+	header.num_captures = info->num_captures;
+	header.history_size = info->history_size;
+	header.max_length = info->max_length;
+	header.data_size = data_size;
+	header.hash = image_hash(image_header_hash(&header), (unsigned char *)data, data_size);
+
+	char tmp_path[strlen(path) + 5];
+	sprintf(tmp_path, "%s.tmp", path);
+
+	int ret = -1;
+	FILE *f = fopen(tmp_path, "wb");
+	if (f) {
+		if (fwrite(&header, sizeof(header), 1, f) == 1
+			&& fwrite(data, 1, data_size, f) == data_size)
+			ret = 0;
+		if (fclose(f))
+			ret = -1;
+
+		if (ret == 0 && rename(tmp_path, path))
+			ret = -1;
+		if (ret == -1)
+			unlink(tmp_path);
+	}
+
+	free(data);
+	if (ret == 0)
+		info->hash = header.hash;
+	return ret;
+}
+
+static ReOS_Inst *get_image_inst(ReOS_Pattern *pattern, int index)
+{
+	ImagePatternData *data = pattern->data;
+	if (index < 0 || index >= data->num_insts)
+		return 0;
+	return &data->insts[index];
+}
+
+static void set_image_inst(ReOS_Pattern *pattern, ReOS_Inst *inst, int index)
+{
+	fprintf(stderr, "error: image patterns are read-only\n");
+	exit(1);
+}
+
+/**
+ * Checks that a mapped image is one this build wrote for \a inst_set, and
+ * that its contents are intact.
+ */
+static int check_image(ImageHeader *header, long len, const char *inst_set)
+{
+	if (len < sizeof(ImageHeader) || memcmp(header->magic, IMAGE_MAGIC, sizeof(header->magic))
+		|| header->version != REOS_IMAGE_VERSION || header->header_size != sizeof(ImageHeader)
+		|| strncmp(header->inst_set, inst_set, sizeof(header->inst_set))
+		|| header->inst_size != sizeof(ImageInst) || header->num_insts < 0
+		|| header->data_size != len - (long)sizeof(ImageHeader)
+		|| (long)sizeof(ImageInst) * header->num_insts > header->data_size)
+		return 0;
+
+	char *data = (char *)(header + 1);
+	ImageInst *image_insts = (ImageInst *)data;
+	int pc;
+	for (pc = 0; pc < header->num_insts; pc++) {
+		ImageInst *inst = &image_insts[pc];
+		if (inst->args_offset != -1 && (inst->args_offset < 0 || inst->args_size < 0
+										|| inst->args_offset % IMAGE_ALIGN
+										|| inst->args_offset + inst->args_size > header->data_size))
+			return 0;
+	}
+
+	return image_hash(image_header_hash(header), (unsigned char *)data, header->data_size) == header->hash;
+}
+
+/**
+ * Loads a pattern image written by reos_pattern_write_image(). The image is
+ * mapped read-only and its instructions' args are used in place, so the
+ * pattern can't be changed, or run through passes that change it.
+ *
+ * \param inst_set The instruction set the kernel running the pattern
+ * executes, as named to reos_pattern_write_image()
+ * \param info Set to what was known about the pattern when it was written
+ * \return The pattern, to be freed with free_image_pattern(), or NULL if
+ * \a path isn't an intact image written by this build for \a inst_set
+ */
+ReOS_Pattern *new_image_pattern(const char *path, const char *inst_set, ReOS_PatternInfo *info)
+{
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+	if (fd == -1 || fstat(fd, &st) == -1) {
+		fprintf(stderr, "error: could not open %s\n", path);
+		if (fd != -1)
+			close(fd);
+		return 0;
+	}
+
+	void *map = 0;
+	if (st.st_size >= sizeof(ImageHeader))
+		map = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (map == MAP_FAILED || !map || !check_image(map, st.st_size, inst_set)) {
+		fprintf(stderr, "error: %s is not a ReOS pattern image\n", path);
+		if (map && map != MAP_FAILED)
+			munmap(map, st.st_size);
+		return 0;
+	}
+
+	ImageHeader *header = map;
+	ImageInst *image_insts = (ImageInst *)(header + 1);
+
+	ImagePatternData *data = reos_malloc(ReOS_MemPattern, sizeof(ImagePatternData));
+	data->map = map;
+	data->len = st.st_size;
+	data->num_insts = header->num_insts;
+	data->insts = reos_malloc(ReOS_MemPattern, sizeof(ReOS_Inst) * (header->num_insts + 1));
+
+	int pc;
+	for (pc = 0; pc < header->num_insts; pc++) {
+		data->insts[pc].opcode = image_insts[pc].opcode;
+		data->insts[pc].args = image_insts[pc].args_offset == -1
+			? 0 : (char *)image_insts + image_insts[pc].args_offset;
+	}
+
+	info->num_captures = header->num_captures;
+	info->history_size = header->history_size;
+	info->max_length = header->max_length;
+	info->hash = header->hash;
+
+	ReOS_Pattern *pattern = reos_malloc(ReOS_MemPattern, sizeof(ReOS_Pattern));
+	pattern->data = data;
+	pattern->get_inst = get_image_inst;
+	pattern->set_inst = set_image_inst;
+	return pattern;
+}
+
+void free_image_pattern(ReOS_Pattern *pattern)
+{
+	if (pattern) {
+		ImagePatternData *data = pattern->data;
+		munmap(data->map, data->len);
+		reos_free(ReOS_MemPattern, data->insts);
+		reos_free(ReOS_MemPattern, data);
+		reos_free(ReOS_MemPattern, pattern);
+	}
+}
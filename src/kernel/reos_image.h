@@ -0,0 +1,30 @@
+#ifndef REOS_IMAGE_H
+#define REOS_IMAGE_H
+
+#include "reos_types.h"
+
+/**
+ * The version of the pattern image format. Images of other versions are
+ * refused.
+ */
+#define REOS_IMAGE_VERSION 2
+
+/**
+ * The most characters in the name of an instruction set, as given to
+ * reos_pattern_write_image() and new_image_pattern().
+ */
+#define REOS_IMAGE_INST_SET_LEN 31
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int reos_pattern_write_image(ReOS_Pattern *, InstArgsSizeFunc, const char *, ReOS_PatternInfo *, const char *);
+ReOS_Pattern *new_image_pattern(const char *, const char *, ReOS_PatternInfo *);
+void free_image_pattern(ReOS_Pattern *);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -3,6 +3,7 @@
 // license that can be found in the LICENSE file.
 
 #include <assert.h>
+#include <string.h>
 #include "reos_debugger.h"
 #include "reos_kernel.h"
 #include "reos_stdlib.h"
@@ -18,13 +19,14 @@ static void swap_threadlists(ReOS_State *state)
 ReOS_Kernel *new_reos_kernel(ReOS_Pattern *pattern, ExecuteInstFunc execute_inst,
 				   int max_capturesets)
 {
-	ReOS_Kernel *k = calloc(1, sizeof(ReOS_Kernel));
+	ReOS_Kernel *k = reos_calloc(ReOS_MemOther, 1, sizeof(ReOS_Kernel));
 	k->pattern = pattern;
 	k->execute_inst = execute_inst;
 	k->free_captureset_list = new_reos_compoundlist(32, (VoidPtrFunc)delete_reos_captureset, 0);
 	k->free_thread_list = new_reos_compoundlist(32, (VoidPtrFunc)delete_reos_thread, 0);
 	k->debuggers = new_reos_simplelist(0);
 
+	k->pc = -1;
 	k->max_capturesets = max_capturesets;
 	k->matches = new_reos_simplelist((VoidPtrFunc)reos_captureset_deref);
 	k->next_backref_id = 1;
@@ -44,10 +46,29 @@ void free_reos_kernel(ReOS_Kernel *k)
 		free_reos_simplelist(k->debuggers);
 		free_reos_compoundlist(k->free_captureset_list);
 		free_reos_compoundlist(k->free_thread_list);
-		free(k);
+		reos_free(ReOS_MemOther, k);
 	}
 }
 
+/**
+ * Reports the memory the kernel's subsystems hold now, the most they have
+ * held, and how many allocations and frees they have made. The figures are
+ * for every kernel in the process together.
+ *
+ * \param stats Filled with the figures, or zeroed if there are none
+ * \return 1 if ReOS was built with REOS_MEMORY_STATS, 0 if it wasn't
+ */
+int reos_kernel_memory_stats(ReOS_MemoryStats *stats)
+{
+#ifdef REOS_MEMORY_STATS
+	reos_stats_get(stats);
+	return 1;
+#else
+	memset(stats, 0, sizeof(ReOS_MemoryStats));
+	return 0;
+#endif
+}
+
 void reos_kernel_free_memory_pools(ReOS_Kernel *k)
 {
 	assert(free_reos_compoundlist(k->free_captureset_list) == 0);
@@ -56,6 +77,19 @@ void reos_kernel_free_memory_pools(ReOS_Kernel *k)
 	k->free_thread_list = new_reos_compoundlist(32, (VoidPtrFunc)delete_reos_thread, 0);
 }
 
+/**
+ * Drops the matches of the last run, so that \a k can run again and report
+ * only its own.
+ */
+void reos_kernel_clear_matches(ReOS_Kernel *k)
+{
+	if (reos_simplelist_has_next(k->matches)) {
+		free_reos_simplelist(k->matches);
+		k->matches = new_reos_simplelist((VoidPtrFunc)reos_captureset_deref);
+	}
+	k->num_capturesets = 0;
+}
+
 int reos_kernel_save_captureset(ReOS_Kernel *k, ReOS_CaptureSet *capture_set)
 {
 	if (k->max_capturesets == -1 || k->num_capturesets < k->max_capturesets) {
@@ -65,18 +99,64 @@ int reos_kernel_save_captureset(ReOS_Kernel *k, ReOS_CaptureSet *capture_set)
 		capture_set = reos_captureset_detach(capture_set);
 
 		reos_simplelist_push_tail(k->matches, capture_set);
+
+		foreach_simple(ReOS_Debugger, debugger, k->debuggers) {
+			if (debugger->match)
+				debugger->match(debugger, k);
+		}
 	}
 
 	return 0;
 }
 
+static void debug_spawn(ReOS_Kernel *k, int pc)
+{
+	foreach_simple(ReOS_Debugger, debugger, k->debuggers) {
+		if (debugger->spawn)
+			debugger->spawn(debugger, k, pc);
+	}
+}
+
+static void debug_drop(ReOS_Kernel *k, int pc)
+{
+	foreach_simple(ReOS_Debugger, debugger, k->debuggers) {
+		if (debugger->drop)
+			debugger->drop(debugger, k, pc);
+	}
+}
+
+static void debug_reject(ReOS_Kernel *k, int pc)
+{
+	foreach_simple(ReOS_Debugger, debugger, k->debuggers) {
+		if (debugger->reject)
+			debugger->reject(debugger, k, pc);
+	}
+}
+
+static void debug_detach(ReOS_Kernel *k, int pc)
+{
+	foreach_simple(ReOS_Debugger, debugger, k->debuggers) {
+		if (debugger->detach)
+			debugger->detach(debugger, k, pc);
+	}
+}
+
+static void debug_branch(ReOS_Kernel *k, int pc)
+{
+	foreach_simple(ReOS_Debugger, debugger, k->debuggers) {
+		if (debugger->branch)
+			debugger->branch(debugger, k, pc);
+	}
+}
+
 static void push_threadlist(ReOS_Kernel *k, ReOS_ThreadList *threadlist,
 								   ReOS_Thread *thread, int backtrack)
 {
-	if (k->pattern->get_inst(k->pattern, thread->pc))
-		reos_threadlist_push_tail(threadlist, thread, backtrack);
-	else
+	int pc = thread->pc;
+	if (!k->pattern->get_inst(k->pattern, pc))
 		free_reos_thread(thread);
+	else if (!reos_threadlist_push_tail(threadlist, thread, backtrack))
+		debug_reject(k, pc);
 }
 
 void reos_kernel_push_current_threadlist(ReOS_Kernel *k, ReOS_Thread *thread, int backtrack)
@@ -84,6 +164,52 @@ void reos_kernel_push_current_threadlist(ReOS_Kernel *k, ReOS_Thread *thread, in
 	push_threadlist(k, k->state.current_thread_list, thread, backtrack);
 }
 
+/**
+ * Pushes \a thread onto the head of the current thread list, so that it runs
+ * next. Instructions that fork, like split, use this to keep their threads in
+ * priority order.
+ */
+void reos_kernel_push_current_threadlist_head(ReOS_Kernel *k, ReOS_Thread *thread, int backtrack)
+{
+	int pc = thread->pc;
+	if (!reos_threadlist_push_head(k->state.current_thread_list, thread, backtrack))
+		debug_reject(k, pc);
+}
+
+/**
+ * Clones \a thread for an instruction that forks it.
+ */
+ReOS_Thread *reos_kernel_clone_thread(ReOS_Kernel *k, ReOS_Thread *thread)
+{
+	debug_spawn(k, k->pc);
+	return reos_thread_clone(thread);
+}
+
+/**
+ * Saves the current input position as the start of a thread's capture, or
+ * as its end if \a end is set. A capture set the thread shares is copied
+ * first.
+ */
+void reos_kernel_save_capture(ReOS_Kernel *k, ReOS_Thread *thread, int capture_num, int end)
+{
+	if (thread->capture_set->refs > 1)
+		debug_detach(k, k->pc);
+
+	if (end)
+		reos_captureset_save_end(&thread->capture_set, capture_num, k->sp);
+	else
+		reos_captureset_save_start(&thread->capture_set, capture_num, k->sp);
+}
+
+/**
+ * Creates a lookahead branch for an instruction that starts one.
+ */
+ReOS_Branch *reos_kernel_new_branch(ReOS_Kernel *k, int neg)
+{
+	debug_branch(k, k->pc);
+	return new_reos_branch(neg);
+}
+
 void reos_kernel_push_next_threadlist(ReOS_Kernel *k, ReOS_Thread *thread, int backtrack)
 {
 	push_threadlist(k, k->state.next_thread_list, thread, backtrack);
@@ -91,6 +217,8 @@ void reos_kernel_push_next_threadlist(ReOS_Kernel *k, ReOS_Thread *thread, int b
 
 int reos_kernel_step_instruction(ReOS_Kernel *k, ReOS_Thread *thread, ReOS_Inst *inst, int ops)
 {
+	int pc = thread->pc;
+	k->pc = pc;
 	int inst_ret = k->execute_inst(k, thread, inst, ops);
 
 	if (inst_ret & ReOS_InstRetMatch)
@@ -111,8 +239,10 @@ int reos_kernel_step_instruction(ReOS_Kernel *k, ReOS_Thread *thread, ReOS_Inst
 		reos_kernel_push_current_threadlist(k, thread, (inst_ret & ReOS_InstRetBacktrack) ? 1 : 0);
 	}
 
-	if (inst_ret & ReOS_InstRetDrop)
+	if (inst_ret & ReOS_InstRetDrop) {
+		debug_drop(k, pc);
 		free_reos_thread(thread);
+	}
 	return inst_ret;
 }
 
@@ -127,6 +257,8 @@ int reos_kernel_step_token(ReOS_Kernel *k, int ops)
 
 	int inst_ret = ReOS_InstRetDrop;
 	k->current_token = reos_tokenbuffer_read(k->token_buf);
+	if (k->token_buf->history && k->current_token)
+		reos_tokenbuffer_remember(k->token_buf, k->sp, k->current_token);
 
 	while (reos_compoundlist_has_next(k->state.current_thread_list->list)) {
 		foreach_simple(ReOS_Debugger, bi_debugger, k->debuggers) {
@@ -155,14 +287,17 @@ int reos_kernel_step_token(ReOS_Kernel *k, int ops)
 			at_debugger->after_token(at_debugger, k);
 	}
 
+	// between tokens the kernel isn't running any instruction
+	k->pc = -1;
 	k->sp++;
 	return inst_ret;
 }
 
-int reos_kernel_execute(ReOS_Kernel *k, ReOS_Input *input, int start_offset, int ops)
+int reos_kernel_execute(ReOS_Kernel *k, ReOS_Input *input, long start_offset, int ops)
 {
 	free_reos_tokenbuffer(k->token_buf);
 	k->token_buf = new_reos_tokenbuffer(input);
+	reos_tokenbuffer_set_history(k->token_buf, k->history_size);
 
 	if (ops & REOS_BACKTRACK_MATCHING) {
 		k->state.current_thread_list->backtrack_captures = 1;
@@ -200,5 +335,8 @@ void reos_kernel_bootstrap(ReOS_Kernel *k, int pc)
 {
 	ReOS_Thread *start_thread = new_reos_thread(k->free_thread_list, pc);
 	start_thread->capture_set = new_reos_captureset(k->free_captureset_list);
-	reos_threadlist_push_tail(k->state.next_thread_list, start_thread, 0);
+	debug_spawn(k, pc);
+
+	if (!reos_threadlist_push_tail(k->state.next_thread_list, start_thread, 0))
+		debug_reject(k, pc);
 }
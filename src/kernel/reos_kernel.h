@@ -18,11 +18,17 @@ extern "C" {
 ReOS_Kernel *new_reos_kernel(ReOS_Pattern *, ExecuteInstFunc, int);
 void free_reos_kernel(ReOS_Kernel *);
 void reos_kernel_clear_memory_pools(ReOS_Kernel *);
+void reos_kernel_clear_matches(ReOS_Kernel *);
 void reos_kernel_process_inst_ret(ReOS_Kernel *, ReOS_Thread *, int);
-int reos_kernel_execute(ReOS_Kernel *, ReOS_Input *, int, int);
+int reos_kernel_execute(ReOS_Kernel *, ReOS_Input *, long, int);
 void reos_kernel_bootstrap(ReOS_Kernel *, int);
 void reos_kernel_push_current_threadlist(ReOS_Kernel *, ReOS_Thread *, int);
 void reos_kernel_push_next_threadlist(ReOS_Kernel *, ReOS_Thread *, int);
+void reos_kernel_push_current_threadlist_head(ReOS_Kernel *, ReOS_Thread *, int);
+ReOS_Thread *reos_kernel_clone_thread(ReOS_Kernel *, ReOS_Thread *);
+void reos_kernel_save_capture(ReOS_Kernel *, ReOS_Thread *, int, int);
+ReOS_Branch *reos_kernel_new_branch(ReOS_Kernel *, int);
+int reos_kernel_memory_stats(ReOS_MemoryStats *);
 
 #ifdef __cplusplus
 }
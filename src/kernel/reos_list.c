@@ -115,7 +115,7 @@ static ReOS_JudyListImpl *new_reos_judylistimpl(VoidPtrFunc, VoidPtrFunc, CloneF
  */
 ReOS_SimpleList *new_reos_simplelist(VoidPtrFunc destructor)
 {
-	ReOS_SimpleList *l = malloc(sizeof(ReOS_SimpleList));
+	ReOS_SimpleList *l = reos_malloc(ReOS_MemListNodes, sizeof(ReOS_SimpleList));
 	l->head = 0;
 	l->tail = 0;
 	l->free_head = 0;
@@ -146,13 +146,13 @@ void free_reos_simplelist(ReOS_SimpleList *l)
 			free_reos_simplelistnode(prev, 0);
 		}
 
-		free(l);
+		reos_free(ReOS_MemListNodes, l);
 	}
 }
 
 static ReOS_SimpleListNode *new_reos_simplelistnode()
 {
-	ReOS_SimpleListNode *n = malloc(sizeof(ReOS_SimpleListNode));
+	ReOS_SimpleListNode *n = reos_malloc(ReOS_MemListNodes, sizeof(ReOS_SimpleListNode));
 	n->next = 0;
 	n->prev = 0;
 	return n;
@@ -163,7 +163,7 @@ static void free_reos_simplelistnode(ReOS_SimpleListNode *n, VoidPtrFunc destruc
 	if (n) {
 		if (destructor)
 			destructor(n->data);
-		free(n);
+		reos_free(ReOS_MemListNodes, n);
 	}
 }
 
@@ -395,7 +395,7 @@ void *reos_simplelistiter_peek_next(ReOS_SimpleListIter *iter)
 ReOS_CompoundList *new_reos_compoundlist(int len, VoidPtrFunc destructor,
 							CloneFunc clone_element)
 {
-	ReOS_CompoundList *l = malloc(sizeof(ReOS_CompoundList));
+	ReOS_CompoundList *l = reos_malloc(ReOS_MemListNodes, sizeof(ReOS_CompoundList));
 	l->impl = new_reos_compoundlistimpl(len, destructor, clone_element);
 	return l;
 }
@@ -404,7 +404,7 @@ static ReOS_CompoundListImpl *new_reos_compoundlistimpl_no_head(int len,
 								VoidPtrFunc destructor,
 								 CloneFunc clone_element)
 {
-	ReOS_CompoundListImpl *impl = malloc(sizeof(ReOS_CompoundListImpl));
+	ReOS_CompoundListImpl *impl = reos_malloc(ReOS_MemListNodes, sizeof(ReOS_CompoundListImpl));
 	impl->refs = 1;
 	impl->head = 0;
 	impl->tail = 0;
@@ -438,7 +438,7 @@ static ReOS_CompoundListNode *new_reos_compoundlistnode(int max_len)
 static ReOS_CompoundListNode *new_reos_compoundlistnode()
 #endif
 {
-	ReOS_CompoundListNode *node = malloc(sizeof(ReOS_CompoundListNode));
+	ReOS_CompoundListNode *node = reos_malloc(ReOS_MemListNodes, sizeof(ReOS_CompoundListNode));
 	node->pos = 0;
 	node->len = 0;
 #ifdef OPTIMIZE_FOR_SIZE
@@ -452,7 +452,7 @@ static ReOS_CompoundListNode *new_reos_compoundlistnode()
 #else
 		requested_size = CACHE_LINE_SIZE;
 #endif
-		node->array = malloc(requested_size);
+		node->array = reos_malloc(ReOS_MemListNodes, requested_size);
 
 #ifdef OPTIMIZE_FOR_SIZE
 	} while (!node->array && (max_len/=2) > 0);
@@ -476,7 +476,7 @@ static ReOS_CompoundListNode *new_reos_compoundlistnode()
 #ifndef NDEBUG
 	// technically unnecessary, but shuts valgrind up
 	if (available_size > requested_size)
-		node->array = realloc(node->array, available_size);
+		node->array = reos_realloc(ReOS_MemListNodes, node->array, available_size);
 #endif
 #endif
 
@@ -503,7 +503,7 @@ int free_reos_compoundlist(ReOS_CompoundList *l)
 
 		impl->refs--;
 		if (impl->refs > 0) {
-			free(l);
+			reos_free(ReOS_MemListNodes, l);
 			return impl->refs;
 		}
 
@@ -524,8 +524,8 @@ int free_reos_compoundlist(ReOS_CompoundList *l)
 			free_reos_compoundlistnode(prev, 0);
 		}
 
-		free(impl);
-		free(l);
+		reos_free(ReOS_MemListNodes, impl);
+		reos_free(ReOS_MemListNodes, l);
 	}
 
 	return 0;
@@ -540,8 +540,8 @@ static void free_reos_compoundlistnode(ReOS_CompoundListNode *node, VoidPtrFunc
 				destructor(node->array[i]);
 		}
 
-		free(node->array);
-		free(node);
+		reos_free(ReOS_MemListNodes, node->array);
+		reos_free(ReOS_MemListNodes, node);
 	}
 }
 
@@ -558,7 +558,7 @@ static void free_reos_compoundlistnode(ReOS_CompoundListNode *node, VoidPtrFunc
  */
 ReOS_CompoundList *reos_compoundlist_clone(ReOS_CompoundList *l)
 {
-	ReOS_CompoundList *clone = malloc(sizeof(ReOS_CompoundList));
+	ReOS_CompoundList *clone = reos_malloc(ReOS_MemListNodes, sizeof(ReOS_CompoundList));
 	if (l->impl->refs != -1) {
 		clone->impl = l->impl;
 		clone->impl->refs++;
@@ -573,7 +573,7 @@ ReOS_CompoundList *reos_compoundlist_clone(ReOS_CompoundList *l)
 
 ReOS_CompoundList *reos_compoundlist_clone_with_func(ReOS_CompoundList *l, CloneFunc func)
 {
-	ReOS_CompoundList *clone = malloc(sizeof(ReOS_CompoundList));
+	ReOS_CompoundList *clone = reos_malloc(ReOS_MemListNodes, sizeof(ReOS_CompoundList));
 	if (l->impl->refs != -1) {
 		clone->impl = l->impl;
 		clone->impl->refs++;
@@ -1039,7 +1039,7 @@ void *reos_compoundlistiter_peek_next(ReOS_CompoundListIter *iter)
 ReOS_JudyList *new_reos_judylist(VoidPtrFunc destructor, VoidPtrFunc deref_element,
 					   CloneFunc clone_element, VoidPtrFunc ref_element)
 {
-	ReOS_JudyList *l = malloc(sizeof(ReOS_JudyList));
+	ReOS_JudyList *l = reos_malloc(ReOS_MemJudy, sizeof(ReOS_JudyList));
 	l->impl = new_reos_judylistimpl(destructor, deref_element, clone_element,
 							   ref_element);
 	return l;
@@ -1050,7 +1050,7 @@ static ReOS_JudyListImpl *new_reos_judylistimpl(VoidPtrFunc destructor,
 									  CloneFunc clone_element,
 									  VoidPtrFunc ref_element)
 {
-	ReOS_JudyListImpl *impl = malloc(sizeof(ReOS_JudyListImpl));
+	ReOS_JudyListImpl *impl = reos_malloc(ReOS_MemJudy, sizeof(ReOS_JudyListImpl));
 	impl->judy = 0;
 	impl->refs = 1;
 	impl->destructor = destructor;
@@ -1068,14 +1068,14 @@ int free_reos_judylist(ReOS_JudyList *l)
 		impl->refs--;
 		if (impl->refs > 0) {
 			reos_judylist_deref_elements(l);
-			free(l);
+			reos_free(ReOS_MemJudy, l);
 
 			return impl->refs;
 		}
 
 		free_judy(l->impl->judy, l->impl->destructor);
-		free(l->impl);
-		free(l);
+		reos_free(ReOS_MemJudy, l->impl);
+		reos_free(ReOS_MemJudy, l);
 	}
 
 	return 0;
@@ -1100,7 +1100,7 @@ void free_judy(void *list, VoidPtrFunc destructor)
 	}
 
 	Word_t rc;
-	JLFA(rc, list);
+	judy_account(list, JLFA(rc, list))
 }
 
 void reos_judylist_ref_elements(ReOS_JudyList *l)
@@ -1121,7 +1121,7 @@ void reos_judylist_deref_elements(ReOS_JudyList *l)
 
 ReOS_JudyList *reos_judylist_clone(ReOS_JudyList *l)
 {
-	ReOS_JudyList *clone = malloc(sizeof(ReOS_JudyList));
+	ReOS_JudyList *clone = reos_malloc(ReOS_MemJudy, sizeof(ReOS_JudyList));
 	clone->impl = l->impl;
 	clone->impl->refs++;
 
@@ -94,8 +94,11 @@ void free_judy(void *, VoidPtrFunc);
 void reos_judylist_ref_elements(ReOS_JudyList *);
 void reos_judylist_deref_elements(ReOS_JudyList *);
 ReOS_JudyList *reos_judylist_clone(ReOS_JudyList *);
-// exported because it's used in the macros above
+// exported because they're used in the macros above
 ReOS_JudyListImpl *reos_judylistimpl_clone(ReOS_JudyListImpl *);
+#ifdef REOS_MEMORY_STATS
+void reos_stats_judy(long, long);
+#endif
 
 void reos_judylist_push_tail(ReOS_JudyList *, void *);
 void *reos_judylist_pop_tail(ReOS_JudyList *);
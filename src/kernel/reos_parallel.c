@@ -0,0 +1,433 @@
+#include <assert.h>
+#include <Judy.h>
+#include <limits.h>
+#include <pthread.h>
+#include <string.h>
+#include "reos_capture.h"
+#include "reos_debugger.h"
+#include "reos_kernel.h"
+#include "reos_parallel.h"
+#include "reos_stdlib.h"
+#include "reos_thread.h"
+
+/**
+ * \file
+ *
+ * Runs one pattern over one large input on several cores, by splitting the
+ * input into chunks and running a kernel per chunk. Each kernel starts at the
+ * beginning of its chunk as though it were the beginning of the input, and
+ * runs past the end of its chunk into the next.
+ *
+ * The kernel of the first chunk is right about everything it sees. The
+ * kernel of every other chunk is missing the threads of matches that began
+ * before its chunk, and those can change which of its own threads survive,
+ * so it is only right from the point at which its state is identical to that
+ * of the kernel before it. Everything a kernel does depends only on its
+ * thread list and the input from there on, so from that point on the two
+ * kernels would find exactly the same matches.
+ *
+ * To find that point, every kernel takes a snapshot of its thread list every
+ * REOS_PARALLEL_CHECKPOINT_INTERVAL tokens, for a window at the start of its
+ * chunk (the head) and the same window past its end (the tail). Running past
+ * the end of its chunk, a kernel stops as soon as one of its tail snapshots
+ * is identical to the head snapshot of the next chunk at the same index.
+ * Tails that end before the next kernel got that far are compared once all
+ * kernels are done. The matches of each chunk are then taken from the point
+ * at which it took over to the point at which the next one did, which puts
+ * them in the same order as a single kernel would find them.
+ *
+ * Threads of patterns with a maximum match length only live that long, so
+ * the window only has to be a little longer than that. For other patterns,
+ * if no pair of snapshots in the window is identical, the whole input is run
+ * on a single kernel. Patterns whose threads carry state that isn't
+ * snapshotted, such as those with backreferences or lookaround, always are.
+ */
+
+typedef struct ParallelSnapshots ParallelSnapshots;
+typedef struct ParallelChunk ParallelChunk;
+typedef struct ParallelScan ParallelScan;
+
+/**
+ * A list of thread list snapshots, stored back to back in \c data, with the
+ * offset of each in \c offsets. Snapshot \c n was taken
+ * REOS_PARALLEL_CHECKPOINT_INTERVAL * \c n tokens into the window.
+ */
+struct ParallelSnapshots
+{
+	long *data;
+	long len;
+	long max_len;
+
+	long *offsets;
+	int count;
+	int max_count;
+};
+
+struct ParallelChunk
+{
+	long start;
+	long end;
+	long window; //!< Tokens in the head and tail windows
+	int last;
+
+	ParallelSnapshots head;
+	ParallelSnapshots tail;
+	pthread_mutex_t lock; //!< Guards \c head, which the previous chunk reads
+
+	ParallelChunk *next;
+	long handoff; //!< Index at which \c next took over, or -1 if it hasn't yet
+	int halt;
+
+	ExecuteInstFunc execute_inst;
+	ReOS_Kernel *k;
+
+	long *match_ends; //!< Index at which each of \c k's matches was found
+	long num_matches;
+	long max_matches;
+};
+
+struct ParallelScan
+{
+	ReOS_Kernel *k;
+	ReOS_InputFactory *factory;
+	int ops;
+
+	ParallelChunk *chunks;
+	int num_chunks;
+	int next_chunk;
+	pthread_mutex_t lock;
+};
+
+static void snapshots_push_value(ParallelSnapshots *s, long value)
+{
+	if (s->len == s->max_len) {
+		s->max_len = s->max_len ? s->max_len * 2 : 256;
+		s->data = reos_realloc(ReOS_MemOther, s->data, sizeof(long) * s->max_len);
+	}
+	s->data[s->len++] = value;
+}
+
+/**
+ * Appends a snapshot of the threads about to run on the current token: their
+ * pcs and captures, and which of them share capture sets, since threads are
+ * told apart by capture set identity when backtrack matching.
+ */
+static void snapshots_push(ParallelSnapshots *s, ReOS_Kernel *k)
+{
+	if (s->count == s->max_count) {
+		s->max_count = s->max_count ? s->max_count * 2 : 16;
+		s->offsets = reos_realloc(ReOS_MemOther, s->offsets, sizeof(long) * s->max_count);
+	}
+	s->offsets[s->count] = s->len;
+
+	long n = 0;
+	foreach_compound(ReOS_Thread, thread, k->state.current_thread_list->list) {
+		snapshots_push_value(s, thread->pc);
+
+		long shared = -1, i = 0;
+		foreach_compound(ReOS_Thread, other, k->state.current_thread_list->list) {
+			if (i == n)
+				break;
+			if (other->capture_set == thread->capture_set) {
+				shared = i;
+				break;
+			}
+			i++;
+		}
+		snapshots_push_value(s, shared);
+
+		ReOS_CaptureSet *capture_set = thread->capture_set;
+		if (capture_set && capture_set->captures) {
+			reos_judylist_iter_begin(ReOS_CompoundList, capture_list, capture_set->captures) {
+				snapshots_push_value(s, iter_capture_list);
+				snapshots_push_value(s, reos_compoundlist_length(capture_list));
+				foreach_compound(ReOS_Capture, cap, capture_list) {
+					snapshots_push_value(s, cap->start);
+					snapshots_push_value(s, cap->end);
+					snapshots_push_value(s, cap->partial);
+				}
+				reos_judylist_iter_next(capture_list, capture_set->captures);
+			}
+		}
+		snapshots_push_value(s, -1);
+		n++;
+	}
+
+	s->count++;
+}
+
+static int snapshots_equal(ParallelSnapshots *a, int i, ParallelSnapshots *b, int j)
+{
+	long a_len = (i + 1 < a->count ? a->offsets[i + 1] : a->len) - a->offsets[i];
+	long b_len = (j + 1 < b->count ? b->offsets[j + 1] : b->len) - b->offsets[j];
+	return a_len == b_len
+		&& !memcmp(&a->data[a->offsets[i]], &b->data[b->offsets[j]], sizeof(long) * a_len);
+}
+
+static void free_snapshots(ParallelSnapshots *s)
+{
+	reos_free(ReOS_MemOther, s->data);
+	reos_free(ReOS_MemOther, s->offsets);
+}
+
+/**
+ * Takes snapshots of a chunk's kernel before each token inside its windows,
+ * and stops it once the next chunk's kernel has taken over or the tail window
+ * is over.
+ */
+static void parallel_debugger_before_token(ReOS_Debugger *debugger, ReOS_Kernel *k)
+{
+	ParallelChunk *c = (ParallelChunk *)debugger->data;
+
+	if (k->sp < c->start + c->window) {
+		if (c->start && (k->sp - c->start) % REOS_PARALLEL_CHECKPOINT_INTERVAL == 0) {
+			pthread_mutex_lock(&c->lock);
+			snapshots_push(&c->head, k);
+			pthread_mutex_unlock(&c->lock);
+		}
+	}
+
+	if (c->last || k->sp < c->end || (k->sp - c->end) % REOS_PARALLEL_CHECKPOINT_INTERVAL)
+		return;
+
+	if (k->sp >= c->end + c->window) {
+		c->halt = 1;
+		return;
+	}
+
+	snapshots_push(&c->tail, k);
+
+	ParallelChunk *next = c->next;
+	pthread_mutex_lock(&next->lock);
+	if (next->head.count >= c->tail.count
+			&& snapshots_equal(&c->tail, c->tail.count - 1, &next->head, c->tail.count - 1)) {
+		c->handoff = k->sp;
+		c->halt = 1;
+	}
+	pthread_mutex_unlock(&next->lock);
+}
+
+/**
+ * Wraps the instruction set's ExecuteInstFunc, to stop the kernel when the
+ * debugger says so and to note where matches are found.
+ */
+static int parallel_execute_inst(ReOS_Kernel *k, ReOS_Thread *thread, ReOS_Inst *inst, int ops)
+{
+	ParallelChunk *c = (ParallelChunk *)k->data;
+	if (c->halt) {
+		free_reos_thread(thread);
+		return ReOS_InstRetHalt;
+	}
+
+	int inst_ret = c->execute_inst(k, thread, inst, ops);
+
+	// the same conditions under which reos_kernel_step_instruction() saves a
+	// match
+	if ((inst_ret & ReOS_InstRetMatch) || ((inst_ret & ReOS_InstRetDrop)
+			&& (ops & REOS_PARTIAL) && (k->current_token == 0))) {
+		if (c->num_matches == c->max_matches) {
+			c->max_matches = c->max_matches ? c->max_matches * 2 : 64;
+			c->match_ends = reos_realloc(ReOS_MemOther, c->match_ends, sizeof(long) * c->max_matches);
+		}
+		c->match_ends[c->num_matches++] = k->sp;
+	}
+
+	return inst_ret;
+}
+
+static void run_chunk(ParallelScan *scan, ParallelChunk *c)
+{
+	c->execute_inst = scan->k->execute_inst;
+	c->k = new_reos_kernel(scan->k->pattern, parallel_execute_inst, -1);
+	c->k->test_backref = scan->k->test_backref;
+	c->k->history_size = scan->k->history_size;
+	c->k->data = c;
+
+	ReOS_Debugger *debugger = reos_calloc(ReOS_MemOther, 1, sizeof(ReOS_Debugger));
+	debugger->before_token = parallel_debugger_before_token;
+	debugger->data = c;
+	reos_simplelist_push_tail(c->k->debuggers, debugger);
+
+	ReOS_Input *input = scan->factory->open(scan->factory->data);
+	reos_kernel_execute(c->k, input, c->start, scan->ops);
+
+	reos_free(ReOS_MemOther, debugger);
+	free_reos_tokenbuffer(c->k->token_buf);
+	c->k->token_buf = 0;
+	scan->factory->close(input);
+}
+
+static void *parallel_worker(void *d)
+{
+	ParallelScan *scan = (ParallelScan *)d;
+	for (;;) {
+		pthread_mutex_lock(&scan->lock);
+		int i = scan->next_chunk < scan->num_chunks ? scan->next_chunk++ : -1;
+		pthread_mutex_unlock(&scan->lock);
+
+		if (i == -1)
+			return 0;
+		run_chunk(scan, &scan->chunks[i]);
+	}
+}
+
+/**
+ * Finds where \a c hands off to the next chunk, if its kernel stopped before
+ * the next one had taken the snapshot it needed.
+ *
+ * \return True if there is such a point within the window
+ */
+static int find_handoff(ParallelChunk *c)
+{
+	if (c->last || c->handoff != -1)
+		return 1;
+
+	int i;
+	for (i = 0; i < c->tail.count && i < c->next->head.count; i++) {
+		if (snapshots_equal(&c->tail, i, &c->next->head, i)) {
+			c->handoff = c->end + i * REOS_PARALLEL_CHECKPOINT_INTERVAL;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Moves every chunk's matches found between the point at which it took over
+ * and the point at which the next chunk did into \c scan->k->matches.
+ */
+static void merge_matches(ParallelScan *scan)
+{
+	ReOS_Kernel *k = scan->k;
+
+	int i;
+	for (i = 0; i < scan->num_chunks; i++) {
+		ParallelChunk *c = &scan->chunks[i];
+		long from = i ? scan->chunks[i - 1].handoff : LONG_MIN;
+		long to = c->last ? LONG_MAX : c->handoff;
+
+		long num = 0;
+		foreach_simple(ReOS_CaptureSet, capture_set, c->k->matches) {
+			assert(num < c->num_matches);
+			long end = c->match_ends[num++];
+
+			// the chunk's kernel is about to be freed, and its free list with it
+			capture_set->free_list = k->free_captureset_list;
+
+			if (end >= from && end < to
+					&& (k->max_capturesets == -1 || k->num_capturesets < k->max_capturesets)) {
+				k->num_capturesets++;
+				reos_simplelist_push_tail(k->matches, capture_set);
+			}
+			else
+				reos_captureset_deref(capture_set);
+		}
+
+		// the capture sets have all been handed over
+		c->k->matches->destructor = 0;
+	}
+}
+
+static int execute_sequential(ReOS_Kernel *k, ReOS_InputFactory *factory, int ops)
+{
+	ReOS_Input *input = factory->open(factory->data);
+	reos_kernel_execute(k, input, 0, ops);
+
+	free_reos_tokenbuffer(k->token_buf);
+	k->token_buf = 0;
+	factory->close(input);
+	return k->num_capturesets;
+}
+
+/**
+ * Runs \a k over an input on several threads, appending the same matches to
+ * \c k->matches, in the same order, as reos_kernel_execute() would starting
+ * at index 0. Each thread matches against its own input opened by \a factory.
+ *
+ * Debuggers attached to \a k aren't run. Since \a k is left without an input,
+ * captures have to be reconstructed from an input the caller opens.
+ *
+ * \param length The length of the input in tokens
+ * \param max_length The longest match of \c k->pattern, as returned by an
+ * analysis such as standard_pattern_max_length()
+ * \param num_workers How many threads to run kernels on
+ * \return The number of matches in \c k->matches
+ */
+int reos_kernel_execute_parallel(ReOS_Kernel *k, ReOS_InputFactory *factory, long length,
+								 long max_length, int num_workers, int ops)
+{
+	long num_chunks = num_workers * REOS_PARALLEL_CHUNKS_PER_WORKER;
+	if (num_chunks > length / REOS_PARALLEL_MIN_CHUNK_SIZE)
+		num_chunks = length / REOS_PARALLEL_MIN_CHUNK_SIZE;
+
+	if (num_chunks < 2 || max_length == REOS_LENGTH_UNKNOWN || (ops & REOS_ANCHORED))
+		return execute_sequential(k, factory, ops);
+
+	// give threads of bounded patterns time to die out, and have at least a
+	// couple of checkpoints in the window either way
+	long window = REOS_PARALLEL_WINDOW_SIZE;
+	if (max_length >= 0 && 2 * (max_length + 1) + 2 * REOS_PARALLEL_CHECKPOINT_INTERVAL < window)
+		window = 2 * (max_length + 1) + 2 * REOS_PARALLEL_CHECKPOINT_INTERVAL;
+	if (window > length / num_chunks)
+		window = length / num_chunks;
+
+	ParallelScan scan;
+	scan.k = k;
+	scan.factory = factory;
+	scan.ops = ops;
+	scan.chunks = reos_calloc(ReOS_MemOther, num_chunks, sizeof(ParallelChunk));
+	scan.num_chunks = num_chunks;
+	scan.next_chunk = 0;
+	pthread_mutex_init(&scan.lock, 0);
+
+	int i;
+	for (i = 0; i < num_chunks; i++) {
+		ParallelChunk *c = &scan.chunks[i];
+		c->start = length * i / num_chunks;
+		c->end = length * (i + 1) / num_chunks;
+		c->window = window;
+		c->last = (i == num_chunks - 1);
+		c->next = c->last ? 0 : &scan.chunks[i + 1];
+		c->handoff = -1;
+		pthread_mutex_init(&c->lock, 0);
+	}
+
+	if (num_workers > num_chunks)
+		num_workers = num_chunks;
+
+	// chunks never wait on each other, so if a worker can't be started the
+	// calling thread runs what the others leave
+	pthread_t workers[num_workers];
+	int num_started;
+	for (num_started = 0; num_started < num_workers; num_started++) {
+		if (pthread_create(&workers[num_started], 0, parallel_worker, &scan))
+			break;
+	}
+	if (num_started < num_workers)
+		parallel_worker(&scan);
+	for (i = 0; i < num_started; i++)
+		pthread_join(workers[i], 0);
+
+	int split = 1;
+	for (i = 0; i < num_chunks; i++)
+		split &= find_handoff(&scan.chunks[i]);
+
+	if (split)
+		merge_matches(&scan);
+
+	for (i = 0; i < num_chunks; i++) {
+		ParallelChunk *c = &scan.chunks[i];
+		free_reos_kernel(c->k);
+		free_snapshots(&c->head);
+		free_snapshots(&c->tail);
+		reos_free(ReOS_MemOther, c->match_ends);
+		pthread_mutex_destroy(&c->lock);
+	}
+
+	pthread_mutex_destroy(&scan.lock);
+	reos_free(ReOS_MemOther, scan.chunks);
+
+	if (!split)
+		return execute_sequential(k, factory, ops);
+	return k->num_capturesets;
+}
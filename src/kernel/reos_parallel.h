@@ -0,0 +1,39 @@
+#ifndef REOS_PARALLEL_H
+#define REOS_PARALLEL_H
+
+#include "reos_types.h"
+
+/**
+ * Chunks queued per worker, so that workers that finish early can pick up
+ * some of the slack of the others.
+ */
+#define REOS_PARALLEL_CHUNKS_PER_WORKER 4
+
+/**
+ * Inputs shorter than this many tokens per chunk aren't worth splitting.
+ */
+#define REOS_PARALLEL_MIN_CHUNK_SIZE (1 << 16)
+
+/**
+ * How far a kernel may run past the end of its chunk, looking for a point at
+ * which the next chunk's kernel can take over, for patterns without a maximum
+ * match length.
+ */
+#define REOS_PARALLEL_WINDOW_SIZE (1 << 16)
+
+/**
+ * Tokens between the points at which kernels compare their states.
+ */
+#define REOS_PARALLEL_CHECKPOINT_INTERVAL 64
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int reos_kernel_execute_parallel(ReOS_Kernel *, ReOS_InputFactory *, long, long, int, int);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
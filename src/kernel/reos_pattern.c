@@ -5,8 +5,8 @@
 
 void free_reos_inst(ReOS_Inst *inst)
 {
-	free(inst->args);
-	free(inst);
+	reos_free(ReOS_MemPattern, inst->args);
+	reos_free(ReOS_MemPattern, inst);
 }
 
 ReOS_Inst *get_mem_inst(ReOS_Pattern *pattern, int index)
@@ -23,7 +23,7 @@ void set_mem_inst(ReOS_Pattern *pattern, ReOS_Inst *inst, int index)
 
 ReOS_Pattern *new_mem_pattern()
 {
-	ReOS_Pattern *a = malloc(sizeof(ReOS_Pattern));
+	ReOS_Pattern *a = reos_malloc(ReOS_MemPattern, sizeof(ReOS_Pattern));
 	a->data = 0;
 
 	a->get_inst = get_mem_inst;
@@ -35,6 +35,6 @@ void free_mem_pattern(ReOS_Pattern *a)
 {
 	if (a) {
 		free_judy(a->data, (VoidPtrFunc)free_reos_inst);
-		free(a);
+		reos_free(ReOS_MemPattern, a);
 	}
 }
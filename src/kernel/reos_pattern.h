@@ -3,12 +3,26 @@
 
 #include "reos_types.h"
 
+/**
+ * Returned by instruction set analyses when matches of a pattern can grow
+ * without limit.
+ */
+#define REOS_LENGTH_UNBOUNDED -1
+
+/**
+ * Returned by instruction set analyses when whether a thread matches depends
+ * on more than its pc and input position, as with backreferences and
+ * lookaround, so the pattern's matches can't be reasoned about piecewise.
+ */
+#define REOS_LENGTH_UNKNOWN -2
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 ReOS_Pattern *new_mem_pattern();
 void free_mem_pattern(ReOS_Pattern *);
+void free_reos_inst(ReOS_Inst *);
 
 void print_pattern(ReOS_Kernel *);
 
@@ -0,0 +1,109 @@
+#include <string.h>
+#include "reos_stdlib.h"
+
+/**
+ * \file
+ *
+ * Memory accounting for the kernel's subsystems, compiled in with
+ * REOS_MEMORY_STATS.
+ *
+ * Each allocation is counted at its usable size, read back from the
+ * allocator, so that freeing it doesn't need its size passed back in. The
+ * counters are shared by every kernel in the process and updated atomically,
+ * since kernels may run on several threads at once.
+ *
+ * Judy arrays allocate their nodes inside libJudy, out of sight of these
+ * counters. Instead the macros that change them ask libJudy how much memory
+ * each array holds before and after, and reos_stats_judy() accounts the
+ * difference to ReOS_MemJudy, along with the lists that wrap them. An array
+ * counts as one allocation from its first element until it's freed.
+ */
+
+#ifdef REOS_MEMORY_STATS
+
+static ReOS_MemoryStats stats;
+
+static void raise_peak(long *peak, long current)
+{
+	long old = *peak;
+	while (current > old && !__sync_bool_compare_and_swap(peak, old, current))
+		old = *peak;
+}
+
+static void account(int tag, long bytes, int allocs, int frees)
+{
+	ReOS_MemoryUsage *usage = &stats.subsystems[tag];
+
+	long current = __sync_add_and_fetch(&usage->current_bytes, bytes);
+	raise_peak(&usage->peak_bytes, current);
+	long total = __sync_add_and_fetch(&stats.total.current_bytes, bytes);
+	raise_peak(&stats.total.peak_bytes, total);
+
+	if (allocs) {
+		__sync_add_and_fetch(&usage->allocs, allocs);
+		__sync_add_and_fetch(&stats.total.allocs, allocs);
+	}
+	if (frees) {
+		__sync_add_and_fetch(&usage->frees, frees);
+		__sync_add_and_fetch(&stats.total.frees, frees);
+	}
+}
+
+void *reos_stats_malloc(int tag, size_t size)
+{
+	void *ptr = malloc(size);
+	if (ptr)
+		account(tag, malloc_usable_size(ptr), 1, 0);
+	return ptr;
+}
+
+void *reos_stats_calloc(int tag, size_t num, size_t size)
+{
+	void *ptr = calloc(num, size);
+	if (ptr)
+		account(tag, malloc_usable_size(ptr), 1, 0);
+	return ptr;
+}
+
+/**
+ * Accounts a Judy array growing or shrinking from \a before bytes to
+ * \a after, as JudyLMemUsed() reports them.
+ */
+void reos_stats_judy(long before, long after)
+{
+	if (after != before)
+		account(ReOS_MemJudy, after - before, before == 0, after == 0);
+}
+
+/**
+ * Counts as an allocation when \a ptr is null and as a free when \a size is
+ * 0, like realloc() itself.
+ */
+void *reos_stats_realloc(int tag, void *ptr, size_t size)
+{
+	long old_size = ptr ? malloc_usable_size(ptr) : 0;
+	void *new_ptr = realloc(ptr, size);
+
+	if (new_ptr)
+		account(tag, (long)malloc_usable_size(new_ptr) - old_size, ptr ? 0 : 1, 0);
+	else if (ptr && !size)
+		account(tag, -old_size, 0, 1);
+	return new_ptr;
+}
+
+void reos_stats_free(int tag, void *ptr)
+{
+	if (ptr) {
+		account(tag, -(long)malloc_usable_size(ptr), 0, 1);
+		free(ptr);
+	}
+}
+
+void reos_stats_get(ReOS_MemoryStats *out)
+{
+	// each counter is read on its own, so a snapshot taken while other
+	// threads allocate may be off by their latest allocations
+	memcpy(out, &stats, sizeof(ReOS_MemoryStats));
+}
+
+#endif
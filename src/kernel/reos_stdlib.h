@@ -2,6 +2,7 @@
 #define REOS_STDLIB_H
 
 #include <stdlib.h>
+#include "reos_types.h"
 
 #ifdef __GNUC__
 # define __MALLOC_P(args)       args __THROW
@@ -12,4 +13,29 @@
 #define HAS_MALLOC_USABLE_SIZE
 extern size_t malloc_usable_size __MALLOC_P ((void *__ptr));
 
+/*
+ * Allocations the kernel makes for one of its subsystems go through these,
+ * tagged with the subsystem's ReOS_Mem* value. Built with REOS_MEMORY_STATS
+ * they are accounted to it, and reos_kernel_memory_stats() reports the
+ * totals; otherwise they are the plain stdlib calls. Memory must be freed
+ * under the tag it was allocated with.
+ */
+#ifdef REOS_MEMORY_STATS
+void *reos_stats_malloc(int, size_t);
+void *reos_stats_calloc(int, size_t, size_t);
+void *reos_stats_realloc(int, void *, size_t);
+void reos_stats_free(int, void *);
+void reos_stats_get(ReOS_MemoryStats *);
+
+#define reos_malloc(tag, size) reos_stats_malloc((tag), (size))
+#define reos_calloc(tag, num, size) reos_stats_calloc((tag), (num), (size))
+#define reos_realloc(tag, ptr, size) reos_stats_realloc((tag), (ptr), (size))
+#define reos_free(tag, ptr) reos_stats_free((tag), (ptr))
+#else
+#define reos_malloc(tag, size) malloc(size)
+#define reos_calloc(tag, num, size) calloc((num), (size))
+#define reos_realloc(tag, ptr, size) realloc((ptr), (size))
+#define reos_free(tag, ptr) free(ptr)
+#endif
+
 #endif
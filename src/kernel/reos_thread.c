@@ -24,7 +24,7 @@ static void free_threadentry(ThreadEntry *entry)
 {
 	if (entry) {
 		free_reos_compoundlist(entry->deps);
-		free(entry);
+		reos_free(ReOS_MemThreads, entry);
 	}
 }
 
@@ -34,7 +34,7 @@ ReOS_Thread *new_reos_thread(ReOS_CompoundList *free_thread_list, int pc)
 	if (reos_compoundlist_has_next(free_thread_list))
 		t = reos_compoundlist_pop_head(free_thread_list);
 	else {
-		t = malloc(sizeof(ReOS_Thread));
+		t = reos_malloc(ReOS_MemThreads, sizeof(ReOS_Thread));
 		t->free_thread_list = free_thread_list;
 
 		t->ref = 0;
@@ -42,6 +42,7 @@ ReOS_Thread *new_reos_thread(ReOS_CompoundList *free_thread_list, int pc)
 	}
 
 	t->pc = pc;
+	t->backref_index = 0;
 	t->backref_buffer = 0;
 	return t;
 }
@@ -69,13 +70,14 @@ void free_reos_thread(ReOS_Thread *t)
 
 void delete_reos_thread(ReOS_Thread *t)
 {
-	free(t);
+	reos_free(ReOS_MemThreads, t);
 }
 
 ReOS_Thread *reos_thread_clone(ReOS_Thread *t)
 {
 	ReOS_Thread *clone = new_reos_thread(t->free_thread_list, t->pc);
 	clone->capture_set = t->capture_set;
+	clone->backref_index = t->backref_index;
 	clone->backref_buffer = t->backref_buffer;
 	reos_captureset_ref(clone->capture_set);
 
@@ -90,7 +92,7 @@ ReOS_Thread *reos_thread_clone(ReOS_Thread *t)
 
 ReOS_ThreadList *new_reos_threadlist(int len)
 {
-	ReOS_ThreadList *l = malloc(sizeof(ReOS_ThreadList));
+	ReOS_ThreadList *l = reos_malloc(ReOS_MemThreads, sizeof(ReOS_ThreadList));
 	l->list = new_reos_compoundlist(len, (VoidPtrFunc)free_reos_thread, 0);
 	l->pc_table = 0;
 	l->backtrack_captures = 0;
@@ -103,14 +105,23 @@ void free_reos_threadlist(ReOS_ThreadList *l)
 	if (l) {
 		free_reos_compoundlist(l->list);
 		free_judy(l->pc_table, (VoidPtrFunc)free_threadentry);
-		free(l);
+		reos_free(ReOS_MemThreads, l);
 	}
 }
 
+/**
+ * Whether \a t may wait at its pc. Unless captures are being backtracked,
+ * the first thread to get to a pc on each token claims it and every later
+ * one is turned away. Threads get to a pc in the order the program's
+ * splits and jumps push them, so which of two threads that meet on a pc
+ * survives, and with it the captures and matches the kernel reports, is
+ * decided by the program's shape: a pass that rewrites a program must keep
+ * the pcs threads meet on, and the order they get to them in.
+ */
 static int can_insert_thread(ReOS_ThreadList *l, ReOS_Thread *t)
 {
 	judy_fail_get(l->pc_table, t->pc, ThreadEntry, entry) {
-		entry = calloc(1, sizeof(ThreadEntry));
+		entry = reos_calloc(ReOS_MemThreads, 1, sizeof(ThreadEntry));
 		judy_insert(l->pc_table, t->pc, entry);
 	}
 
@@ -154,24 +165,46 @@ static int can_insert_thread(ReOS_ThreadList *l, ReOS_Thread *t)
 	return insert;
 }
 
-void reos_threadlist_push_head(ReOS_ThreadList *l, ReOS_Thread *t, int backtrack)
+/**
+ * Returns whether a thread at \a pc has been pushed onto \a l for the
+ * current token, in which case another one pushed there would be turned
+ * away, unless the list backtracks captures.
+ */
+int reos_threadlist_has_pc(ReOS_ThreadList *l, int pc)
+{
+	ThreadEntry *entry;
+	judy_get(l->pc_table, pc, entry);
+	return entry && entry->gen >= l->gen;
+}
+
+/**
+ * Adds \a t to the head of \a l, unless a thread is already waiting at its
+ * pc and \a backtrack is 0, in which case \a t is freed.
+ *
+ * \return 1 if \a t was added, 0 if it was turned away
+ */
+int reos_threadlist_push_head(ReOS_ThreadList *l, ReOS_Thread *t, int backtrack)
 {
 	if (backtrack || can_insert_thread(l, t)) {
 		reos_compoundlist_push_head(l->list, t);
 		thread_ref_branches(t);
+		return 1;
 	}
-	else
-		free_reos_thread(t);
+
+	free_reos_thread(t);
+	return 0;
 }
 
-void reos_threadlist_push_tail(ReOS_ThreadList *l, ReOS_Thread *t, int backtrack)
+int reos_threadlist_push_tail(ReOS_ThreadList *l, ReOS_Thread *t, int backtrack)
 {
 	if (backtrack || can_insert_thread(l, t)) {
 		reos_compoundlist_push_tail(l->list, t);
 		thread_ref_branches(t);
+		return 1;
 	}
-	else
-		free_reos_thread(t);
+
+	free_reos_thread(t);
+	return 0;
 }
 
 ReOS_Thread *reos_threadlist_pop_head(ReOS_ThreadList *l)
@@ -222,7 +255,7 @@ static void thread_deref_branches(ReOS_Thread *t)
 
 ReOS_Branch *new_reos_branch(int neg)
 {
-	ReOS_Branch *b = malloc(sizeof(ReOS_Branch));
+	ReOS_Branch *b = reos_malloc(ReOS_MemBranches, sizeof(ReOS_Branch));
 	b->strong_refs = 0;
 	b->weak_refs = 0;
 	b->num_threads = 0;
@@ -237,7 +270,7 @@ ReOS_Branch *new_reos_branch(int neg)
 static void free_reos_branch(ReOS_Branch *branch)
 {
 	free_reos_compoundlist(branch->matches);
-	free(branch);
+	reos_free(ReOS_MemBranches, branch);
 }
 
 /* We can't use simple reference counting with branches, since branches can refer
@@ -262,27 +295,27 @@ static void free_reos_branch(ReOS_Branch *branch)
 ReOS_Branch *reos_branch_strong_ref(ReOS_Branch *branch)
 {
 	branch->strong_refs++;
-	printf("strong ref ");
-	reos_branch_print(branch);
-	printf("\n");
+	BRANCH_DEBUG_DO(printf("strong ref "));
+	BRANCH_DEBUG_DO(reos_branch_print(branch));
+	BRANCH_DEBUG_DO(printf("\n"));
 	return branch;
 }
 
 ReOS_Branch *reos_branch_weak_ref(ReOS_Branch *branch)
 {
 	branch->weak_refs++;
-	printf("weak ref ");
-	reos_branch_print(branch);
-	printf("\n");
+	BRANCH_DEBUG_DO(printf("weak ref "));
+	BRANCH_DEBUG_DO(reos_branch_print(branch));
+	BRANCH_DEBUG_DO(printf("\n"));
 	return branch;
 }
 
 void reos_branch_strong_deref(ReOS_Branch *branch)
 {
 	branch->strong_refs--;
-	printf("strong deref ");
-	reos_branch_print(branch);
-	printf("\n");
+	BRANCH_DEBUG_DO(printf("strong deref "));
+	BRANCH_DEBUG_DO(reos_branch_print(branch));
+	BRANCH_DEBUG_DO(printf("\n"));
 	
 	if (branch->strong_refs == 0) {
 		// only free in this function if weak_refs is already zero
@@ -305,9 +338,9 @@ void reos_branch_strong_deref(ReOS_Branch *branch)
 void reos_branch_weak_deref(ReOS_Branch *branch)
 {
 	branch->weak_refs--;
-	printf("weak deref ");
-	reos_branch_print(branch);
-	printf("\n");
+	BRANCH_DEBUG_DO(printf("weak deref "));
+	BRANCH_DEBUG_DO(reos_branch_print(branch));
+	BRANCH_DEBUG_DO(printf("\n"));
 	if (branch->weak_refs == 0 && branch->strong_refs == 0)
 		free_reos_branch(branch);
 }
@@ -15,8 +15,9 @@ ReOS_Thread *reos_thread_clone(ReOS_Thread *);
 ReOS_ThreadList *new_reos_threadlist(int);
 void free_reos_threadlist(ReOS_ThreadList *);
 
-void reos_threadlist_push_head(ReOS_ThreadList *, ReOS_Thread *, int);
-void reos_threadlist_push_tail(ReOS_ThreadList *, ReOS_Thread *, int);
+int reos_threadlist_has_pc(ReOS_ThreadList *, int);
+int reos_threadlist_push_head(ReOS_ThreadList *, ReOS_Thread *, int);
+int reos_threadlist_push_tail(ReOS_ThreadList *, ReOS_Thread *, int);
 ReOS_Thread *reos_threadlist_pop_head(ReOS_ThreadList *);
 
 ReOS_Branch *new_reos_branch(int);
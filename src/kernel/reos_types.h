@@ -22,6 +22,8 @@ typedef struct ReOS_Debugger ReOS_Debugger;
 typedef struct ReOS_Pattern ReOS_Pattern;
 typedef struct ReOS_TokenBuffer ReOS_TokenBuffer;
 typedef struct ReOS_Input ReOS_Input;
+typedef struct ReOS_InputFactory ReOS_InputFactory;
+typedef struct ReOS_InputProducer ReOS_InputProducer;
 typedef struct ReOS_Inst ReOS_Inst;
 typedef struct ReOS_State ReOS_State;
 typedef struct ReOS_Kernel ReOS_Kernel;
@@ -42,16 +44,26 @@ typedef struct ReOS_CaptureSet ReOS_CaptureSet;
 typedef struct ReOS_Thread ReOS_Thread;
 typedef struct ReOS_ThreadList ReOS_ThreadList;
 typedef struct ReOS_Branch ReOS_Branch;
+typedef struct ReOS_MemoryUsage ReOS_MemoryUsage;
+typedef struct ReOS_MemoryStats ReOS_MemoryStats;
+typedef struct ReOS_PatternInfo ReOS_PatternInfo;
 
 typedef void (*VoidPtrFunc)(void *);
 typedef void *(*CloneFunc)(void *);
 typedef int (*StreamReadFunc)(void *, int, void *);
 typedef int (*IndexedReadFunc)(void *, int, long, void *);
+typedef int (*MapReadFunc)(void **, int, void *);
+typedef void *(*SpanFunc)(long *, void *);
+typedef void (*SeekFunc)(long, void *);
+typedef ReOS_Input *(*OpenInputFunc)(void *);
+typedef ReOS_Input *(*ProduceInputFunc)(long, void *);
 typedef int (*ExecuteInstFunc)(ReOS_Kernel *, ReOS_Thread *, ReOS_Inst *, int);
 typedef int (*TestBackrefFunc)(ReOS_Kernel *, void *, void *);
 typedef void (*DebugCallbackFunc)(ReOS_Debugger *, ReOS_Kernel *);
+typedef void (*DebugPcCallbackFunc)(ReOS_Debugger *, ReOS_Kernel *, int);
 typedef void (*PrintInputFunc)(ReOS_Kernel *);
 typedef void (*PrintInstFunc)(ReOS_Inst *);
+typedef int (*InstArgsSizeFunc)(ReOS_Inst *);
 
 struct ReOS_Pattern
 {
@@ -61,24 +73,92 @@ struct ReOS_Pattern
 	void (*set_inst)(ReOS_Pattern *, ReOS_Inst *, int);
 };
 
+/**
+ * What instruction set analyses found out about a pattern, kept with it in
+ * pattern images so that loading one needs no analysis.
+ */
+struct ReOS_PatternInfo
+{
+	int num_captures;
+	long history_size; //!< For the kernel's \c history_size
+	long max_length; //!< For reos_kernel_execute_parallel()
+
+	//! The hash of the image's contents, set when it's written or loaded
+	unsigned long long hash;
+};
+
 struct ReOS_TokenBuffer
 {
-	int len;
-	int pos;
+	char *next; //!< The next token to be consumed
+	char *end; //!< One past the last buffered token
+	int token_size;
 	void *buf;
 	ReOS_Input *input;
+
+	/*!
+	 *  A ring buffer of the last \c history_size tokens consumed by the kernel,
+	 *  so that backreferences can compare against them without re-reading
+	 *  the input. Not allocated for span inputs, which keep every token
+	 *  addressable anyway.
+	 */
+	char *history;
+	long history_size;
 };
 
 struct ReOS_Input
 {
 	StreamReadFunc stream_read;
 	IndexedReadFunc indexed_read;
+
+	/*!
+	 *  Optional. Points its first argument at up to \c buffer_size tokens kept
+	 *  in the input's own storage and returns how many there are, or 0 at the
+	 *  end of input. If set, the token buffer uses it instead of copying tokens
+	 *  with \c stream_read.
+	 */
+	MapReadFunc map_read;
+
+	/*!
+	 *  Optional. Returns a pointer to the entire input, stored contiguously, and
+	 *  stores its length in tokens in the first argument. If set, the token
+	 *  buffer walks the returned span directly and never calls \c stream_read,
+	 *  \c map_read or \c free_token.
+	 */
+	SpanFunc span;
+
+	/*!
+	 *  Optional. Moves the stream to the token at the given index, so that the
+	 *  next \c stream_read or \c map_read starts there. Lets the kernel start
+	 *  at an offset without reading and discarding everything before it.
+	 */
+	SeekFunc seek;
 	VoidPtrFunc free_token;
 	int token_size;
 	int buffer_size;
 	void *data;
 };
 
+/**
+ * Opens independent inputs over the same source, for drivers that run
+ * several kernels over it at once.
+ */
+struct ReOS_InputFactory
+{
+	OpenInputFunc open; //!< Called with \c data
+	VoidPtrFunc close; //!< Called with an input returned by \c open
+	void *data;
+};
+
+/**
+ * Opens the inputs of a batch of independent inputs, by index.
+ */
+struct ReOS_InputProducer
+{
+	ProduceInputFunc open; //!< Called with an index and \c data
+	VoidPtrFunc close; //!< Optional. Called with an input returned by \c open
+	void *data;
+};
+
 enum
 {
 	ReOS_InstRetHalt = 1,
@@ -114,17 +194,29 @@ struct ReOS_Kernel
 	void *current_token;
 	void *data;
 
+	/*!
+	 *  The pc of the instruction being executed, or -1 between tokens, for
+	 *  debuggers and samplers.
+	 */
+	int pc;
+
 	int num_capturesets;
 	int max_capturesets;
 	ReOS_SimpleList *matches;
 
 	TestBackrefFunc test_backref;
 	int next_backref_id;
+
+	/*!
+	 *  How many consumed tokens the token buffer remembers for
+	 *  backreferences. 0 disables the history, in which case backreferences
+	 *  re-read their captures with \c indexed_read.
+	 */
+	long history_size;
 };
 
 struct ReOS_BackrefBuffer
 {
-	long index;
 	long length;
 	void **tokens;
 };
@@ -259,6 +351,7 @@ struct Call
 struct ReOS_Thread
 {
 	int pc;
+	long backref_index; //!< Tokens of the current backreference matched so far
 	ReOS_BackrefBuffer *backref_buffer;
 	ReOS_CaptureSet *capture_set;
 	ReOS_CompoundList *call_stack;
@@ -287,9 +380,62 @@ struct ReOS_Debugger
 	DebugCallbackFunc failure;
 	DebugCallbackFunc end;
 
+	/*!
+	 *  Thread events, each passed the pc it happened at: a thread was
+	 *  created there, died there, or was turned away from a thread list
+	 *  because one was already waiting there.
+	 */
+	DebugPcCallbackFunc spawn;
+	DebugPcCallbackFunc drop;
+	DebugPcCallbackFunc reject;
+
+	/*!
+	 *  A thread at the pc copied a capture set it shared in order to write
+	 *  to it, or created a lookahead branch.
+	 */
+	DebugPcCallbackFunc detach;
+	DebugPcCallbackFunc branch;
+
 	void *data;
 };
 
+/**
+ * The kernel subsystems memory is accounted to when ReOS is built with
+ * REOS_MEMORY_STATS.
+ */
+enum
+{
+	ReOS_MemThreads,
+	ReOS_MemCaptureSets,
+	ReOS_MemCaptures,
+	ReOS_MemListNodes,
+	ReOS_MemJudy,
+	ReOS_MemBranches,
+	ReOS_MemTokenBuffer,
+	ReOS_MemPattern,
+	ReOS_MemOther,
+	ReOS_MemNumSubsystems
+};
+
+struct ReOS_MemoryUsage
+{
+	long current_bytes;
+	long peak_bytes;
+	long allocs;
+	long frees;
+};
+
+struct ReOS_MemoryStats
+{
+	ReOS_MemoryUsage subsystems[ReOS_MemNumSubsystems];
+
+	/*!
+	 *  All subsystems together. Its peak is the most that was in use at once,
+	 *  not the sum of the subsystems' peaks.
+	 */
+	ReOS_MemoryUsage total;
+};
+
 #define reos_simplelistiter_has_next_body(iter) \
 	((iter)->current ? 1 : 0)
 
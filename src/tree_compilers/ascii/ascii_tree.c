@@ -16,17 +16,33 @@ TreeNode* new_ascii_tree_node(int type, TreeNode *left, TreeNode *right)
 	node->right = right;
 	node->x = 0;
 	node->y = 0;
+	node->arena = 0;
 	return node;
 }
 
+/**
+ * Allocates a node from \a arena, or with malloc() as new_ascii_tree_node()
+ * does if \a arena is 0.
+ */
+TreeNode *new_ascii_arena_node(TreeArena *arena, int type, TreeNode *left, TreeNode *right)
+{
+	if (!arena)
+		return new_ascii_tree_node(type, left, right);
+
+	int has_args = type == NodeAsciiChar || type == NodeAsciiRange;
+	return new_arena_tree_node(arena, type, left, right, has_args ? sizeof(AsciiTreeNodeArgs) : 0);
+}
+
 void free_ascii_tree_node(TreeNode *node)
 {
 	if (node) {
 		if (node->type == NodeAsciiChar || node->type == NodeAsciiRange) {
-			free(node->args);
 			free_ascii_tree_node(node->left);
 			free_ascii_tree_node(node->right);
-			free(node);
+			if (!node->arena) {
+				free(node->args);
+				free(node);
+			}
 		}
 		else
 			free_standard_tree_node(node, free_ascii_tree_node);
@@ -60,6 +76,23 @@ int ascii_tree_node_compile(ReOS_Pattern *pattern, int index, TreeNode *node, Re
 	}
 }
 
+static TreeOptimizer ascii_tree_optimizer = {
+	new_ascii_tree_node,
+	free_ascii_tree_node
+};
+
+/**
+ * Optimizes a tree from the ascii expression compiler, as
+ * standard_tree_optimize() does.
+ *
+ * \param tree The tree, which is used up
+ * \return The tree to compile and free instead
+ */
+TreeNode *ascii_tree_optimize(TreeNode *tree)
+{
+	return standard_tree_optimize(tree, &ascii_tree_optimizer);
+}
+
 void print_ascii_tree(TreeNode *node)
 {
 	switch (node->type) {
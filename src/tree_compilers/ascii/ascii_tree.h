@@ -26,9 +26,11 @@ struct AsciiTreeNodeArgs
 };
 
 TreeNode *new_ascii_tree_node(int, TreeNode *, TreeNode *);
+TreeNode *new_ascii_arena_node(TreeArena *, int, TreeNode *, TreeNode *);
 void free_ascii_tree_node(TreeNode *);
 int ascii_tree_node_compile(ReOS_Pattern *, int, TreeNode *, ReOS_InstFactoryFunc);
 void print_ascii_tree(TreeNode *);
+TreeNode *ascii_tree_optimize(TreeNode *);
 
 #ifdef __cplusplus
 }
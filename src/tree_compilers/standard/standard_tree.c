@@ -3,15 +3,82 @@
 #include "standard_inst.h"
 #include "standard_tree.h"
 
+// the size of an arena's first block; each next one is twice the last
+#define TREE_ARENA_BLOCK_SIZE 4096
+
+// rounds up to a multiple of the largest alignment a node's args need
+#define tree_arena_align(size) (((size) + sizeof(void *) - 1) & ~(sizeof(void *) - 1))
+
 void free_standard_tree_node(TreeNode *node, FreeTreeNodeFunc free_func)
 {
 	if (node) {
 		free_func(node->left);
 		free_func(node->right);
-		free(node);
+		if (!node->arena)
+			free(node);
+	}
+}
+
+TreeArena *new_tree_arena()
+{
+	TreeArena *arena = malloc(sizeof(TreeArena));
+	arena->block = 0;
+	arena->used = 0;
+	arena->size = 0;
+	return arena;
+}
+
+void free_tree_arena(TreeArena *arena)
+{
+	if (arena) {
+		while (arena->block) {
+			char *last = *(char **)arena->block;
+			free(arena->block);
+			arena->block = last;
+		}
+		free(arena);
 	}
 }
 
+static void *tree_arena_alloc(TreeArena *arena, long size)
+{
+	size = tree_arena_align(size);
+	if (arena->used + size > arena->size) {
+		long block_size = arena->size ? arena->size * 2 : TREE_ARENA_BLOCK_SIZE;
+		while (block_size < tree_arena_align(sizeof(char *)) + size)
+			block_size *= 2;
+
+		char *block = malloc(block_size);
+		*(char **)block = arena->block;
+		arena->block = block;
+		arena->used = tree_arena_align(sizeof(char *));
+		arena->size = block_size;
+	}
+
+	void *p = arena->block + arena->used;
+	arena->used += size;
+	return p;
+}
+
+/**
+ * Allocates a node and \a args_size bytes of args from \a arena, for tree
+ * compilers' own node constructors. The node must still be passed to the
+ * tree compiler's free function, which frees any malloc()ed nodes below it,
+ * and is freed itself with the arena.
+ */
+TreeNode *new_arena_tree_node(TreeArena *arena, int type, TreeNode *left, TreeNode *right, int args_size)
+{
+	TreeNode *node = tree_arena_alloc(arena, tree_arena_align(sizeof(TreeNode)) + args_size);
+	node->type = type;
+	node->left = left;
+	node->right = right;
+	node->x = 0;
+	node->y = 0;
+	node->args = args_size ? (char *)node + tree_arena_align(sizeof(TreeNode)) : 0;
+	node->arena = arena;
+	return node;
+}
+
 void standard_tree_compile(ReOS_Pattern *pattern, TreeNode *tree,
 						   ReOS_InstFactoryFunc inst_factory,
 						   TreeNodeCompileFunc tree_node_compile)
@@ -258,11 +325,11 @@ int standard_tree_node_compile(ReOS_Pattern *pattern, int index, TreeNode *node,
 			next = tree_node_compile(pattern, next, node->left, inst_factory);
 
 		if (node->y == -1) {
-			TreeNode star = {NodeStar, node->left, 0, 0, 0, 0};
+			TreeNode star = {NodeStar, node->left, 0, 0, 0, 0, 0};
 			return tree_node_compile(pattern, next, &star, inst_factory);
 		}
 		else {
-			TreeNode quest = {NodeQuest, node->left, 0, 0, 0, 0};
+			TreeNode quest = {NodeQuest, node->left, 0, 0, 0, 0, 0};
 			for (i = node->x; i < node->y; i++)
 				next = tree_node_compile(pattern, next, &quest, inst_factory);
 			return next;
@@ -321,6 +388,9 @@ int standard_tree_node_compile(ReOS_Pattern *pattern, int index, TreeNode *node,
 		pattern->set_inst(pattern, rec_inst, index);
 		return index+1;
 	}
+
+	case NodeEmpty:
+		return index;
 	}
 }
 
@@ -410,5 +480,187 @@ void print_standard_tree(TreeNode *node, PrintTreeNodeFunc print_tree)
 		print_tree(node->left);
 		printf(")");
 		break;
+
+	case NodeEmpty:
+		printf("Empty");
+		break;
+	}
+}
+
+/*
+	The tree optimizer rewrites a parsed tree into one that compiles to fewer
+	instructions, and above all fewer splits, so fewer threads are alive on
+	each token:
+
+	abc:			Cat(a, Cat(b, c)), whatever the parser's nesting
+	(?:a?)?:		a?
+	(?:a+)+:		a+
+	e{0}:			nothing
+	e{0,1}, e{0,}:	e?, e*
+
+	Which of two threads that meet on a pc survives decides what the kernel
+	reports (see can_insert_thread() in reos_thread.c), so the optimizer only
+	makes rewrites that keep every meeting as it was. Alternations are left
+	as parsed: duplicate alternatives, common prefixes and runs of single
+	chars all meet on the jumps out of them in an order that dropping,
+	factoring or folding them would change. Loops around nothing are kept,
+	as their splits still decide when threads get to the pc after them, and
+	lookahead is left as parsed too.
+*/
+
+// frees a node whose children have been given to other nodes
+static void free_shell(TreeNode *node, TreeOptimizer *opt)
+{
+	node->left = 0;
+	node->right = 0;
+	opt->free_node(node);
+}
+
+typedef struct NodeList NodeList;
+
+struct NodeList
+{
+	TreeNode **nodes;
+	int length;
+	int size;
+};
+
+static void node_list_push(NodeList *list, TreeNode *node)
+{
+	if (list->length == list->size) {
+		list->size = list->size ? list->size*2 : 4;
+		list->nodes = realloc(list->nodes, sizeof(TreeNode *)*list->size);
+	}
+	list->nodes[list->length++] = node;
+}
+
+/*
+	Appends the operands of a chain of concatenations to \a list, dropping
+	empty nodes, and frees the chain's own nodes.
+*/
+static void flatten(TreeNode *node, NodeList *list, TreeOptimizer *opt)
+{
+	if (node->type == NodeCat) {
+		flatten(node->left, list, opt);
+		flatten(node->right, list, opt);
+		free_shell(node, opt);
+	}
+	else if (node->type == NodeEmpty)
+		opt->free_node(node);
+	else
+		node_list_push(list, node);
+}
+
+// chains nodes into concatenations, or an empty node
+static TreeNode *join(TreeNode **nodes, int length, TreeOptimizer *opt)
+{
+	if (!length)
+		return opt->new_node(NodeEmpty, 0, 0);
+
+	TreeNode *node = nodes[length-1];
+	int i;
+	for (i = length-2; i >= 0; i--)
+		node = opt->new_node(NodeCat, nodes[i], node);
+	return node;
+}
+
+/*
+	Wraps an optimized node in e?, e* or e+. (?:e?)? is folded into e? and
+	(?:e+)+ into e+, when both have the same greed: the inner and outer
+	loops go back to, or out to, the same pcs, so the outer one only ever
+	makes threads that meet the inner one's and lose to them. Other pairs
+	are left alone, since e.g. (?:e*)* lets a thread go round the outer
+	loop after e matched nothing, and so reach the pcs after it first.
+*/
+static TreeNode *quantify(int type, int lazy, TreeNode *node, TreeOptimizer *opt)
+{
+	if (node->type == type && node->x == lazy && (type == NodeQuest || type == NodePlus))
+		return node;
+
+	TreeNode *quantified = opt->new_node(type, node, 0);
+	quantified->x = lazy;
+	return quantified;
+}
+
+static TreeNode *optimize(TreeNode *node, TreeOptimizer *opt)
+{
+	switch (node->type) {
+	case NodeCat:
+	{
+		NodeList parsed = {0}, items = {0};
+		flatten(node, &parsed, opt);
+
+		int i;
+		for (i = 0; i < parsed.length; i++)
+			flatten(optimize(parsed.nodes[i], opt), &items, opt);
+
+		node = join(items.nodes, items.length, opt);
+		free(parsed.nodes);
+		free(items.nodes);
+		return node;
+	}
+
+	case NodeAlt:
+		node->left = optimize(node->left, opt);
+		node->right = optimize(node->right, opt);
+		return node;
+
+	case NodeQuest:
+	case NodeStar:
+	case NodePlus:
+	{
+		int type = node->type, lazy = node->x;
+		TreeNode *left = optimize(node->left, opt);
+		free_shell(node, opt);
+		return quantify(type, lazy, left, opt);
 	}
+
+	case NodeRepCount:
+	{
+		node->left = optimize(node->left, opt);
+
+		int min = node->x, max = node->y;
+		TreeNode *left = node->left;
+		if (!min && !max) {
+			opt->free_node(node);
+			return opt->new_node(NodeEmpty, 0, 0);
+		}
+
+		if (min == 1 && (max == 0 || max == 1)) {
+			free_shell(node, opt);
+			return left;
+		}
+		else if (min == 0 && max == 1) {
+			free_shell(node, opt);
+			return quantify(NodeQuest, 0, left, opt);
+		}
+		else if (min == 0 && max == -1) {
+			free_shell(node, opt);
+			return quantify(NodeStar, 0, left, opt);
+		}
+		return node;
+	}
+
+	case NodeParen:
+		node->left = optimize(node->left, opt);
+		return node;
+
+	case NodePosAhead:
+	case NodeNegAhead:
+	default:
+		return node;
+	}
+}
+
+/**
+ * Rewrites a parsed tree to compile to fewer instructions and split fewer
+ * threads, without changing the matches or captures the kernel reports.
+ *
+ * \param tree The tree, which is used up
+ * \param opt The tree compiler's side of the rewriting
+ * \return The optimized tree, to be freed in place of \a tree
+ */
+TreeNode *standard_tree_optimize(TreeNode *tree, TreeOptimizer *opt)
+{
+	return optimize(tree, opt);
 }
@@ -8,6 +8,7 @@ extern "C" {
 #endif
 
 typedef struct TreeNode TreeNode;
+typedef struct TreeArena TreeArena;
 typedef void (*FreeTreeNodeFunc)(TreeNode *);
 typedef void (*PrintTreeNodeFunc)(TreeNode *);
 struct TreeNodeCompileFunctor;
@@ -15,6 +16,8 @@ struct TreeNodeCompileFunctor;
 typedef ReOS_Inst *(*ReOS_InstFactoryFunc)(int);
 typedef int (*TreeNodeCompileFunc)(ReOS_Pattern *, int, TreeNode *, ReOS_InstFactoryFunc);
 
+typedef TreeNode *(*NewTreeNodeFunc)(int, TreeNode *, TreeNode *);
+
 struct TreeNode
 {
 	int type;
@@ -23,6 +26,21 @@ struct TreeNode
 	int x;
 	int y;
 	void *args;
+
+	//! The arena the node and its args were allocated from, or 0 if they
+	//! were malloc()ed. Arena nodes are freed with the arena.
+	TreeArena *arena;
+};
+
+/**
+ * Allocates the nodes of one compile from a few large blocks, which are
+ * freed together once the tree has been compiled.
+ */
+struct TreeArena
+{
+	char *block; //!< The current block, linked to the last through its start
+	long used;
+	long size;
 };
 
 enum
@@ -40,13 +58,29 @@ enum
 	NodeRepCount,
 	NodePosAhead,
 	NodeNegAhead,
-	NodeRecurse
+	NodeRecurse,
+	NodeEmpty
+};
+
+typedef struct TreeOptimizer TreeOptimizer;
+
+/**
+ * How the tree optimizer makes and frees a tree compiler's nodes.
+ */
+struct TreeOptimizer
+{
+	NewTreeNodeFunc new_node;
+	FreeTreeNodeFunc free_node;
 };
 
 void free_standard_tree_node(TreeNode *, FreeTreeNodeFunc);
+TreeArena *new_tree_arena();
+void free_tree_arena(TreeArena *);
+TreeNode *new_arena_tree_node(TreeArena *, int, TreeNode *, TreeNode *, int);
 void standard_tree_compile(ReOS_Pattern *, TreeNode *, ReOS_InstFactoryFunc, TreeNodeCompileFunc);
 int standard_tree_node_compile(ReOS_Pattern *, int, TreeNode *, ReOS_InstFactoryFunc, TreeNodeCompileFunc);
 void print_standard_tree(TreeNode *, PrintTreeNodeFunc);
+TreeNode *standard_tree_optimize(TreeNode *, TreeOptimizer *);
 
 #ifdef __cplusplus
 }
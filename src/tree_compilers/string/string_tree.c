@@ -17,6 +17,7 @@ TreeNode* new_string_tree_node(int type, TreeNode *left, TreeNode *right)
 	node->right = right;
 	node->x = 0;
 	node->y = 0;
+	node->arena = 0;
 	return node;
 }
 
@@ -24,6 +24,7 @@ TreeNode* new_unicode_tree_node(int type, TreeNode *left, TreeNode *right)
 	node->right = right;
 	node->x = 0;
 	node->y = 0;
+	node->arena = 0;
 	return node;
 }
 
@@ -68,6 +69,23 @@ int unicode_tree_node_compile(ReOS_Pattern *pattern, int index, TreeNode *node,
 	}
 }
 
+static TreeOptimizer unicode_tree_optimizer = {
+	new_unicode_tree_node,
+	free_unicode_tree_node
+};
+
+/**
+ * Optimizes a tree from the unicode expression compiler, as
+ * standard_tree_optimize() does.
+ *
+ * \param tree The tree, which is used up
+ * \return The tree to compile and free instead
+ */
+TreeNode *unicode_tree_optimize(TreeNode *tree)
+{
+	return standard_tree_optimize(tree, &unicode_tree_optimizer);
+}
+
 void print_unicode_tree(TreeNode *node)
 {
 	UnicodeTreeNodeArgs *args = (UnicodeTreeNodeArgs *)node->args;
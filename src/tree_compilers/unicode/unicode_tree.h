@@ -26,6 +26,7 @@ TreeNode *new_unicode_tree_node(int, TreeNode *, TreeNode *);
 void free_unicode_tree_node(TreeNode *);
 int unicode_tree_node_compile(ReOS_Pattern *, int, TreeNode *, ReOS_InstFactoryFunc);
 void print_unicode_tree(TreeNode *);
+TreeNode *unicode_tree_optimize(TreeNode *);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,604 @@
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include "bench.h"
+
+/**
+ * \file
+ *
+ * End-to-end benchmark. Every pattern family is run by every engine that can
+ * express it, over a generated corpus, and the results are written out as
+ * JSON.
+ *
+ * Each family and engine pair runs in a child process of its own. A crash, an
+ * exit() from a parser or a runaway backtracker then only loses that one
+ * result, the peak RSS wait4() reports belongs to that run alone, and the
+ * reference engines' leaks don't pile up from one run to the next.
+ *
+ * With --scaling, the scaling families are run instead. Each one is swept
+ * over doubling input lengths, repetition counts or nesting depths, and a
+ * power law is fitted to the times, so a family whose cost grows faster than
+ * linearly stands out.
+ */
+
+enum
+{
+	BenchOk,
+	BenchUnsupported,
+	BenchFailed,
+	BenchTimeout
+};
+
+typedef struct BenchResult BenchResult;
+
+struct BenchResult
+{
+	int status;
+	long bytes;
+	long runs;
+	double seconds;
+	long matches;
+	long allocations;
+	long allocated;
+	long peak_rss;
+	long peak_threads;
+};
+
+enum
+{
+	ScaleInput,
+	ScaleRepeat,
+	ScaleDepth
+};
+
+typedef struct BenchScaling BenchScaling;
+
+/**
+ * A family that's swept over one dimension, doubling at each step.
+ */
+struct BenchScaling
+{
+	char *name;
+	char *engine;
+	char *corpus;
+	int dimension;
+
+	// for ScaleInput, the pattern; for ScaleRepeat, a printf() format whose
+	// %1$d is the repetition count; for ScaleDepth, the innermost pattern
+	char *regex;
+
+	// for ScaleDepth, what's wrapped around the pattern at each level
+	char *open;
+	char *close;
+
+	// the corpus size for the pattern sweeps
+	long size;
+
+	long first;
+	int steps;
+};
+
+static BenchFamily families[] = {
+	{"literal", "log", "ERROR", "ERROR", 0, 0},
+	{"alternation", "log", "ERROR|WARN|FATAL", "ERROR|WARN|FATAL", 0, 0},
+	{"class-plus", "log", "[0-9]+ms", "(?:0|1|2|3|4|5|6|7|8|9)+ms", 0, 0},
+	{"dot-star", "log", "GET.*500", "GET.*500", 0, 0},
+	{"capture", "log", "user\\=([a-z]+)",
+	 "user=((?:a|b|c|d|e|f|g|h|i|j|k|l|m|n|o|p|q|r|s|t|u|v|w|x|y|z)+)", 0, 0},
+	{"backref", "log", "([0-9])\\1", 0, 0, 0},
+	{"lookahead", "log", "(?=[a-z]*er)[a-z]+", 0, 0, 0},
+	{"literal", "random", "abc", "abc", 0, 0},
+	{"class-seq", "random", "[a-f][0-9][a-f]",
+	 "(?:a|b|c|d|e|f)(?:0|1|2|3|4|5|6|7|8|9)(?:a|b|c|d|e|f)", 0, 0},
+	{"dot-star", "random", "x.*y.*z", "x.*y.*z", 0, 0},
+	{"optional-run", "random", "a?b?c?d?e?f?g", "a?b?c?d?e?f?g", 0, 0},
+	{"ascii-suffix", "unicode", "[a-z]+ing", "(?:a|b|c|d|e|f|g|h|i|j|k|l|m|n|o|p|q|r|s|t|u|v|w|x|y|z)+ing", 0, 0},
+	{"utf8-literal", "unicode", "café", "café", 0, 0},
+	{"dot", "unicode", "S.raße", 0, 0, 0}
+};
+
+static BenchScaling scalings[] = {
+	{"literal", "reos-string", "log", ScaleInput, "ERROR", 0, 0, 0, 16 << 10, 6},
+	{"dot-star", "reos-string", "log", ScaleInput, "GET.*500", 0, 0, 0, 16 << 10, 6},
+	{"backref", "reos-string", "log", ScaleInput, "([0-9])\\1", 0, 0, 0, 16 << 10, 6},
+	{"lookahead", "reos-string", "log", ScaleInput, "(?=[a-z]*er)[a-z]+", 0, 0, 0, 16 << 10, 6},
+	{"capture", "reos-backtrack-caps", "log", ScaleInput, "user\\=([a-z]+)", 0, 0, 0, 16 << 10, 6},
+	{"capture", "reos-unicode", "unicode", ScaleInput, "(caf.)", 0, 0, 0, 16 << 10, 6},
+	{"line", "reos-line", "log", ScaleInput, "ERROR", 0, 0, 0, 16 << 10, 6},
+	{"counted", "reos-string", "pathological", ScaleRepeat, "(a){1,%1$d}", 0, 0, 4 << 10, 4, 6},
+	{"optional-run", "reos-string", "pathological", ScaleRepeat, "(?:a?){%1$d}a{%1$d}", 0, 0, 4 << 10, 4, 6},
+	{"lookahead-counted", "reos-string", "pathological", ScaleRepeat,
+	 "((?=(?!b)a)a){1,%1$d}(a){1,%1$d}(\\1\\2)?", 0, 0, 1 << 10, 2, 6},
+	{"nested-captures", "reos-string", "log", ScaleDepth, "[a-z]+", "(", ")", 16 << 10, 2, 6},
+	{"nested-alternation", "reos-string", "log", ScaleDepth, "ERROR", "(?:WARN|", ")", 16 << 10, 2, 6},
+	{"nested-star", "reos-string", "pathological", ScaleDepth, "a", "(?:", ")*", 4 << 10, 1, 6}
+};
+
+static const char *dimension_names[] = {"input_length", "repetitions", "nesting_depth"};
+
+/**
+ * Sizes of the a?^n a^n family.
+ */
+static int pathological_sizes[] = {8, 16, 24};
+
+static long allocations;
+static long allocated;
+
+#ifdef __GLIBC__
+// count the allocations of everything in the process, ReOS included
+extern void *__libc_malloc(size_t);
+extern void *__libc_calloc(size_t, size_t);
+extern void *__libc_realloc(void *, size_t);
+
+void *malloc(size_t size)
+{
+	allocations++;
+	allocated += size;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	allocations++;
+	allocated += nmemb * size;
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	allocations++;
+	allocated += size;
+	return __libc_realloc(ptr, size);
+}
+#endif
+
+static void print_usage()
+{
+	fprintf(stderr,
+			"Usage: bench [OPTION]...\n"
+			"Options:\n"
+			"	-o, --json PATH\n"
+			"		write the results to PATH instead of standard output\n"
+			"	-s, --size BYTES\n"
+			"		generate corpora BYTES long (default: 1048576)\n"
+			"	-t, --min-time SECONDS\n"
+			"		repeat each run for at least SECONDS (default: 0.5)\n"
+			"	-T, --timeout SECONDS\n"
+			"		give up on a run after SECONDS (default: 30)\n"
+			"	-f, --filter STRING\n"
+			"		only run families, corpora or engines whose names contain STRING\n"
+			"	    --scaling\n"
+			"		run the scaling families instead, and fit how their times grow\n"
+			"	    --threshold EXPONENT\n"
+			"		flag scaling families that grow faster than this (default: 1.2)\n"
+			"	-h, --help\n"
+			"		display this help\n");
+	exit(0);
+}
+
+static double now()
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/**
+ * Runs \a engine over \a family's corpus until \a min_time has passed. Called
+ * in the child.
+ */
+static void run_case(BenchFamily *family, BenchEngine *engine, long size, double min_time,
+					 BenchResult *result)
+{
+	BenchCorpus *corpus = new_bench_corpus(family->corpus, family->size ? family->size : size);
+	if (!corpus) {
+		fprintf(stderr, "error: no corpus called %s\n", family->corpus);
+		exit(1);
+	}
+
+	void *state = engine->prepare(family, corpus);
+	if (!state) {
+		result->status = BenchUnsupported;
+		free_bench_corpus(corpus);
+		return;
+	}
+
+	allocations = 0;
+	allocated = 0;
+
+	double start = now();
+	do {
+		result->matches = engine->run(state, corpus);
+		result->runs++;
+		result->seconds = now() - start;
+	} while (result->seconds < min_time);
+
+	result->status = BenchOk;
+	result->bytes = corpus->len;
+	result->allocations = allocations / result->runs;
+	result->allocated = allocated / result->runs;
+
+	if (engine->count_threads)
+		result->peak_threads = engine->count_threads(state, corpus);
+
+	engine->finish(state);
+	free_bench_corpus(corpus);
+}
+
+/**
+ * Runs one family and engine pair in a child process.
+ */
+static void fork_case(BenchFamily *family, BenchEngine *engine, long size, double min_time,
+					  int timeout, BenchResult *result)
+{
+	memset(result, 0, sizeof(BenchResult));
+	result->status = BenchFailed;
+
+	int fds[2];
+	if (pipe(fds) == -1) {
+		perror("error: could not create pipe");
+		exit(1);
+	}
+
+	fflush(0);
+	pid_t pid = fork();
+	if (pid == -1) {
+		perror("error: could not fork");
+		exit(1);
+	}
+	else if (pid == 0) {
+		close(fds[0]);
+		alarm(timeout);
+		run_case(family, engine, size, min_time, result);
+		if (write(fds[1], result, sizeof(BenchResult)) != sizeof(BenchResult))
+			exit(1);
+		exit(0);
+	}
+
+	close(fds[1]);
+	BenchResult child;
+	int got = read(fds[0], &child, sizeof(BenchResult)) == sizeof(BenchResult);
+	close(fds[0]);
+
+	int status;
+	struct rusage usage;
+	while (wait4(pid, &status, 0, &usage) == -1 && errno == EINTR)
+		;
+
+	if (got)
+		*result = child;
+	else if (WIFSIGNALED(status) && WTERMSIG(status) == SIGALRM)
+		result->status = BenchTimeout;
+
+	// ru_maxrss is in kilobytes on Linux
+	result->peak_rss = usage.ru_maxrss * 1024L;
+}
+
+static void print_json_string(FILE *out, char *s)
+{
+	fputc('"', out);
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\')
+			fprintf(out, "\\%c", *s);
+		else if ((unsigned char)*s < 0x20)
+			fprintf(out, "\\u%04x", *s);
+		else
+			fputc(*s, out);
+	}
+	fputc('"', out);
+}
+
+static const char *status_names[] = {"ok", "unsupported", "failed", "timeout"};
+
+static void print_json_result(FILE *out, BenchFamily *family, BenchEngine *engine,
+							  BenchResult *r, int first)
+{
+	fprintf(out, "%s\n\t\t{\"family\": ", first ? "" : ",");
+	print_json_string(out, family->name);
+	fprintf(out, ", \"corpus\": ");
+	print_json_string(out, family->corpus);
+	fprintf(out, ", \"pattern\": ");
+	print_json_string(out, family->regex);
+	fprintf(out, ", \"engine\": ");
+	print_json_string(out, engine->name);
+	fprintf(out, ", \"status\": \"%s\"", status_names[r->status]);
+
+	if (r->status == BenchOk) {
+		double per_run = r->seconds / r->runs;
+		fprintf(out, ",\n\t\t \"bytes\": %ld, \"runs\": %ld, \"seconds_per_run\": %.9f",
+				r->bytes, r->runs, per_run);
+		fprintf(out, ", \"mb_per_s\": %.3f, \"matches\": %ld, \"match_unit\": \"%s\", \"matches_per_s\": %.1f",
+				r->bytes / per_run / (1 << 20), r->matches, engine->unit, r->matches / per_run);
+		fprintf(out, ",\n\t\t \"peak_rss_bytes\": %ld, \"allocations_per_run\": %ld, \"allocated_bytes_per_run\": %ld",
+				r->peak_rss, r->allocations, r->allocated);
+		fprintf(out, ", \"peak_threads\": %ld", r->peak_threads);
+	}
+	fprintf(out, "}");
+}
+
+static int matches_filter(char *filter, BenchFamily *family, BenchEngine *engine)
+{
+	return !filter || strstr(family->name, filter) || strstr(family->corpus, filter)
+		|| strstr(engine->name, filter);
+}
+
+static BenchEngine *find_engine(char *name)
+{
+	int i;
+	for (i = 0; i < bench_num_engines; i++) {
+		if (!strcmp(bench_engines[i].name, name))
+			return &bench_engines[i];
+	}
+	return 0;
+}
+
+/**
+ * Builds the pattern for step \a x of \a scaling's sweep.
+ */
+static char *scaling_regex(BenchScaling *scaling, long x)
+{
+	char *regex;
+	if (scaling->dimension == ScaleRepeat) {
+		int len = snprintf(0, 0, scaling->regex, (int)x);
+		regex = malloc(len + 1);
+		snprintf(regex, len + 1, scaling->regex, (int)x);
+	}
+	else if (scaling->dimension == ScaleDepth) {
+		long open_len = strlen(scaling->open), close_len = strlen(scaling->close);
+		long inner_len = strlen(scaling->regex);
+		regex = malloc((open_len + close_len) * x + inner_len + 1);
+
+		char *c = regex;
+		long i;
+		for (i = 0; i < x; i++, c += open_len)
+			memcpy(c, scaling->open, open_len);
+		memcpy(c, scaling->regex, inner_len);
+		c += inner_len;
+		for (i = 0; i < x; i++, c += close_len)
+			memcpy(c, scaling->close, close_len);
+		*c = '\0';
+	}
+	else
+		regex = strdup(scaling->regex);
+	return regex;
+}
+
+/**
+ * Fits y = a * x^b by least squares on a log-log scale.
+ *
+ * \return b, or NAN with fewer than two usable points
+ */
+static double fit_exponent(double *xs, double *ys, int n)
+{
+	double sx = 0, sy = 0, sxx = 0, sxy = 0;
+	int used = 0;
+
+	int i;
+	for (i = 0; i < n; i++) {
+		if (xs[i] <= 0 || ys[i] <= 0)
+			continue;
+
+		double lx = log(xs[i]), ly = log(ys[i]);
+		sx += lx;
+		sy += ly;
+		sxx += lx * lx;
+		sxy += lx * ly;
+		used++;
+	}
+
+	if (used < 2 || used * sxx - sx * sx == 0)
+		return NAN;
+	return (used * sxy - sx * sy) / (used * sxx - sx * sx);
+}
+
+static void print_json_exponent(FILE *out, char *name, double exponent)
+{
+	if (isnan(exponent))
+		fprintf(out, ", \"%s\": null", name);
+	else
+		fprintf(out, ", \"%s\": %.3f", name, exponent);
+}
+
+/**
+ * Sweeps one scaling family and writes its points and fitted exponents.
+ * A sweep stops at its first timeout or failure, since every larger step
+ * would only take longer.
+ *
+ * \return Whether the time grew faster than \a threshold allows
+ */
+static int run_scaling(FILE *out, BenchScaling *scaling, BenchEngine *engine, double min_time,
+					   int timeout, double threshold, int first)
+{
+	double xs[scaling->steps], times[scaling->steps], threads[scaling->steps];
+	int num_points = 0;
+
+	fprintf(out, "%s\n\t\t{\"family\": ", first ? "" : ",");
+	print_json_string(out, scaling->name);
+	fprintf(out, ", \"corpus\": ");
+	print_json_string(out, scaling->corpus);
+	fprintf(out, ", \"engine\": ");
+	print_json_string(out, engine->name);
+	fprintf(out, ", \"dimension\": \"%s\", \"pattern\": ", dimension_names[scaling->dimension]);
+	print_json_string(out, scaling->regex);
+	fprintf(out, ",\n\t\t \"points\": [");
+
+	long x = scaling->first;
+	int i;
+	for (i = 0; i < scaling->steps; i++, x *= 2) {
+		char *regex = scaling_regex(scaling, x);
+		BenchFamily family = {scaling->name, scaling->corpus, regex, 0, 0,
+							  scaling->dimension == ScaleInput ? x : scaling->size};
+
+		BenchResult r;
+		fork_case(&family, engine, family.size, min_time, timeout, &r);
+
+		fprintf(out, "%s\n\t\t\t{\"size\": %ld, \"pattern\": ", i == 0 ? "" : ",", x);
+		print_json_string(out, regex);
+		fprintf(out, ", \"status\": \"%s\"", status_names[r.status]);
+		if (r.status == BenchOk) {
+			fprintf(out, ", \"bytes\": %ld, \"seconds_per_run\": %.9f, \"peak_threads\": %ld, \"peak_rss_bytes\": %ld",
+					r.bytes, r.seconds / r.runs, r.peak_threads, r.peak_rss);
+
+			xs[num_points] = x;
+			times[num_points] = r.seconds / r.runs;
+			threads[num_points] = r.peak_threads;
+			num_points++;
+		}
+		fprintf(out, "}");
+
+		fprintf(stderr, "%-18s %-20s %8ld ", scaling->name, engine->name, x);
+		if (r.status == BenchOk)
+			fprintf(stderr, "%14.6f s %10ld threads\n", r.seconds / r.runs, r.peak_threads);
+		else
+			fprintf(stderr, "%s\n", status_names[r.status]);
+
+		free(regex);
+		if (r.status != BenchOk)
+			break;
+	}
+
+	double exponent = fit_exponent(xs, times, num_points);
+	double thread_exponent = fit_exponent(xs, threads, num_points);
+
+	// a sweep cut short by a timeout has grown too fast whatever the fit says
+	int superlinear = (num_points < scaling->steps) || exponent > threshold;
+
+	fprintf(out, "\n\t\t ]");
+	print_json_exponent(out, "exponent", exponent);
+	print_json_exponent(out, "thread_exponent", thread_exponent);
+	fprintf(out, ", \"superlinear\": %s}", superlinear ? "true" : "false");
+
+	fprintf(stderr, "%-18s %-20s exponent %.2f in %s%s\n", scaling->name, engine->name, exponent,
+			dimension_names[scaling->dimension], superlinear ? ", SUPER-LINEAR" : "");
+	return superlinear;
+}
+
+int main(int argc, char **argv)
+{
+	char *json_path = 0;
+	long size = 1 << 20;
+	double min_time = 0.5;
+	int timeout = 30;
+	char *filter = 0;
+	int scaling = 0;
+	double threshold = 1.2;
+
+	int i, j;
+	for (i = 1; i < argc; i++) {
+		if ((!strcmp(argv[i], "-o") || !strcmp(argv[i], "--json")) && i+1 < argc)
+			json_path = argv[++i];
+		else if ((!strcmp(argv[i], "-s") || !strcmp(argv[i], "--size")) && i+1 < argc)
+			size = atol(argv[++i]);
+		else if ((!strcmp(argv[i], "-t") || !strcmp(argv[i], "--min-time")) && i+1 < argc)
+			min_time = atof(argv[++i]);
+		else if ((!strcmp(argv[i], "-T") || !strcmp(argv[i], "--timeout")) && i+1 < argc)
+			timeout = atoi(argv[++i]);
+		else if ((!strcmp(argv[i], "-f") || !strcmp(argv[i], "--filter")) && i+1 < argc)
+			filter = argv[++i];
+		else if (!strcmp(argv[i], "--scaling"))
+			scaling = 1;
+		else if (!strcmp(argv[i], "--threshold") && i+1 < argc)
+			threshold = atof(argv[++i]);
+		else
+			print_usage();
+	}
+
+	FILE *out = stdout;
+	if (json_path && !(out = fopen(json_path, "w"))) {
+		fprintf(stderr, "error: could not open %s\n", json_path);
+		exit(1);
+	}
+
+	if (scaling) {
+		fprintf(out, "{\n\t\"min_time\": %f,\n\t\"threshold\": %f,\n\t\"scaling\": [", min_time,
+				threshold);
+
+		int first = 1, num_superlinear = 0;
+		for (i = 0; i < sizeof(scalings) / sizeof(scalings[0]); i++) {
+			BenchScaling *s = &scalings[i];
+			BenchEngine *engine = find_engine(s->engine);
+			if (!engine || (filter && !strstr(s->name, filter) && !strstr(s->corpus, filter)
+							&& !strstr(s->engine, filter)))
+				continue;
+
+			num_superlinear += run_scaling(out, s, engine, min_time, timeout, threshold, first);
+			first = 0;
+		}
+
+		fprintf(out, "\n\t]\n}\n");
+		if (out != stdout)
+			fclose(out);
+
+		fprintf(stderr, "%d super-linear famil%s\n", num_superlinear, num_superlinear == 1 ? "y" : "ies");
+		return 0;
+	}
+
+	// the fixed families, then a?^n a^n for each size
+	int num_fixed = sizeof(families) / sizeof(families[0]);
+	int num_pathological = sizeof(pathological_sizes) / sizeof(pathological_sizes[0]);
+	int num_families = num_fixed + num_pathological;
+	BenchFamily *all = malloc(sizeof(BenchFamily) * num_families);
+	memcpy(all, families, sizeof(families));
+
+	for (i = 0; i < num_pathological; i++) {
+		int n = pathological_sizes[i];
+		char *regex = malloc(3 * n + 1);
+		for (j = 0; j < n; j++)
+			memcpy(regex + 2 * j, "a?", 2);
+		memset(regex + 2 * n, 'a', n);
+		regex[3 * n] = '\0';
+
+		char *name = malloc(32);
+		sprintf(name, "pathological-%d", n);
+
+		BenchFamily family = {name, "pathological", regex, regex, 1, n};
+		all[num_fixed + i] = family;
+	}
+
+	fprintf(out, "{\n\t\"corpus_size\": %ld,\n\t\"min_time\": %f,\n\t\"results\": [", size, min_time);
+
+	int first = 1;
+	for (i = 0; i < num_families; i++) {
+		for (j = 0; j < bench_num_engines; j++) {
+			BenchFamily *family = &all[i];
+			BenchEngine *engine = &bench_engines[j];
+			if (!matches_filter(filter, family, engine))
+				continue;
+
+			BenchResult r;
+			fork_case(family, engine, size, min_time, timeout, &r);
+			if (r.status == BenchUnsupported)
+				continue;
+
+			print_json_result(out, family, engine, &r, first);
+			first = 0;
+
+			fprintf(stderr, "%-16s %-8s %-20s ", family->name, family->corpus, engine->name);
+			if (r.status == BenchOk)
+				fprintf(stderr, "%10.2f MB/s %14.0f %s/s %8ld KB\n",
+						r.bytes / (r.seconds / r.runs) / (1 << 20),
+						r.matches / (r.seconds / r.runs), engine->unit, r.peak_rss / 1024);
+			else
+				fprintf(stderr, "%s\n", status_names[r.status]);
+		}
+	}
+
+	fprintf(out, "\n\t]\n}\n");
+	if (out != stdout)
+		fclose(out);
+
+	for (i = num_fixed; i < num_families; i++) {
+		free(all[i].name);
+		free(all[i].regex);
+	}
+	free(all);
+	return 0;
+}
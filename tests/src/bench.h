@@ -0,0 +1,89 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+typedef struct BenchCorpus BenchCorpus;
+typedef struct BenchFamily BenchFamily;
+typedef struct BenchEngine BenchEngine;
+
+typedef void *(*BenchPrepareFunc)(BenchFamily *, BenchCorpus *);
+typedef long (*BenchRunFunc)(void *, BenchCorpus *);
+typedef void (*BenchFinishFunc)(void *);
+
+/**
+ * A deterministic input, generated from a fixed seed so that every engine
+ * and every run sees the same bytes.
+ */
+struct BenchCorpus
+{
+	char *name;
+
+	// NUL-terminated, for the engines that need it
+	char *text;
+	long len;
+
+	// a copy of the text with each line NUL-terminated, for the line-at-a-time
+	// engines; filled in by bench_corpus_split_lines()
+	char *line_text;
+	char **lines;
+	long *line_lens;
+	long num_lines;
+};
+
+/**
+ * One pattern, written in the syntax of each kind of engine, and the corpus
+ * it's run over.
+ */
+struct BenchFamily
+{
+	char *name;
+	char *corpus;
+
+	// ascii expression syntax
+	char *regex;
+
+	// the syntax of the engines in original/, or 0 if they can't express the
+	// pattern
+	char *original;
+
+	// match only at the start of each line
+	int anchored;
+
+	// corpus size, or 0 for the default
+	long size;
+};
+
+/**
+ * An engine prepares its state for a family once, untimed, then runs over the
+ * whole corpus as many times as it takes to fill the minimum time.
+ */
+struct BenchEngine
+{
+	char *name;
+
+	// what an engine's match count counts: every match, or matching lines
+	char *unit;
+
+	// returns 0 if the engine can't run the family
+	BenchPrepareFunc prepare;
+	BenchRunFunc run;
+	BenchFinishFunc finish;
+
+	// runs once more, untimed, and returns the most threads alive at any one
+	// step; 0 for engines that can't say
+	BenchRunFunc count_threads;
+};
+
+BenchCorpus *new_bench_corpus(char *, long);
+void free_bench_corpus(BenchCorpus *);
+void bench_corpus_split_lines(BenchCorpus *);
+
+extern BenchEngine bench_engines[];
+extern int bench_num_engines;
+
+void *bench_original_pike_prepare(BenchFamily *, BenchCorpus *);
+void *bench_original_thompson_prepare(BenchFamily *, BenchCorpus *);
+void *bench_original_backtrack_prepare(BenchFamily *, BenchCorpus *);
+long bench_original_run(void *, BenchCorpus *);
+void bench_original_finish(void *);
+
+#endif
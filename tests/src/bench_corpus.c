@@ -0,0 +1,204 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+
+/**
+ * \file
+ *
+ * Corpus generators. Each one is driven by its own xorshift generator with a
+ * fixed seed, so a corpus of a given name and size is the same on every
+ * machine and in every run.
+ */
+
+typedef struct BenchWriter BenchWriter;
+
+struct BenchWriter
+{
+	char *text;
+	long len;
+	long size;
+	unsigned long long state;
+};
+
+static unsigned long next_random(BenchWriter *w)
+{
+	w->state ^= w->state << 13;
+	w->state ^= w->state >> 7;
+	w->state ^= w->state << 17;
+	return (unsigned long)(w->state >> 16);
+}
+
+#define pick(w, array) (array[next_random(w) % (sizeof(array) / sizeof(array[0]))])
+
+/**
+ * Appends at most the bytes left before \a w is full.
+ */
+static void write_string(BenchWriter *w, const char *s)
+{
+	long len = strlen(s);
+	if (len > w->size - w->len)
+		len = w->size - w->len;
+	memcpy(w->text + w->len, s, len);
+	w->len += len;
+}
+
+static void generate_log(BenchWriter *w)
+{
+	static const char *levels[] = {"INFO", "INFO", "INFO", "INFO", "DEBUG", "DEBUG", "WARN", "ERROR"};
+	static const char *methods[] = {"GET", "GET", "GET", "POST", "PUT", "DELETE"};
+	static const char *resources[] = {"items", "users", "orders", "carts", "sessions"};
+	static const int statuses[] = {200, 200, 200, 201, 204, 304, 404, 500};
+	static const char *users[] = {"alice", "bob", "carol", "dave", "eve", "mallory", "trent"};
+
+	char line[256];
+	while (w->len < w->size) {
+		// draw every field in order first; the order in which arguments are
+		// evaluated isn't fixed
+		unsigned long month = next_random(w) % 12 + 1;
+		unsigned long day = next_random(w) % 28 + 1;
+		unsigned long hour = next_random(w) % 24;
+		unsigned long minute = next_random(w) % 60;
+		unsigned long second = next_random(w) % 60;
+		const char *level = pick(w, levels);
+		unsigned long worker = next_random(w) % 16;
+		const char *method = pick(w, methods);
+		const char *resource = pick(w, resources);
+		unsigned long id = next_random(w) % 100000;
+		int status = pick(w, statuses);
+		unsigned long ms = next_random(w) % 2000;
+		const char *user = pick(w, users);
+
+		snprintf(line, sizeof(line),
+				 "2014-%02lu-%02lu %02lu:%02lu:%02lu %s [worker-%lu] %s /api/v1/%s/%lu %d %lums user=%s\n",
+				 month, day, hour, minute, second, level, worker, method, resource, id, status,
+				 ms, user);
+		write_string(w, line);
+	}
+}
+
+static void generate_random(BenchWriter *w)
+{
+	long line_end = 0;
+	while (w->len < w->size) {
+		if (w->len >= line_end) {
+			if (w->len > 0)
+				w->text[w->len++] = '\n';
+			line_end = w->len + 40 + next_random(w) % 80;
+		}
+		else
+			w->text[w->len++] = ' ' + next_random(w) % ('~' - ' ' + 1);
+	}
+}
+
+static void generate_unicode(BenchWriter *w)
+{
+	static const char *words[] = {
+		"the", "data", "running", "testing", "string", "naïve", "café", "Straße",
+		"façade", "smörgåsbord", "日本語", "文字列", "Ελληνικά", "λόγος", "привет",
+		"строка", "עברית", "العربية", "emoji😀", "jalapeño"
+	};
+
+	while (w->len < w->size) {
+		int num_words = 4 + next_random(w) % 10;
+		int i;
+		for (i = 0; i < num_words && w->len < w->size; i++) {
+			const char *word = pick(w, words);
+
+			// pad the end with newlines rather than cut a character in half
+			if (w->len + (long)strlen(word) + 1 > w->size) {
+				while (w->len < w->size)
+					w->text[w->len++] = '\n';
+				break;
+			}
+
+			write_string(w, word);
+			write_string(w, i == num_words - 1 ? "\n" : " ");
+		}
+	}
+}
+
+/**
+ * The input half of the classic pathological case for backtracking, a?^n
+ * a^n against a^n: \a size is n.
+ */
+static void generate_pathological(BenchWriter *w)
+{
+	memset(w->text, 'a', w->size);
+	w->len = w->size;
+}
+
+/**
+ * Generates the corpus called \a name, \a size bytes long.
+ *
+ * \return The corpus, or 0 if there's no generator called \a name
+ */
+BenchCorpus *new_bench_corpus(char *name, long size)
+{
+	BenchWriter w = {malloc(size + 1), 0, size, 88172645463325252ULL};
+
+	if (!strcmp(name, "log"))
+		generate_log(&w);
+	else if (!strcmp(name, "random"))
+		generate_random(&w);
+	else if (!strcmp(name, "unicode"))
+		generate_unicode(&w);
+	else if (!strcmp(name, "pathological"))
+		generate_pathological(&w);
+	else {
+		free(w.text);
+		return 0;
+	}
+	w.text[w.len] = '\0';
+
+	BenchCorpus *corpus = calloc(1, sizeof(BenchCorpus));
+	corpus->name = name;
+	corpus->text = w.text;
+	corpus->len = w.len;
+	return corpus;
+}
+
+void free_bench_corpus(BenchCorpus *corpus)
+{
+	if (corpus) {
+		free(corpus->text);
+		free(corpus->line_text);
+		free(corpus->lines);
+		free(corpus->line_lens);
+		free(corpus);
+	}
+}
+
+void bench_corpus_split_lines(BenchCorpus *corpus)
+{
+	if (corpus->lines)
+		return;
+
+	corpus->line_text = malloc(corpus->len + 1);
+	memcpy(corpus->line_text, corpus->text, corpus->len + 1);
+
+	long max_lines = 1;
+	long i;
+	for (i = 0; i < corpus->len; i++) {
+		if (corpus->text[i] == '\n')
+			max_lines++;
+	}
+
+	corpus->lines = malloc(sizeof(char *) * max_lines);
+	corpus->line_lens = malloc(sizeof(long) * max_lines);
+
+	long start = 0;
+	for (i = 0; i <= corpus->len; i++) {
+		if (i == corpus->len || corpus->line_text[i] == '\n') {
+			// a trailing newline doesn't start another line
+			if (i == corpus->len && start == i && i > 0)
+				break;
+
+			corpus->line_text[i] = '\0';
+			corpus->lines[corpus->num_lines] = corpus->line_text + start;
+			corpus->line_lens[corpus->num_lines] = i - start;
+			corpus->num_lines++;
+			start = i + 1;
+		}
+	}
+}
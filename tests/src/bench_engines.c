@@ -0,0 +1,385 @@
+#include <Judy.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ascii_expression.h"
+#include "ascii_input.h"
+#include "ascii_inst.h"
+#include "ascii_tree.h"
+#include "reos_capture.h"
+#include "reos_debugger.h"
+#include "reos_kernel.h"
+#include "reos_stdlib.h"
+#include "standard_inst.h"
+#include "bench.h"
+
+#ifdef BENCH_ICU
+#include "unicode_input.h"
+#include "unicode_inst.h"
+#include "unicode_tree.h"
+#endif
+
+#ifdef BENCH_PCRE
+#include <pcre.h>
+#endif
+
+/**
+ * \file
+ *
+ * The engines under test: ReOS in each of its input and matching modes, the
+ * reference engines in original/ and, when it's installed, PCRE. The ReOS
+ * engines run patterns as parsed, except reos-optimized, which runs them
+ * through the tree optimizer and closures.
+ *
+ * Whole-input ReOS engines run the kernel once over the entire corpus and
+ * count every match it saves. Line engines reset the kernel for each line and
+ * count matching lines, the same as the reference engines and PCRE, so they
+ * can be compared directly.
+ */
+
+enum
+{
+	ReosString,
+	ReosFile,
+	ReosMmap,
+	ReosLine,
+	ReosUnicode
+};
+
+typedef struct BenchReos BenchReos;
+
+struct BenchReos
+{
+	int mode;
+	int ops;
+	ReOS_Pattern *pattern;
+	ReOS_Kernel *k;
+	ReOS_Input *line_input;
+	char path[64];
+};
+
+#ifdef BENCH_ICU
+/**
+ * Copies an ascii tree into a unicode one with the same structure.
+ */
+static TreeNode *unicode_tree_from_ascii(TreeNode *node)
+{
+	if (!node)
+		return 0;
+
+	TreeNode *copy = new_unicode_tree_node(node->type == NodeAsciiChar ? NodeUnicodeChar
+										   : node->type == NodeAsciiRange ? NodeUnicodeRange
+										   : node->type,
+										   unicode_tree_from_ascii(node->left),
+										   unicode_tree_from_ascii(node->right));
+	copy->x = node->x;
+	copy->y = node->y;
+
+	if (node->type == NodeAsciiChar || node->type == NodeAsciiRange) {
+		AsciiTreeNodeArgs *ascii_args = node->args;
+		UnicodeTreeNodeArgs *unicode_args = copy->args;
+		unicode_args->c1 = (unsigned char)ascii_args->c1;
+		unicode_args->c2 = (unsigned char)ascii_args->c2;
+	}
+	return copy;
+}
+#endif
+
+static void reos_finish(void *);
+
+/**
+ * Compiles \a family's pattern as parsed or, if \a optimize is set, through
+ * the tree optimizer and into closures.
+ */
+static void *reos_prepare(BenchFamily *family, BenchCorpus *corpus, int mode, int ops, int optimize)
+{
+	TreeNode *tree = ascii_expression_compile(family->regex);
+	if (!tree)
+		return 0;
+	if (optimize)
+		tree = ascii_tree_optimize(tree);
+
+	BenchReos *state = calloc(1, sizeof(BenchReos));
+	state->mode = mode;
+	state->ops = ops | (family->anchored ? REOS_ANCHORED : 0);
+	state->pattern = new_mem_pattern();
+
+	if (mode == ReosUnicode) {
+#ifdef BENCH_ICU
+		// the ascii parser reads bytes, so only ASCII patterns mean the same
+		// thing to the unicode instruction set
+		char *c;
+		for (c = family->regex; *c; c++) {
+			if (*c & 0x80) {
+				free_ascii_tree_node(tree);
+				free_mem_pattern(state->pattern);
+				free(state);
+				return 0;
+			}
+		}
+
+		TreeNode *unicode_tree = unicode_tree_from_ascii(tree);
+		standard_tree_compile(state->pattern, unicode_tree, unicode_inst_factory, unicode_tree_node_compile);
+		free_unicode_tree_node(unicode_tree);
+		state->k = new_reos_kernel(state->pattern, execute_unicode_inst, -1);
+#endif
+	}
+	else {
+		standard_tree_compile(state->pattern, tree, ascii_inst_factory, ascii_tree_node_compile);
+		if (optimize)
+			standard_pattern_compute_closures(state->pattern);
+
+		// a line only has to match once to be counted
+		state->k = new_reos_kernel(state->pattern, execute_ascii_inst, mode == ReosLine ? 1 : -1);
+		state->k->test_backref = ascii_test_backref;
+	}
+	free_ascii_tree_node(tree);
+
+	if (!state->k) {
+		free_mem_pattern(state->pattern);
+		free(state);
+		return 0;
+	}
+	state->k->history_size = standard_pattern_history_size(state->pattern);
+
+	// only the ascii instruction set can test backreferences
+	if (mode == ReosUnicode && state->k->history_size > 0) {
+		reos_finish(state);
+		return 0;
+	}
+
+	if (mode == ReosFile || mode == ReosMmap) {
+		strcpy(state->path, "/tmp/reos-bench-XXXXXX");
+		int fd = mkstemp(state->path);
+		if (fd == -1 || write(fd, corpus->text, corpus->len) != corpus->len) {
+			fprintf(stderr, "error: could not write corpus to %s\n", state->path);
+			exit(1);
+		}
+		close(fd);
+	}
+	else if (mode == ReosLine) {
+		bench_corpus_split_lines(corpus);
+		state->line_input = new_ascii_string_input("");
+	}
+
+	return state;
+}
+
+static void *reos_string_prepare(BenchFamily *family, BenchCorpus *corpus)
+{
+	return reos_prepare(family, corpus, ReosString, 0, 0);
+}
+
+static void *reos_file_prepare(BenchFamily *family, BenchCorpus *corpus)
+{
+	return reos_prepare(family, corpus, ReosFile, 0, 0);
+}
+
+static void *reos_mmap_prepare(BenchFamily *family, BenchCorpus *corpus)
+{
+	return reos_prepare(family, corpus, ReosMmap, 0, 0);
+}
+
+static void *reos_line_prepare(BenchFamily *family, BenchCorpus *corpus)
+{
+	return reos_prepare(family, corpus, ReosLine, 0, 0);
+}
+
+static void *reos_optimized_prepare(BenchFamily *family, BenchCorpus *corpus)
+{
+	return reos_prepare(family, corpus, ReosString, 0, 1);
+}
+
+static void *reos_backtrack_prepare(BenchFamily *family, BenchCorpus *corpus)
+{
+	return reos_prepare(family, corpus, ReosString, REOS_BACKTRACK_MATCHING, 0);
+}
+
+#ifdef BENCH_ICU
+static void *reos_unicode_prepare(BenchFamily *family, BenchCorpus *corpus)
+{
+	return reos_prepare(family, corpus, ReosUnicode, 0, 0);
+}
+#endif
+
+static long reos_run(void *d, BenchCorpus *corpus)
+{
+	BenchReos *state = (BenchReos *)d;
+	ReOS_Kernel *k = state->k;
+	long matches = 0;
+
+	if (state->mode == ReosLine) {
+		AsciiStringInputData *data = (AsciiStringInputData *)state->line_input->data;
+
+		long i;
+		for (i = 0; i < corpus->num_lines; i++) {
+			data->string = corpus->lines[i];
+			data->len = corpus->line_lens[i];
+			data->pos = 0;
+
+			reos_kernel_clear_matches(k);
+			reos_kernel_execute(k, state->line_input, 0, state->ops);
+			matches += k->num_capturesets;
+		}
+		return matches;
+	}
+
+	ReOS_Input *input;
+	switch (state->mode) {
+	case ReosFile:
+		input = new_ascii_file_input(state->path);
+		break;
+	case ReosMmap:
+		input = new_ascii_mmap_input(state->path);
+		break;
+#ifdef BENCH_ICU
+	case ReosUnicode:
+		input = new_unicode_string_input(corpus->text);
+		break;
+#endif
+	default:
+		input = new_ascii_string_input(corpus->text);
+		break;
+	}
+
+	reos_kernel_clear_matches(k);
+	reos_kernel_execute(k, input, 0, state->ops);
+	matches = k->num_capturesets;
+
+	// the kernel's token buffer still refers to the input
+	free_reos_tokenbuffer(k->token_buf);
+	k->token_buf = 0;
+
+	switch (state->mode) {
+	case ReosFile:
+		free_ascii_file_input(input);
+		break;
+	case ReosMmap:
+		free_ascii_mmap_input(input);
+		break;
+#ifdef BENCH_ICU
+	case ReosUnicode:
+		free_unicode_string_input(input);
+		break;
+#endif
+	default:
+		free_ascii_string_input(input);
+		break;
+	}
+
+	return matches;
+}
+
+static void reos_finish(void *d)
+{
+	BenchReos *state = (BenchReos *)d;
+	reos_kernel_clear_matches(state->k);
+	free_reos_kernel(state->k);
+	free_mem_pattern(state->pattern);
+	free_ascii_string_input(state->line_input);
+	if (state->path[0])
+		unlink(state->path);
+	free(state);
+}
+
+static void count_threads_before_token(ReOS_Debugger *debugger, ReOS_Kernel *k)
+{
+	long *peak = debugger->data;
+	long threads = reos_compoundlist_length(k->state.current_thread_list->list);
+	if (threads > *peak)
+		*peak = threads;
+}
+
+/**
+ * Runs the kernel once with a debugger that counts the threads it steps
+ * through for each token.
+ */
+static long reos_count_threads(void *d, BenchCorpus *corpus)
+{
+	BenchReos *state = (BenchReos *)d;
+	long peak = 0;
+
+	ReOS_Debugger debugger;
+	debugger_reset(&debugger);
+	debugger.before_token = count_threads_before_token;
+	debugger.data = &peak;
+
+	reos_simplelist_push_tail(state->k->debuggers, &debugger);
+	reos_run(d, corpus);
+
+	free_reos_simplelist(state->k->debuggers);
+	state->k->debuggers = new_reos_simplelist(0);
+	return peak;
+}
+
+#ifdef BENCH_PCRE
+typedef struct BenchPcre BenchPcre;
+
+struct BenchPcre
+{
+	pcre *re;
+	pcre_extra *extra;
+};
+
+static void *pcre_prepare(BenchFamily *family, BenchCorpus *corpus)
+{
+	const char *error;
+	int error_offset;
+	pcre *re = pcre_compile(family->regex, family->anchored ? PCRE_ANCHORED : 0, &error,
+							&error_offset, 0);
+	if (!re)
+		return 0;
+
+	bench_corpus_split_lines(corpus);
+
+	BenchPcre *state = malloc(sizeof(BenchPcre));
+	state->re = re;
+	state->extra = pcre_study(re, 0, &error);
+	return state;
+}
+
+static long pcre_run(void *d, BenchCorpus *corpus)
+{
+	BenchPcre *state = (BenchPcre *)d;
+	int ovector[30];
+	long matches = 0;
+
+	long i;
+	for (i = 0; i < corpus->num_lines; i++) {
+		if (pcre_exec(state->re, state->extra, corpus->lines[i], corpus->line_lens[i], 0, 0,
+					  ovector, 30) >= 0)
+			matches++;
+	}
+	return matches;
+}
+
+static void pcre_finish(void *d)
+{
+	BenchPcre *state = (BenchPcre *)d;
+	if (state->extra)
+		pcre_free_study(state->extra);
+	pcre_free(state->re);
+	free(state);
+}
+#endif
+
+BenchEngine bench_engines[] = {
+	{"reos-string", "matches", reos_string_prepare, reos_run, reos_finish, reos_count_threads},
+	{"reos-file", "matches", reos_file_prepare, reos_run, reos_finish, reos_count_threads},
+	{"reos-mmap", "matches", reos_mmap_prepare, reos_run, reos_finish, reos_count_threads},
+	{"reos-optimized", "matches", reos_optimized_prepare, reos_run, reos_finish, reos_count_threads},
+	{"reos-backtrack-caps", "matches", reos_backtrack_prepare, reos_run, reos_finish, reos_count_threads},
+#ifdef BENCH_ICU
+	{"reos-unicode", "matches", reos_unicode_prepare, reos_run, reos_finish, reos_count_threads},
+#endif
+	{"reos-line", "lines", reos_line_prepare, reos_run, reos_finish, reos_count_threads},
+	{"original-pike", "lines", bench_original_pike_prepare, bench_original_run, bench_original_finish},
+	{"original-thompson", "lines", bench_original_thompson_prepare, bench_original_run, bench_original_finish},
+	{"original-backtrack", "lines", bench_original_backtrack_prepare, bench_original_run, bench_original_finish},
+#ifdef BENCH_PCRE
+	{"pcre", "lines", pcre_prepare, pcre_run, pcre_finish},
+#endif
+};
+
+int bench_num_engines = sizeof(bench_engines) / sizeof(bench_engines[0]);
@@ -1,80 +1,394 @@
-//#include <Judy.h>
-#include "pikevm_types.h"
-//#include "utarray.h"
-#include "pikevm_stdlib.h"
-#include "pikevm_list.h"
+#include <Judy.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "reos_capture.h"
+#include "reos_list.h"
+#include "reos_stdlib.h"
+#include "reos_thread.h"
+#include "reos_types.h"
 
-int main(int argc, char **argv)
+/**
+ * \file
+ *
+ * Microbenchmarks for the kernel's data structures, without a pattern, an
+ * input or a kernel around them.
+ *
+ * Each case does one batch of operations on a structure of a given size,
+ * shaped like the work the kernel does on it during a step, and is repeated
+ * until the minimum time has passed. The cost is reported per operation.
+ *
+ * The list layouts differ between builds, so run it once per layout and
+ * compare:
+ *
+\verbatim
+scons OPTIMIZE=size bench_lists
+scons OPTIMIZE=speed bench_lists
+\endverbatim
+ */
+
+#ifdef OPTIMIZE_FOR_SPEED
+#define STR(x) #x
+#define XSTR(x) STR(x)
+#define BUILD_NAME "speed (" XSTR(CACHE_LINE_SIZE) " byte lines)"
+#elif defined(CONST_CLIST_SIZE)
+#define BUILD_NAME "size_const_clist"
+#else
+#define BUILD_NAME "size"
+#endif
+
+// the block size the kernel gives its thread and free lists
+#define BLOCK_SIZE 32
+
+typedef struct BenchCase BenchCase;
+
+/**
+ * Does one batch of operations on structures of size \a n.
+ *
+ * \return The number of operations done
+ */
+typedef long (*BenchCaseFunc)(int n);
+
+struct BenchCase
 {
-	int j;
-	int times = 20;//atoi(argv[1]);
-	int compound_size = 8;//atoi(argv[2]);
+	char *name;
+	BenchCaseFunc run;
+	int sizes[4];
+};
 
-	/*Pvoid_t judy = NULL;
-	for (j = 0; j < times; j++)
-		judy_insert(judy, j, (void *)0x1);
+// keeps the compiler from throwing away loops whose results aren't used
+static volatile long sink;
 
-	judy_iter_begin(void, x, judy)
-		judy_iter_next(x, judy);
+static ReOS_CompoundList *compound;
+static ReOS_JudyList *judy;
+static ReOS_ThreadList *threads;
+static ReOS_CompoundList *free_threads;
+static ReOS_CaptureSet *set;
+static ReOS_CompoundList *free_sets;
 
-	free_judy(judy, 0);*/
+// the sizes the structures above were last filled to, so the cases don't
+// have to measure them every time
+static int compound_size;
+static int judy_size = -1;
+static int set_size = -1;
 
-	CompoundList *compound = new_compoundlist(compound_size, 0, 0);
-	for (j = 0; j < times; j++)
-		compoundlist_push_tail(compound, (void *)0x1);
+static void fill_compoundlist(int n)
+{
+	if (compound_size == n)
+		return;
 
-	foreach_compound(void, y, compound)
-	{}
+	free_reos_compoundlist(compound);
+	compound = new_reos_compoundlist(BLOCK_SIZE, 0, 0);
+	compound_size = n;
 
-	for (j = 0; j < times; j++)
-		compoundlist_pop_head(compound);
+	int i;
+	for (i = 0; i < n; i++)
+		reos_compoundlist_push_tail(compound, (void *)(long)(i + 1));
+}
+
+static long compound_push_tail_pop_head(int n)
+{
+	int i;
+	for (i = 0; i < n; i++)
+		reos_compoundlist_push_tail(compound, (void *)(long)(i + 1));
+	for (i = 0; i < n; i++)
+		sink += (long)reos_compoundlist_pop_head(compound);
+	return 2 * n;
+}
 
-	free_compoundlist(compound);
+static long compound_push_head_pop_head(int n)
+{
+	int i;
+	for (i = 0; i < n; i++)
+		reos_compoundlist_push_head(compound, (void *)(long)(i + 1));
+	for (i = 0; i < n; i++)
+		sink += (long)reos_compoundlist_pop_head(compound);
+	return 2 * n;
+}
 
-	/*SimpleList *simple = new_simplelist(0);
-	for (j = 0; j < times; j++)
-		simplelist_push_head(simple, (void *)0x1);
+static long compound_push_tail_pop_tail(int n)
+{
+	int i;
+	for (i = 0; i < n; i++)
+		reos_compoundlist_push_tail(compound, (void *)(long)(i + 1));
+	for (i = 0; i < n; i++)
+		sink += (long)reos_compoundlist_pop_tail(compound);
+	return 2 * n;
+}
 
-	foreach_simple(void, z, simple)
-	{}
+static long compound_iterate(int n)
+{
+	fill_compoundlist(n);
 
-	for (j = 0; j < times; j++)
-		simplelist_pop_head(simple);
+	long sum = 0;
+	foreach_compound(void, e, compound)
+		sum += (long)e;
+	sink += sum;
+	return n;
+}
 
-	free_simplelist(simple);*/
+/**
+ * Shares the list: the clone only bumps a reference count.
+ */
+static long compound_clone(int n)
+{
+	fill_compoundlist(n);
 
-	/*UT_array *ut;
-	utarray_new(ut, &ut_int_icd);
-	utarray_reserve(ut, compound_size);
+	ReOS_CompoundList *clone = reos_compoundlist_clone(compound);
+	free_reos_compoundlist(clone);
+	return 1;
+}
 
-	for (j = 0; j < times; j++)
-		utarray_push_back(ut, &j);
+/**
+ * Copies a shared list's elements into a list of its own, as writing to a
+ * clone does.
+ */
+static long compound_unshare(int n)
+{
+	fill_compoundlist(n);
+
+	ReOS_CompoundList *clone = reos_compoundlist_clone(compound);
+	reos_compoundlist_unshare(clone);
+	free_reos_compoundlist(clone);
+	return 1;
+}
+
+// a shared list references and dereferences its elements through these
+static void ref_element(void *e)
+{
+	sink++;
+}
+
+static void deref_element(void *e)
+{
+	sink--;
+}
+
+static void fill_judylist(int n)
+{
+	if (judy_size == n)
+		return;
+
+	free_reos_judylist(judy);
+	judy = new_reos_judylist(0, deref_element, 0, ref_element);
+	judy_size = n;
+
+	// reos_judylist_insert() is two statements
+	int i;
+	for (i = 0; i < n; i++) {
+		reos_judylist_insert(judy, i, (void *)(long)(i + 1));
+	}
+}
+
+static long judy_clone(int n)
+{
+	fill_judylist(n);
+
+	ReOS_JudyList *clone = reos_judylist_clone(judy);
+	free_reos_judylist(clone);
+	return 1;
+}
+
+/**
+ * Clones the list and writes to the clone, which copies it.
+ */
+static long judy_clone_write(int n)
+{
+	fill_judylist(n);
 
-	int *p;
-	for (p = (int *)utarray_front(ut); p != NULL; p = (int *)utarray_next(ut, p))
-	{}
+	ReOS_JudyList *clone = reos_judylist_clone(judy);
+	reos_judylist_insert(clone, 0, (void *)1L);
+	free_reos_judylist(clone);
+	return 1;
+}
+
+static long judy_iterate(int n)
+{
+	fill_judylist(n);
+
+	long sum = 0;
+	reos_judylist_iter_begin(void, e, judy) {
+		sum += (long)e;
+		reos_judylist_iter_next(e, judy);
+	}
+	sink += sum;
+	return n;
+}
+
+/**
+ * One kernel step: \a n threads at distinct pcs are added to a list and then
+ * run off it.
+ */
+static long threadlist_push_pop(int n)
+{
+	int i;
+	for (i = 0; i < n; i++) {
+		ReOS_Thread *t = new_reos_thread(free_threads, i);
+		t->capture_set = set;
+		reos_captureset_ref(set);
+		reos_threadlist_push_tail(threads, t, 0);
+	}
+
+	ReOS_Thread *t;
+	for (i = 0; i < n && (t = reos_threadlist_pop_head(threads)); i++)
+		free_reos_thread(t);
+
+	threads->gen++;
+	return 2 * n;
+}
+
+/**
+ * As above, but every pc is added twice, so half the threads are turned away
+ * as duplicates.
+ */
+static long threadlist_dedup(int n)
+{
+	int i;
+	for (i = 0; i < 2 * n; i++) {
+		ReOS_Thread *t = new_reos_thread(free_threads, i % n);
+		t->capture_set = set;
+		reos_captureset_ref(set);
+		reos_threadlist_push_tail(threads, t, 0);
+	}
+
+	ReOS_Thread *t;
+	for (i = 0; i < n && (t = reos_threadlist_pop_head(threads)); i++)
+		free_reos_thread(t);
+
+	threads->gen++;
+	return 3 * n;
+}
+
+static void fill_captureset(int n)
+{
+	if (set_size == n)
+		return;
+
+	reos_captureset_deref(set);
+	set = new_reos_captureset(free_sets);
+	set_size = n;
+
+	int i;
+	for (i = 0; i < n; i++) {
+		reos_captureset_save_start(&set, i, i);
+		reos_captureset_save_end(&set, i, i + 1);
+	}
+}
+
+/**
+ * Detaches a shared capture set with \a n captures, which copies every one.
+ */
+static long captureset_detach_shared(int n)
+{
+	fill_captureset(n);
+
+	reos_captureset_ref(set);
+	ReOS_CaptureSet *clone = reos_captureset_detach(set);
+	reos_captureset_deref(clone);
+	return 1;
+}
+
+/**
+ * Detaches a capture set nobody else holds, which only bumps its version.
+ */
+static long captureset_detach_owned(int n)
+{
+	fill_captureset(n);
+
+	set = reos_captureset_detach(set);
+	return 1;
+}
+
+static BenchCase cases[] = {
+	{"compoundlist_push_tail_pop_head", compound_push_tail_pop_head, {4, 32, 256, 4096}},
+	{"compoundlist_push_head_pop_head", compound_push_head_pop_head, {4, 32, 256, 4096}},
+	{"compoundlist_push_tail_pop_tail", compound_push_tail_pop_tail, {4, 32, 256, 4096}},
+	{"compoundlist_iterate", compound_iterate, {4, 32, 256, 4096}},
+	{"compoundlist_clone", compound_clone, {4, 32, 256, 4096}},
+	{"compoundlist_unshare", compound_unshare, {4, 32, 256, 4096}},
+	{"judylist_clone", judy_clone, {1, 4, 16, 64}},
+	{"judylist_clone_write", judy_clone_write, {1, 4, 16, 64}},
+	{"judylist_iterate", judy_iterate, {1, 4, 16, 64}},
+	{"threadlist_push_tail_pop_head", threadlist_push_pop, {4, 32, 256, 4096}},
+	{"threadlist_dedup", threadlist_dedup, {4, 32, 256, 4096}},
+	{"captureset_detach_shared", captureset_detach_shared, {1, 4, 16, 64}},
+	{"captureset_detach_owned", captureset_detach_owned, {1, 4, 16, 64}}
+};
+
+static void print_usage()
+{
+	fprintf(stderr,
+			"Usage: bench_lists [OPTION]...\n"
+			"Options:\n"
+			"	-t, --min-time SECONDS\n"
+			"		repeat each case for at least SECONDS (default: 0.2)\n"
+			"	-f, --filter STRING\n"
+			"		only run cases whose names contain STRING\n"
+			"	-h, --help\n"
+			"		display this help\n");
+	exit(0);
+}
+
+static double now()
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+	double min_time = 0.2;
+	char *filter = 0;
 
-	while ((p = (int *)utarray_back(ut)))
-		utarray_pop_back(ut);
+	int i, j;
+	for (i = 1; i < argc; i++) {
+		if ((!strcmp(argv[i], "-t") || !strcmp(argv[i], "--min-time")) && i+1 < argc)
+			min_time = atof(argv[++i]);
+		else if ((!strcmp(argv[i], "-f") || !strcmp(argv[i], "--filter")) && i+1 < argc)
+			filter = argv[++i];
+		else
+			print_usage();
+	}
 
-	utarray_free(ut);
+	compound = new_reos_compoundlist(BLOCK_SIZE, 0, 0);
+	free_threads = new_reos_compoundlist(BLOCK_SIZE, (VoidPtrFunc)delete_reos_thread, 0);
+	threads = new_reos_threadlist(BLOCK_SIZE);
+	free_sets = new_reos_compoundlist(BLOCK_SIZE, (VoidPtrFunc)delete_reos_captureset, 0);
+	set = new_reos_captureset(free_sets);
 
-	hi_handle_t *hi_handle;
-	const char *data_ptr;*/
+	printf("# build: %s\n", BUILD_NAME);
+	printf("# %-32s %6s %12s %12s\n", "case", "size", "ns/op", "ops");
 
-	/* initialize hashish handle */
-//	hi_init_str(&hi_handle, 23);
+	int num_cases = sizeof(cases) / sizeof(cases[0]);
+	for (i = 0; i < num_cases; i++) {
+		if (filter && !strstr(cases[i].name, filter))
+			continue;
 
-	/* insert an key/data pair */
-//	ret = hi_insert_str(hi_handle, key, data);
+		for (j = 0; j < 4; j++) {
+			int n = cases[i].sizes[j];
 
-	/* search for a pair with a string key and store result */
-//	hi_get_str(hi_handle, key, &data_ptr);
+			// once untimed, to settle the free lists and fill the structure
+			cases[i].run(n);
 
-//	fprintf(stdout, "Key: %s Data: %s\n", key, data_ptr);
+			long ops = 0;
+			double start = now(), seconds;
+			do {
+				int k;
+				for (k = 0; k < 64; k++)
+					ops += cases[i].run(n);
+				seconds = now() - start;
+			} while (seconds < min_time);
 
-	/* free the hashish handle */
-//	hi_fini(hi_handle);*/
+			printf("  %-32s %6d %12.2f %12ld\n", cases[i].name, n, seconds * 1e9 / ops, ops);
+		}
+	}
 
+	free_reos_compoundlist(compound);
+	free_reos_judylist(judy);
+	free_reos_threadlist(threads);
+	free_reos_compoundlist(free_threads);
+	reos_captureset_deref(set);
+	free_reos_compoundlist(free_sets);
 	return 0;
 }
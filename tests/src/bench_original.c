@@ -0,0 +1,83 @@
+#include <stdarg.h>
+#include "regexp.h"
+#include "bench.h"
+
+/**
+ * \file
+ *
+ * Runs the reference engines in original/. They only match at the start of
+ * a NUL-terminated string and stop at the first match, so they're run over
+ * each line of the corpus in turn, with a leading <tt>.*</tt> for unanchored
+ * families, and count matching lines.
+ *
+ * The Pike VM in original/ traces every step with printf(); the bench build
+ * compiles original/ with printf defined to original_trace(), below, so that
+ * formatting doesn't swamp the timings.
+ */
+
+typedef struct BenchOriginal BenchOriginal;
+
+struct BenchOriginal
+{
+	Prog *prog;
+	int (*match)(Prog *, char *, char **, int);
+};
+
+int original_trace(const char *format, ...)
+{
+	return 0;
+}
+
+static void *original_prepare(BenchFamily *family, BenchCorpus *corpus,
+							  int (*match)(Prog *, char *, char **, int))
+{
+	if (!family->original)
+		return 0;
+
+	char *regex = family->original;
+	char unanchored[strlen(regex) + 8];
+	if (!family->anchored) {
+		sprintf(unanchored, ".*(?:%s)", regex);
+		regex = unanchored;
+	}
+
+	bench_corpus_split_lines(corpus);
+
+	BenchOriginal *state = mal(sizeof(BenchOriginal));
+	state->prog = compile(parse(regex));
+	state->match = match;
+	return state;
+}
+
+void *bench_original_pike_prepare(BenchFamily *family, BenchCorpus *corpus)
+{
+	return original_prepare(family, corpus, pikevm);
+}
+
+void *bench_original_thompson_prepare(BenchFamily *family, BenchCorpus *corpus)
+{
+	return original_prepare(family, corpus, thompsonvm);
+}
+
+void *bench_original_backtrack_prepare(BenchFamily *family, BenchCorpus *corpus)
+{
+	return original_prepare(family, corpus, backtrack);
+}
+
+long bench_original_run(void *d, BenchCorpus *corpus)
+{
+	BenchOriginal *state = (BenchOriginal *)d;
+	char *sub[MAXSUB];
+	long matches = 0;
+
+	long i;
+	for (i = 0; i < corpus->num_lines; i++)
+		matches += state->match(state->prog, corpus->lines[i], sub, nelem(sub));
+	return matches;
+}
+
+void bench_original_finish(void *d)
+{
+	// original/ has no way to free a program
+	free(d);
+}
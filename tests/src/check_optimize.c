@@ -0,0 +1,320 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ascii_expression.h"
+#include "ascii_input.h"
+#include "ascii_inst.h"
+#include "ascii_tree.h"
+#include "reos_capture.h"
+#include "reos_kernel.h"
+#include "standard_inst.h"
+
+/**
+ * \file
+ *
+ * Checks that the optimizing passes leave what the kernel reports alone. Each
+ * pattern, the fixed ones below and then ones generated from a fixed seed, is
+ * compiled as parsed and through each pass, and run over every input of up
+ * to CHECK_INPUT_LENGTH a's and b's, with and without backtrack matching.
+ * Every match, with all its captures, has to come out the same as from the
+ * pattern as parsed.
+ *
+ * Exits with 1, after printing the first differences, if any pass changed
+ * anything.
+ */
+
+#define CHECK_INPUT_LENGTH 5
+#define CHECK_MAX_SHOWN 10
+
+enum
+{
+	CheckTree = 0x1,
+	CheckClosures = 0x2
+};
+
+typedef struct CheckPass CheckPass;
+
+struct CheckPass
+{
+	char *name;
+	int passes;
+};
+
+static CheckPass check_passes[] = {
+	{"tree", CheckTree},
+	{"closures", CheckClosures},
+	{"tree and closures", CheckTree | CheckClosures}
+};
+
+#define NUM_CHECK_PASSES (sizeof(check_passes) / sizeof(check_passes[0]))
+
+// patterns passes have got wrong before
+static char *check_patterns[] = {
+	"(.?(.|.a*).)",
+	"(b|a*b*|b)",
+	"(a|ab)(c|bcd)(d*)",
+	"foo|foobar|fob",
+	"(a|b)*c",
+	"x(a|b|c)+y",
+	"(ab|cd|ef)*g",
+	"a{2,5}",
+	"(?:a*)*b",
+	"(?:(a)?)+",
+	"(a*)+(b)",
+	"(a?)?" "?(a*?)",
+	"(a|ab|abc)*$",
+	"^(a+|b)*",
+	"(b?)(?:b*)*",
+	"[b]|(a)[b](?:($){0}){1,}"
+};
+
+#define NUM_CHECK_PATTERNS (sizeof(check_patterns) / sizeof(check_patterns[0]))
+
+typedef struct CheckGen CheckGen;
+
+struct CheckGen
+{
+	char *regex;
+	int len;
+	int size;
+	unsigned long long state;
+};
+
+static unsigned long next_random(CheckGen *g)
+{
+	g->state ^= g->state << 13;
+	g->state ^= g->state >> 7;
+	g->state ^= g->state << 17;
+	return (unsigned long)(g->state >> 16);
+}
+
+static void gen_append(CheckGen *g, char *s)
+{
+	int len = strlen(s);
+	if (g->len + len >= g->size) {
+		g->size = (g->len + len) * 2;
+		g->regex = realloc(g->regex, g->size);
+	}
+	strcpy(g->regex + g->len, s);
+	g->len += len;
+}
+
+static void gen_alt(CheckGen *, int);
+
+static void gen_atom(CheckGen *g, int depth)
+{
+	static char *tokens[] = {"a", "a", "b", "b", ".", "[ab]", "[a-b]"};
+	static char *quantifiers[] = {"", "", "", "?", "*", "+", "??", "*?", "+?",
+								  "{0}", "{1}", "{2}", "{0,1}", "{0,}", "{1,}", "{1,2}", "{,2}"};
+
+	unsigned long r = next_random(g) % 16;
+	if (depth > 0 && r < 3) {
+		gen_append(g, "(");
+		gen_alt(g, depth - 1);
+		gen_append(g, ")");
+	}
+	else if (depth > 0 && r < 6) {
+		gen_append(g, "(?:");
+		gen_alt(g, depth - 1);
+		gen_append(g, ")");
+	}
+	else if (r == 6) {
+		gen_append(g, next_random(g) % 2 ? "^" : "$");
+		return;
+	}
+	else
+		gen_append(g, tokens[next_random(g) % (sizeof(tokens) / sizeof(tokens[0]))]);
+
+	gen_append(g, quantifiers[next_random(g) % (sizeof(quantifiers) / sizeof(quantifiers[0]))]);
+}
+
+static void gen_alt(CheckGen *g, int depth)
+{
+	int alts = 1 + next_random(g) % 3;
+	int i, j;
+	for (i = 0; i < alts; i++) {
+		if (i)
+			gen_append(g, "|");
+
+		int atoms = 1 + next_random(g) % 3;
+		for (j = 0; j < atoms; j++)
+			gen_atom(g, depth);
+	}
+}
+
+static char *gen_regex(CheckGen *g)
+{
+	g->len = 0;
+	gen_append(g, "");
+	gen_alt(g, 2);
+	return g->regex;
+}
+
+static ReOS_Pattern *check_compile(char *regex, int passes)
+{
+	TreeNode *tree = ascii_expression_compile(regex);
+	if (!tree)
+		return 0;
+
+	if (passes & CheckTree)
+		tree = ascii_tree_optimize(tree);
+
+	ReOS_Pattern *pattern = new_mem_pattern();
+	standard_tree_compile(pattern, tree, ascii_inst_factory, ascii_tree_node_compile);
+	if (passes & CheckClosures)
+		standard_pattern_compute_closures(pattern);
+	free_ascii_tree_node(tree);
+	return pattern;
+}
+
+/**
+ * Runs \a pattern over \a input and writes out every match it reports.
+ */
+static void check_run(ReOS_Pattern *pattern, char *input, int ops, char *out, long size)
+{
+	ReOS_Kernel *k = new_reos_kernel(pattern, execute_ascii_inst, -1);
+	k->test_backref = ascii_test_backref;
+	k->history_size = standard_pattern_history_size(pattern);
+
+	ReOS_Input *in = new_ascii_string_input(input);
+	reos_kernel_execute(k, in, 0, ops);
+
+	long len = 0;
+	out[0] = 0;
+	foreach_simple(ReOS_CaptureSet, capture_set, k->matches) {
+		len += snprintf(out + len, size - len, "{");
+		if (capture_set->captures) {
+			reos_judylist_iter_begin(ReOS_CompoundList, captures, capture_set->captures) {
+				foreach_compound(ReOS_Capture, capture, captures) {
+					if (len < size)
+						len += snprintf(out + len, size - len, " %ld:[%ld,%ld]", iter_captures,
+										capture->start, capture->end);
+				}
+				reos_judylist_iter_next(captures, capture_set->captures);
+			}
+		}
+		if (len < size)
+			len += snprintf(out + len, size - len, " }");
+		if (len >= size)
+			break;
+	}
+
+	free_reos_kernel(k);
+	free_ascii_string_input(in);
+}
+
+/**
+ * Whether \a regex repeats a group. Backtrack matching doesn't finish on
+ * some of those whose body can match nothing, e.g. (a*)+, so they're only
+ * checked without it.
+ */
+static int repeats_group(char *regex)
+{
+	char *c;
+	for (c = regex; *c; c++) {
+		if (*c == ')' && (c[1] == '*' || c[1] == '+' || c[1] == '{'))
+			return 1;
+	}
+	return 0;
+}
+
+/**
+ * Checks every pass against \a regex as parsed.
+ *
+ * \return The number of runs that differed
+ */
+static int check_pattern(char *regex, int *shown)
+{
+	static char expected[1 << 14], actual[1 << 14];
+
+	ReOS_Pattern *parsed = check_compile(regex, 0);
+	if (!parsed) {
+		fprintf(stderr, "error: could not parse %s\n", regex);
+		exit(2);
+	}
+
+	ReOS_Pattern *optimized[NUM_CHECK_PASSES];
+	int p;
+	for (p = 0; p < NUM_CHECK_PASSES; p++)
+		optimized[p] = check_compile(regex, check_passes[p].passes);
+
+	int modes = repeats_group(regex) ? 1 : 2;
+	int differed = 0;
+	char input[CHECK_INPUT_LENGTH + 1];
+	int len;
+	for (len = 0; len <= CHECK_INPUT_LENGTH; len++) {
+		int bits;
+		for (bits = 0; bits < 1 << len; bits++) {
+			int i;
+			for (i = 0; i < len; i++)
+				input[i] = bits & 1 << i ? 'b' : 'a';
+			input[len] = 0;
+
+			int backtrack;
+			for (backtrack = 0; backtrack < modes; backtrack++) {
+				int ops = backtrack ? REOS_BACKTRACK_MATCHING : 0;
+				check_run(parsed, input, ops, expected, sizeof(expected));
+
+				for (p = 0; p < NUM_CHECK_PASSES; p++) {
+					check_run(optimized[p], input, ops, actual, sizeof(actual));
+					if (strcmp(expected, actual)) {
+						differed++;
+						if ((*shown)++ < CHECK_MAX_SHOWN)
+							printf("%s on \"%s\"%s, %s pass:\n  parsed:    %s\n  optimized: %s\n", regex,
+								   input, backtrack ? " backtracking" : "", check_passes[p].name,
+								   expected, actual);
+					}
+				}
+			}
+		}
+	}
+
+	free_mem_pattern(parsed);
+	for (p = 0; p < NUM_CHECK_PASSES; p++)
+		free_mem_pattern(optimized[p]);
+	return differed;
+}
+
+static void print_usage()
+{
+	fprintf(stderr,
+			"Usage: check_optimize [OPTION]...\n"
+			"Options:\n"
+			"	-n, --patterns NUM\n"
+			"		check NUM generated patterns after the fixed ones (default: 1000)\n"
+			"	--seed SEED\n"
+			"		generate patterns from SEED\n"
+			"	-h, --help\n"
+			"		display this help\n");
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	long num_patterns = 1000;
+	unsigned long long seed = 0x2545f4914f6cdd1dULL;
+
+	int i;
+	for (i = 1; i < argc; i++) {
+		if ((!strcmp(argv[i], "-n") || !strcmp(argv[i], "--patterns")) && i+1 < argc)
+			num_patterns = atol(argv[++i]);
+		else if (!strcmp(argv[i], "--seed") && i+1 < argc)
+			seed = strtoull(argv[++i], 0, 0);
+		else
+			print_usage();
+	}
+
+	CheckGen g = {0, 0, 0, seed ? seed : 1};
+	long checked = 0, failed = 0;
+	int shown = 0;
+
+	for (i = 0; i < NUM_CHECK_PATTERNS; i++, checked++)
+		failed += check_pattern(check_patterns[i], &shown) > 0;
+	for (i = 0; i < num_patterns; i++, checked++)
+		failed += check_pattern(gen_regex(&g), &shown) > 0;
+
+	printf("%ld of %ld patterns changed by a pass\n", failed, checked);
+	free(g.regex);
+	return failed ? 1 : 0;
+}